@@ -5,6 +5,13 @@
 #include "Definitions.h"
 #include "GainControl.h"
 #include "Track.h"
+#include "TransferScheduler.h"
+#include "PageAllocator.h"
+#include "Profiler.h"
+#include "DeferredLog.h"
+#include "MidiClockOut.h"
+#include "SampleClock.h"
+#include "SpscRing.h"
 
 class AudioLooper : public AudioStream {
 public:
@@ -16,15 +23,18 @@ public:
     RESET
   };
 
-  AudioLooper(void) : AudioStream(1, inputQueueArray) {
+  AudioLooper(void) : AudioStream(1, inputQueueArray), xfer(&ram), lastSyncSample(0) {
     for (int i = 0; i < NUM_LOOPS; i++) {
-      tracks[i] = new Track(&ram);
+      tracks[i] = new Track(&ram, &pager);
     }
     hardReset();
   }
 
   void begin() {
     ram.begin();
+    for (int i = 0; i < NUM_LOOPS; i++) {
+      tracks[i]->beginSpill();
+    }
   }
 
   bool isWaiting() {
@@ -55,89 +65,119 @@ public:
     return false;
   }
 
-  void updateSmartMute(float potValue) {
-    if (state == RESET || reqState == RESET) return;
+  // --- Main Loop side: requests are queued and applied by the audio ISR ---
 
-    // Track 0 (Base) is always unmuted
-    tracks[0]->mute(false);
+  // Mutes the layers above the pot position, see applySmartMute()
+  void updateSmartMute(float potValue) { send(Command::SMART_MUTE, 0, potValue); }
 
-    int totalActiveTracks = activeTrackIndex + 1;
-    // If only base track exists, nothing else to do
-    if (totalActiveTracks <= 1) return;
+  // Footswitch: record -> play -> record a new layer. The base loop starts and
+  // ends on the sample `at`, layers stay on the loop grid.
+  void trigger(uint32_t at = SampleClock::precise()) { send(Command::TRIGGER, 0, 0.0f, at); }
 
-    // Handle subsequent tracks
-    for (int i = 1; i < totalActiveTracks; i++) {
-      // Threshold increases with index. 
-      // Example with 3 tracks (0, 1, 2):
-      // Track 1 threshold: 1/3 = 0.33
-      // Track 2 threshold: 2/3 = 0.66
-      float threshold = (float)i / (float)totalActiveTracks;
-      
-      bool shouldMute = potValue <= threshold;
-      tracks[i]->mute(shouldMute);
-    }
-  }
+  void reset() { send(Command::RESET); }
 
-  void trigger() {
-    LOG("AudioLooper::trigger() called. Current State: %d", state);
-    switch (state) {
-      case NONE:
-        reqState = RECORD;
-        LOG("AudioLooper::trigger() -> Requesting RECORD");
-        break;
-      
-      case RECORD:
-        reqState = PLAY;
-        LOG("AudioLooper::trigger() -> Requesting PLAY");
-        break;
+  // Closes the base recording on sample `at`, which may still be ahead (see
+  // TempoSync). A sample already gone by trims the loop to it.
+  void closeLoopAt(uint32_t at) { send(Command::CLOSE, 0, 0.0f, at); }
 
-      case PLAY:
-        reqState = RECORD;
-        LOG("AudioLooper::trigger() -> Requesting RECORD (New Layer)");
-        break;
+  void muteTrack(int track, bool willMute) { send(Command::MUTE, track, willMute ? 1.0f : 0.0f); }
+  void setTrackVolume(int track, float gain) { send(Command::VOLUME, track, gain); }
 
-      default:
-        break;
-    }
+  // Overdub on a playing track, starting or ending on the sample `at`. Each
+  // pass can be undone and redone (see OverdubMap).
+  void overdubTrack(int track, bool on, uint32_t at = SampleClock::precise()) {
+    send(Command::OVERDUB, track, on ? 1.0f : 0.0f, at);
   }
+  void undoOverdub(int track) { send(Command::UNDO, track); }
+  void redoOverdub(int track) { send(Command::REDO, track); }
+
+  // Mixes tracks 0..last into track 0 as they sound, over one lap from the
+  // next loop start, then clears tracks 1..last and moves the layers above
+  // them down. Playback is unchanged throughout. Every track mixed must be
+  // closed and exactly one loop long, or the collapse is refused.
+  void collapse(int last) { send(Command::COLLAPSE, last); }
+  // A collapse is waiting for the loop start or running
+  bool isCollapsing() const { return collapseLast >= 0 || bounceLast >= 0; }
+
+  // Measure sync (FS2 or MIDI CC), stamped for tempo and bar alignment
+  void sync(uint32_t at = SampleClock::precise()) { send(Command::SYNC, 0, 0.0f, at); }
 
   virtual void update(void) {
     audio_block_t *inBlock = receiveReadOnly(0);
     audio_block_t *outBlock = allocate();
 
-    if (!outBlock) {
+    // A skipped block still takes its time on the I2S clock
+    if (!outBlock || !inBlock) {
       if (inBlock) release(inBlock);
+      if (outBlock) release(outBlock);
+      SampleClock::advance();
       return;
     }
-    if (!inBlock) return;
 
-    updateState();
+    PROFILE_BLOCK_BEGIN();
+    {
+      PROFILE_SCOPE(PROF_STATE);
+      processCommands();
+      // A running collapse takes the whole block, unless the loop start moves its ends
+      bounceFrom = 0;
+      bounceTo = AUDIO_BLOCK_SAMPLES;
+      bounceEnding = false;
+      updateState();
+    }
+
+    // zero out the mix bus
+    memset(mixBus, 0, sizeof(mixBus));
+    bool bouncing = bounceLast >= 0;
+    if (bouncing) {
+      memset(bounceBus, 0, sizeof(bounceBus));
+      tracks[0]->setBounceWindow(bounceFrom, bounceTo, bounceEnding);
+    }
 
-    // zero out the output block
-    memset(outBlock->data, 0, sizeof(outBlock->data));
+    // Gather every track's SPI reads, run them as bursts, then mix. The
+    // tracks in use come first (see finishCollapse() and the pruning in
+    // updateState()), the cleared ones after them are idle and skipped.
+    size_t count = getTrackCount();
+    xfer.reset();
+    {
+      PROFILE_SCOPE(PROF_SCHEDULE);
+      for (size_t i = 0; i < count; i++) {
+        tracks[i]->schedule(xfer);
+      }
+    }
+    xfer.executeReads();
 
     // Check if base loop just finished recording to set global timeline
     if (activeTrackIndex == 0 && timeline == 0) {
       if (tracks[0]->getState() == Track::PLAY) {
-        timeline = tracks[0]->getTimelineLength();
-        LOG("AudioLooper -> Global Timeline Set: %d blocks", timeline);
+        timeline = tracks[0]->getLength();
+        playhead = tracks[0]->getPlayhead();
+        LOG_DEFER("AudioLooper -> Global Timeline Set: %d samples", timeline);
       }
     }
 
-    if (timeline > 0) {
-      playhead++;
-      if (playhead >= timeline) {
-        playhead = 0;
-        // LOG("AudioLooper -> Loop Wrap"); // Commented out to avoid spam, uncomment if needed
-      }
+    for (size_t n = 0; n < count; n++) {
+      // While collapsing, track 0 goes last so the mix it stores is complete
+      size_t i = bouncing ? (n + 1) % count : n;
+      PROFILE_SCOPE(PROF_TRACK_0 + i);
+      tracks[i]->update(inBlock, bouncing && (int)i <= bounceLast ? bounceBus : mixBus, xfer);
     }
-
-    for (size_t i = 0; i < NUM_LOOPS; i++) {
-      tracks[i]->update(inBlock, outBlock);
+    if (bouncing) {
+      for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) mixBus[i] += bounceBus[i];
     }
-
-    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
-      outBlock->data[i] *= gc_volume.get(i);
+    xfer.executeWrites();
+    if (bounceEnding) finishCollapse();
+
+    // Master gain and the only saturation stage, two samples per store
+    {
+      PROFILE_SCOPE(PROF_MASTER);
+      int32_t gains[AUDIO_BLOCK_SAMPLES];
+      int gainMask = gc_volume.fillBlock(gains) ? 0 : ~0;
+      uint32_t* outPairs = (uint32_t*)outBlock->data;
+      for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i += 2) {
+        int32_t a = saturate16(gainApply32(gains[i & gainMask], mixBus[i]));
+        int32_t b = saturate16(gainApply32(gains[(i + 1) & gainMask], mixBus[i + 1]));
+        outPairs[i >> 1] = pack_16b_16b(b, a);
+      }
     }
 
     transmit(outBlock, 0);
@@ -145,55 +185,427 @@ public:
     release(inBlock);
 
     gc_volume.update();
+    MidiClockOut::schedule(SampleClock::now(), playhead, timeline);
+    if (timeline > 0) playhead = (playhead + AUDIO_BLOCK_SAMPLES) % timeline;
+    SampleClock::advance();
+
+#if PROFILER_ENABLED
+    if (Profiler::endBlock()) captureProfile();
+#endif
+  }
+
+  // Main Loop: keep every playing track's read-ahead ring topped up
+  void prefetch() {
+    for (size_t i = 0; i < NUM_LOOPS; i++) {
+      tracks[i]->prefetch();
+    }
+  }
+
+  // Main Loop: move spilled loop audio between the SPI RAM rings and SD, and
+  // fold overdub passes past the undo levels into their loops
+  void updateStorage() {
+    for (size_t i = 0; i < NUM_LOOPS; i++) {
+      tracks[i]->updateSpill();
+      tracks[i]->updateOverdub();
+    }
+  }
+
+  // Spilled blocks lost because SD could not keep up
+  uint32_t getSpillUnderruns() {
+    uint32_t total = 0;
+    for (size_t i = 0; i < NUM_LOOPS; i++) {
+      total += tracks[i]->getSpillUnderruns();
+    }
+    return total;
   }
 
-  void reset() {
-    reqState = RESET;
-    LOG("AudioLooper::reset() -> Requesting RESET");
+  // SPI RAM pages holding overdub copies kept for undo
+  int getOverdubPages() {
+    int total = 0;
+    for (size_t i = 0; i < NUM_LOOPS; i++) {
+      total += tracks[i]->getOverdubPages();
+    }
+    return total;
+  }
+
+  // Play blocks that had to be read from SPI inside the ISR
+  uint32_t getPrefetchMisses() {
+    uint32_t total = 0;
+    for (size_t i = 0; i < NUM_LOOPS; i++) {
+      total += tracks[i]->getPrefetchMisses();
+    }
+    return total;
+  }
+
+  // SPI RAM pages not owned by any track
+  int getFreePages() const { return pager.getFreePages(); }
+  int getTotalPages() const { return pager.getTotalPages(); }
+
+  // Global loop position of the next block and loop length, in samples
+  // (0 until the base loop closes)
+  size_t getPlayhead() const { return playhead; }
+  size_t getTimeline() const { return timeline; }
+
+  // SPI traffic of the last processed block
+  uint32_t getSpiTransactions() const { return xfer.getTransactionCount(); }
+  uint32_t getSpiBytes() const { return xfer.getBytesMoved(); }
+
+  // Commands refused because the queue was full
+  uint32_t getCommandOverflows() const { return commands.getOverflows(); }
+
+  // Sample time of the last sync() once the ISR has seen it
+  uint32_t getLastSyncSample() const { return lastSyncSample; }
+
+  // Sample the base loop starts on, valid once recording has started
+  uint32_t getRecordStartSample() const { return recordStartSample; }
+
+  // --- Session save and restore (see SessionStore) ---
+
+  Track* getTrack(int index) { return tracks[index]; }
+  // Tracks in use, the one recording included
+  int getTrackCount() const { return state == NONE ? 0 : activeTrackIndex + 1; }
+
+  // Main Loop, with the audio ISR held off and the looper idle: the first
+  // `count` tracks have been set up by Track::beginRestore(). The looper waits
+  // in STOP, ignoring triggers, until playRestored(0) starts the base loop.
+  bool beginRestore(int count) {
+    if (state != NONE || count < 1 || count > NUM_LOOPS) return false;
+    activeTrackIndex = count - 1;
+    state = STOP;
+    return true;
+  }
+
+  // Main Loop: a restored track has enough blocks loaded to play. The base
+  // loop starts on the next block, the others join at the next loop start.
+  void playRestored(int track) { send(Command::RESTORE, track); }
+
+  // Stored block writes so far; the autosave journal scans when this moves
+  uint32_t getStoredWrites() const { return pager.getWrites(); }
+
+  // Blocks played as silence because a restore had not loaded them yet
+  uint32_t getRestoreUnderruns() {
+    uint32_t total = 0;
+    for (size_t i = 0; i < NUM_LOOPS; i++) {
+      total += tracks[i]->getRestoreUnderruns();
+    }
+    return total;
   }
 
 private:
+  // A control request from loop(), stamped with the sample time it was made
+  struct Command {
+    enum Type : uint8_t { TRIGGER, RESET, SMART_MUTE, MUTE, VOLUME, SYNC, CLOSE, RESTORE, OVERDUB, UNDO, REDO, COLLAPSE };
+    Type type;
+    uint8_t track;      // MUTE, VOLUME, RESTORE, OVERDUB, UNDO, REDO, last track of a COLLAPSE
+    float value;        // SMART_MUTE pot position, MUTE 1/0, VOLUME gain, OVERDUB 1/0
+    uint32_t timestamp; // sample it applies to, SampleClock::precise() by default
+  };
+
   audio_block_t *inputQueueArray[1];
   Track* tracks[NUM_LOOPS];
+  int32_t mixBus[AUDIO_BLOCK_SAMPLES]; // wide accumulator, saturated once per block
+  int32_t bounceBus[AUDIO_BLOCK_SAMPLES]; // the tracks being collapsed, added to mixBus after
   Ram ram;
+  PageAllocator pager;
+  TransferScheduler xfer;
   GainControl gc_volume;
   volatile State state, reqState;
-  size_t playhead; // by blocks
-  size_t timeline; // by blocks
+  uint32_t reqSample; // sample the command behind reqState applies to
+  SpscRing<Command, COMMAND_QUEUE_SIZE> commands; // loop() -> audio ISR
+  volatile uint32_t lastSyncSample;
+  volatile uint32_t recordStartSample;
+  size_t playhead; // loop position of the block being processed, in samples
+  size_t timeline; // loop length in samples
   int activeTrackIndex;
+  uint32_t restorePending; // restored tracks waiting for the loop start, one bit each
   volatile bool shouldResetPot;
+  // Collapse: last track of a requested one, and of the running one; -1 for none
+  volatile int collapseLast, bounceLast;
+  int bounceFrom, bounceTo; // output samples of this block stored by track 0
+  bool bounceEnding;        // this block closes the lap
+
+#if PROFILER_ENABLED
+  // Stores the looper state next to a new worst-case block
+  void captureProfile() {
+    Profiler::Snapshot& snapshot = Profiler::worstSnapshot();
+    snapshot.looperState = (uint8_t)state;
+    snapshot.activeTrack = (uint8_t)activeTrackIndex;
+    snapshot.playhead = playhead;
+    snapshot.timeline = timeline;
+    for (int i = 0; i < NUM_LOOPS; i++) {
+      snapshot.trackState[i] = (uint8_t)tracks[i]->getState();
+    }
+  }
+#endif
 
   void hardReset() {
-    LOG("AudioLooper::hardReset() called");
+    LOG_DEFER("AudioLooper::hardReset() called");
     gc_volume.hardReset(1.0f);
     state = NONE;
     reqState = NONE;
-    playhead = 0; // by blocks
-    timeline = 0; // by blocks
+    reqSample = 0;
+    recordStartSample = 0;
+    playhead = 0;
+    timeline = 0;
     activeTrackIndex = 0;
+    restorePending = 0;
     shouldResetPot = false;
+    collapseLast = -1;
+    bounceLast = -1;
+    bounceFrom = 0;
+    bounceTo = 0;
+    bounceEnding = false;
+  }
+
+  // Main Loop: stamps and queues one command
+  void send(Command::Type type, int track = 0, float value = 0.0f, uint32_t at = SampleClock::now()) {
+    Command command = { type, (uint8_t)track, value, at };
+    if (!commands.push(command)) {
+      LOG("AudioLooper: command queue full, dropped command %d", type);
+    }
+  }
+
+  // Audio ISR: applies the queued commands up to the end of this block in
+  // arrival order. Later ones wait for their block, except CLOSE which
+  // updateState() holds itself.
+  void processCommands() {
+    Command command;
+    while (commands.peek(command)) {
+      bool later = (int32_t)(command.timestamp - SampleClock::now()) >= AUDIO_BLOCK_SAMPLES;
+      if (later && command.type != Command::CLOSE) break;
+      commands.pop(command);
+
+      switch (command.type) {
+        case Command::TRIGGER:
+          applyTrigger(command.timestamp);
+          break;
+
+        case Command::RESET:
+          LOG_DEFER("AudioLooper::reset() -> Requesting RESET");
+          reqState = RESET;
+          reqSample = command.timestamp;
+          break;
+
+        case Command::SMART_MUTE:
+          applySmartMute(command.value);
+          break;
+
+        case Command::MUTE:
+          if (command.track < NUM_LOOPS) tracks[command.track]->mute(command.value != 0.0f);
+          break;
+
+        case Command::VOLUME:
+          if (command.track < NUM_LOOPS) tracks[command.track]->setVolume(command.value);
+          break;
+
+        case Command::SYNC:
+          lastSyncSample = command.timestamp;
+          break;
+
+        case Command::CLOSE:
+          if (reqState != RESET && state == RECORD && timeline == 0) {
+            LOG_DEFER("AudioLooper::closeLoopAt() -> Requesting PLAY at %d", command.timestamp);
+            reqState = PLAY;
+            reqSample = command.timestamp;
+          }
+          break;
+
+        case Command::RESTORE:
+          if (reqState == RESET || command.track > activeTrackIndex) break;
+          if (command.track == 0 && state == STOP) {
+            // The restored base loop starts on this block
+            tracks[0]->play(0);
+            timeline = tracks[0]->getLength();
+            playhead = 0;
+            state = PLAY;
+            LOG_DEFER("AudioLooper -> Restored loop playing: %d samples", timeline);
+          } else if (state == PLAY) {
+            restorePending |= 1u << command.track;
+          }
+          break;
+
+        case Command::OVERDUB:
+          // A track being collapsed plays as it is until the lap is stored
+          if (reqState != RESET && command.track <= activeTrackIndex && (int)command.track > bounceLast) {
+            applyOverdub(tracks[command.track], command.value != 0.0f, command.timestamp);
+          }
+          break;
+
+        case Command::UNDO:
+        case Command::REDO:
+          if (reqState == RESET || command.track > activeTrackIndex) break;
+          if (command.type == Command::UNDO && tracks[command.track]->undo()) {
+            LOG_DEFER("AudioLooper -> Track %d overdub undone", command.track);
+          } else if (command.type == Command::REDO && tracks[command.track]->redo()) {
+            LOG_DEFER("AudioLooper -> Track %d overdub redone", command.track);
+          }
+          break;
+
+        case Command::COLLAPSE:
+          if (reqState != RESET && state != RESET && timeline > 0 && !isCollapsing()) {
+            LOG_DEFER("AudioLooper::collapse() -> Collapsing tracks 0..%d at the next loop start", command.track);
+            collapseLast = command.track;
+          }
+          break;
+      }
+    }
+  }
+
+  void applyTrigger(uint32_t timestamp) {
+    // A pending RESET wins over anything queued after it
+    if (reqState == RESET) return;
+
+    LOG_DEFER("AudioLooper::trigger() called. Current State: %d", state);
+    switch (state) {
+      case NONE:
+        reqState = RECORD;
+        LOG_DEFER("AudioLooper::trigger() -> Requesting RECORD");
+        break;
+      
+      case RECORD:
+        reqState = PLAY;
+        LOG_DEFER("AudioLooper::trigger() -> Requesting PLAY");
+        break;
+
+      case PLAY:
+        reqState = RECORD;
+        LOG_DEFER("AudioLooper::trigger() -> Requesting RECORD (New Layer)");
+        break;
+
+      default:
+        return;
+    }
+    reqSample = timestamp;
+  }
+
+  // Punch in or out on the sample `timestamp`, inside this block
+  void applyOverdub(Track* track, bool on, uint32_t timestamp) {
+    int32_t ahead = (int32_t)(timestamp - SampleClock::now());
+    int offset = ahead < 0 ? 0 : ahead;
+    if (on && state == PLAY && track->getState() == Track::PLAY) {
+      track->overdub(offset);
+    } else if (!on && track->getState() == Track::OVERDUB) {
+      track->play(offset);
+    }
+  }
+
+  // Audio ISR, on a loop start: track 0 starts storing the mix at sample `offset`
+  void startCollapse(int offset) {
+    int last = collapseLast;
+    collapseLast = -1;
+    // A layer still recording stays out
+    int closed = state == RECORD ? activeTrackIndex - 1 : activeTrackIndex;
+    if (last > closed) last = closed;
+
+    bool ok = last >= 1 && restorePending == 0;
+    for (int i = 1; ok && i <= last; i++) {
+      ok = tracks[i]->canBounce(timeline);
+    }
+    if (!ok || !tracks[0]->beginBounce()) {
+      LOG_DEFER("AudioLooper -> Collapse of tracks 0..%d refused, a track is not a closed single-lap loop", last);
+      return;
+    }
+    bounceLast = last;
+    bounceFrom = offset;
+    LOG_DEFER("AudioLooper -> Collapsing tracks 0..%d into track 0 from sample %d", last, offset);
+  }
+
+  // Audio ISR, after the last collapse block: the mixed tracks are cleared,
+  // the layers above them move down and the cleared tracks go to the top
+  void finishCollapse() {
+    int last = bounceLast;
+    tracks[0]->endBounce();
+
+    Track* cleared[NUM_LOOPS];
+    for (int i = 1; i <= last; i++) {
+      tracks[i]->forceClear();
+      cleared[i - 1] = tracks[i];
+    }
+    int to = 1;
+    for (int i = last + 1; i < NUM_LOOPS; i++) tracks[to++] = tracks[i];
+    for (int i = 0; i < last; i++) tracks[to++] = cleared[i];
+    activeTrackIndex -= last;
+
+    bounceLast = -1;
+    bounceEnding = false;
+    shouldResetPot = true;
+    LOG_DEFER("AudioLooper -> Collapse done, %d tracks in use", activeTrackIndex + 1);
+  }
+
+  void applySmartMute(float potValue) {
+    if (state == RESET || reqState == RESET) return;
+
+    // Track 0 (Base) is always unmuted
+    tracks[0]->mute(false);
+
+    int totalActiveTracks = activeTrackIndex + 1;
+    // If only base track exists, nothing else to do
+    if (totalActiveTracks <= 1) return;
+
+    // Handle subsequent tracks
+    for (int i = 1; i < totalActiveTracks; i++) {
+      // Threshold increases with index. 
+      // Example with 3 tracks (0, 1, 2):
+      // Track 1 threshold: 1/3 = 0.33
+      // Track 2 threshold: 2/3 = 0.66
+      float threshold = (float)i / (float)totalActiveTracks;
+      
+      bool shouldMute = potValue <= threshold;
+      tracks[i]->mute(shouldMute);
+    }
   }
 
   void updateState() {
     // Prioritize RESET request: ignore sync wait
     if (reqState == RESET) {
-      LOG("AudioLooper::updateState() -> Starting RESET Sequence (Fade Out)");
+      LOG_DEFER("AudioLooper::updateState() -> Starting RESET Sequence (Fade Out)");
       gc_volume.mute();
 
       state = reqState;
       reqState = NONE;
     }
 
-    // Wait for the start of the global loop to sync state changes
+    // Wait for the block holding the start of the global loop to sync state changes,
+    // they land on its exact sample. The base loop takes the sample it was asked for.
     // Exception: If we are in RESET state, we continue to process logic immediately
-    if (state != RESET && timeline > 0 && playhead != 0) return;
+    int offset = 0;
+    if (state != RESET && timeline > 0) {
+      size_t toStart = playhead == 0 ? 0 : timeline - playhead;
+      if (toStart >= AUDIO_BLOCK_SAMPLES) return;
+      offset = (int)toStart;
+
+      // Restored layers that finished loading join here
+      for (int i = 1; restorePending != 0 && i < NUM_LOOPS; i++) {
+        if ((restorePending & (1u << i)) && tracks[i]->getState() == Track::STOP) tracks[i]->play(offset);
+      }
+      restorePending = 0;
+
+      // A collapse runs from one loop start to the next
+      if (bounceLast >= 0) {
+        bounceFrom = 0;
+        bounceTo = offset;
+        bounceEnding = true;
+      } else if (collapseLast >= 0) {
+        startCollapse(offset);
+      }
+    } else if (reqState != NONE && state != RESET) {
+      int32_t ahead = (int32_t)(reqSample - SampleClock::now());
+      if (ahead >= AUDIO_BLOCK_SAMPLES) return;
+      offset = ahead < 0 ? 0 : ahead;
+
+      // The base loop was asked to end on a sample already recorded past
+      if (ahead < 0 && state == RECORD && reqState == PLAY) {
+        tracks[0]->trimLength(reqSample - recordStartSample);
+      }
+    }
 
     switch (state) {
       case NONE:
         if (reqState == RECORD) {
           activeTrackIndex = 0;
-          LOG("AudioLooper::updateState() -> Starting Recording on Track %d", activeTrackIndex);
-          tracks[activeTrackIndex]->record();
+          LOG_DEFER("AudioLooper::updateState() -> Starting Recording on Track %d at sample %d", activeTrackIndex, offset);
+          tracks[activeTrackIndex]->record(offset);
+          recordStartSample = SampleClock::now() + offset;
 
           state = reqState;
           reqState = NONE;
@@ -202,8 +614,8 @@ private:
       
       case RECORD:
         if (reqState == PLAY) {
-          LOG("AudioLooper::updateState() -> Stopping Recording, Starting Playback on Track %d", activeTrackIndex);
-          tracks[activeTrackIndex]->play();
+          LOG_DEFER("AudioLooper::updateState() -> Stopping Recording, Starting Playback on Track %d", activeTrackIndex);
+          tracks[activeTrackIndex]->play(offset);
 
           state = reqState;
           reqState = NONE;
@@ -212,9 +624,10 @@ private:
 
       case PLAY:
         if (reqState == RECORD) {
-          // 1. Prune muted tracks
-          while (activeTrackIndex > 0 && tracks[activeTrackIndex]->getMuteState()) {
-            LOG("AudioLooper::updateState() -> Pruning Muted Track %d", activeTrackIndex);
+          // 1. Prune muted tracks, but none that a collapse mixes
+          int keep = bounceLast > collapseLast ? bounceLast : collapseLast;
+          while (activeTrackIndex > 0 && activeTrackIndex > keep && tracks[activeTrackIndex]->getMuteState()) {
+            LOG_DEFER("AudioLooper::updateState() -> Pruning Muted Track %d", activeTrackIndex);
             tracks[activeTrackIndex]->forceClear();
             activeTrackIndex--;
           }
@@ -222,13 +635,13 @@ private:
           // 2. Only transition if we have space (after pruning)
           if (activeTrackIndex < NUM_LOOPS - 1) {
             activeTrackIndex++;
-            LOG("AudioLooper::updateState() -> Starting New Layer Recording on Track %d", activeTrackIndex);
-            tracks[activeTrackIndex]->record();
+            LOG_DEFER("AudioLooper::updateState() -> Starting New Layer Recording on Track %d", activeTrackIndex);
+            tracks[activeTrackIndex]->record(offset);
             shouldResetPot = true;
 
             state = reqState;
           } else {
-             LOG("AudioLooper::updateState() -> Max Tracks Reached (%d). Cannot Record New Layer.", activeTrackIndex);
+             LOG_DEFER("AudioLooper::updateState() -> Max Tracks Reached (%d). Cannot Record New Layer.", activeTrackIndex);
           }
 
           reqState = NONE;
@@ -244,7 +657,7 @@ private:
           }
 
           hardReset();
-          LOG("AudioLooper::updateState() -> RESET Complete");
+          LOG_DEFER("AudioLooper::updateState() -> RESET Complete");
         }
         break;
 
@@ -0,0 +1,301 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <SD.h>
+#include "Definitions.h"
+#include "GainControl.h"
+#include "StorageCodec.h"
+#include "SpscRing.h"
+#include "Hal.h"
+
+// On-device micro benchmarks. Run once from setup() when RUN_BENCHMARKS is set,
+// before the audio graph is busy. Results are printed through LOG(), so
+// without DEBUG_MODE there is nothing to run.
+class Benchmark {
+public:
+  static void runAll() {
+#if DEBUG_MODE
+    LOG("--- Running Benchmarks ---");
+    gainControl();
+    storageCodec();
+    sdStreaming();
+    spscRing();
+    LOG("--- Benchmarks Done ---");
+#endif
+  }
+
+private:
+#if DEBUG_MODE
+  static const int BENCH_BLOCKS = 1000;
+
+  static inline uint32_t cycles() { return Hal::cycles(); }
+
+  // --- SD streaming ---
+  static const int SD_BENCH_BATCHES = 400;  // 400 x 8 KB, about 37 s of audio
+  static const int SD_BATCH_BYTES = 8192;   // one MemorySd batch
+  static const int HIST_BUCKETS = 18;       // bucket b counts [2^b, 2^(b+1)) us
+
+  // Same gain work as a Track in OVERDUB with an active crossfade:
+  // per-sample float get() against the Q16 block API.
+  static void gainControl() {
+    GainControl gcVolume, gcRecord, gcXfade;
+    int16_t in[AUDIO_BLOCK_SAMPLES], play[AUDIO_BLOCK_SAMPLES], xfade[AUDIO_BLOCK_SAMPLES];
+    int16_t out[AUDIO_BLOCK_SAMPLES], rec[AUDIO_BLOCK_SAMPLES];
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      in[i] = (int16_t)(i * 97);
+      play[i] = (int16_t)(i * 53);
+      xfade[i] = (int16_t)(i * 31);
+    }
+
+    // Before: float get() per sample, per gain
+    uint32_t start = cycles();
+    for (int b = 0; b < BENCH_BLOCKS; b++) {
+      restartFades(b, gcVolume, gcRecord, gcXfade);
+      for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        int32_t s_out = play[i] + (int32_t)(xfade[i] * gcXfade.get(i));
+        int32_t s_rec = (int32_t)(in[i] * gcRecord.get(i)) + s_out;
+        rec[i] = (int16_t)(s_rec * FEEDBACK_MULTIPLIER);
+        s_out *= gcVolume.get(i);
+        out[i] = (int16_t)SAMPLE_LIMITER(s_out);
+      }
+      advance(gcVolume, gcRecord, gcXfade);
+    }
+    uint32_t floatCycles = cycles() - start;
+
+    // After: one fillBlock() per gain, fixed-point multiply + saturate
+    int32_t volGains[AUDIO_BLOCK_SAMPLES], recGains[AUDIO_BLOCK_SAMPLES], xfadeGains[AUDIO_BLOCK_SAMPLES];
+    const int32_t feedback = GAIN_TO_Q16(FEEDBACK_MULTIPLIER);
+    start = cycles();
+    for (int b = 0; b < BENCH_BLOCKS; b++) {
+      restartFades(b, gcVolume, gcRecord, gcXfade);
+      int volMask = gcVolume.fillBlock(volGains) ? 0 : ~0;
+      int recMask = gcRecord.fillBlock(recGains) ? 0 : ~0;
+      int xfadeMask = gcXfade.fillBlock(xfadeGains) ? 0 : ~0;
+      for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        int32_t s_out = play[i] + gainApply16(xfadeGains[i & xfadeMask], xfade[i]);
+        int32_t s_rec = gainApply16(recGains[i & recMask], in[i]) + s_out;
+        rec[i] = saturate16(gainApply32(feedback, s_rec));
+        out[i] = saturate16(gainApply32(volGains[i & volMask], s_out));
+      }
+      advance(gcVolume, gcRecord, gcXfade);
+    }
+    uint32_t fixedCycles = cycles() - start;
+
+    LOG("GainControl: float get() %lu cycles/block, fillBlock() %lu cycles/block (out %d, rec %d)",
+        floatCycles / BENCH_BLOCKS, fixedCycles / BENCH_BLOCKS, out[1], rec[1]);
+  }
+
+  // SNR and encode/decode cost of every storage codec, whichever one is selected
+  static void storageCodec() {
+    int16_t pcm[AUDIO_BLOCK_SAMPLES], decoded[AUDIO_BLOCK_SAMPLES];
+    int16_t stored[AUDIO_BLOCK_SAMPLES];
+
+    codecRun("PCM16", pcm, decoded, stored, nullptr, nullptr);
+    codecRun("BFP8", pcm, decoded, stored, StorageCodec::encodeBfp8, StorageCodec::decodeBfp8);
+    codecRun("ADPCM", pcm, decoded, stored, StorageCodec::encodeAdpcm, StorageCodec::decodeAdpcm);
+  }
+
+  typedef void (*CodecFn)(const int16_t*, int16_t*);
+
+  static void codecRun(const char* name, int16_t* pcm, int16_t* decoded, int16_t* stored,
+                       CodecFn encode, CodecFn decode) {
+    uint32_t encodeCycles = 0, decodeCycles = 0;
+    float signal = 0.0f, noise = 0.0f;
+    uint32_t seed = 1;
+
+    for (int b = 0; b < BENCH_BLOCKS; b++) {
+      // Guitar-ish test signal: two partials plus a little noise
+      for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        int n = b * AUDIO_BLOCK_SAMPLES + i;
+        seed = seed * 1664525u + 1013904223u;
+        float v = 9000.0f * sinf(n * 0.0621f) + 3000.0f * sinf(n * 0.2417f) + (float)((int32_t)(seed >> 20) - 2048);
+        pcm[i] = (int16_t)v;
+      }
+
+      uint32_t start = cycles();
+      if (encode) encode(pcm, stored);
+      else memcpy(stored, pcm, sizeof(int16_t) * AUDIO_BLOCK_SAMPLES);
+      encodeCycles += cycles() - start;
+
+      start = cycles();
+      if (decode) decode(stored, decoded);
+      else memcpy(decoded, stored, sizeof(int16_t) * AUDIO_BLOCK_SAMPLES);
+      decodeCycles += cycles() - start;
+
+      for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        float err = (float)(pcm[i] - decoded[i]);
+        signal += (float)pcm[i] * (float)pcm[i];
+        noise += err * err;
+      }
+    }
+
+    float snr = noise > 0.0f ? 10.0f * log10f(signal / noise) : 999.0f;
+    LOG("StorageCodec %s: SNR %.1f dB, encode %lu cycles/block, decode %lu cycles/block",
+        name, snr, encodeCycles / BENCH_BLOCKS, decodeCycles / BENCH_BLOCKS);
+  }
+
+  // Latency of each SD batch MemorySd moves while a track records and plays
+  // back, one write then one read per pass. The old pattern seeks every batch,
+  // stages through a 2-byte aligned buffer and lets the file grow cluster by
+  // cluster; the new one preallocates, stays aligned and skips no-op seeks.
+  // Needs the SD card, so runAll() must come after looper.begin().
+  static void sdStreaming() {
+    sdPattern("grow+seek", false);
+    sdPattern("preallocated", true);
+    SD.remove(SD_BENCH_FILE);
+  }
+
+  static constexpr const char* SD_BENCH_FILE = "bench.bin";
+
+  static void sdPattern(const char* name, bool preallocated) {
+    SD_DMA_ALIGNED static uint8_t buffer[SD_BATCH_BYTES + 32];
+    uint8_t* data = preallocated ? buffer : buffer + 2;
+    uint32_t writeHist[HIST_BUCKETS] = {0};
+    uint32_t readHist[HIST_BUCKETS] = {0};
+    uint32_t worstWrite = 0, worstRead = 0;
+
+    SD.remove(SD_BENCH_FILE);
+    Hal::StreamFile file = Hal::createStreamFile(SD_BENCH_FILE);
+    if (!file) {
+      LOG("SD %s: cannot open %s", name, SD_BENCH_FILE);
+      return;
+    }
+    if (preallocated && !file.preAllocate((uint64_t)SD_BENCH_BATCHES * SD_BATCH_BYTES)) {
+      LOG("SD %s: preAllocate failed", name);
+    }
+
+    size_t position = 0, writeCursor = 0, readCursor = 0;
+    for (int b = 0; b < SD_BENCH_BATCHES; b++) {
+      memset(data, b, SD_BATCH_BYTES);
+
+      uint32_t start = Hal::microseconds();
+      if (!preallocated || position != writeCursor) file.seekSet(writeCursor);
+      file.write(data, SD_BATCH_BYTES);
+      uint32_t elapsed = Hal::microseconds() - start;
+      writeCursor += SD_BATCH_BYTES;
+      position = writeCursor;
+      addToHistogram(writeHist, elapsed, worstWrite);
+
+      start = Hal::microseconds();
+      if (!preallocated || position != readCursor) file.seekSet(readCursor);
+      file.read(data, SD_BATCH_BYTES);
+      elapsed = Hal::microseconds() - start;
+      readCursor += SD_BATCH_BYTES;
+      position = readCursor;
+      addToHistogram(readHist, elapsed, worstRead);
+    }
+    file.close();
+
+    LOG("SD %s: worst write %lu us, worst read %lu us", name, worstWrite, worstRead);
+    printHistogram("  write", writeHist);
+    printHistogram("  read ", readHist);
+  }
+
+  static void addToHistogram(uint32_t* hist, uint32_t micros, uint32_t& worst) {
+    int bucket = 0;
+    while (bucket < HIST_BUCKETS - 1 && (micros >> (bucket + 1)) != 0) bucket++;
+    hist[bucket]++;
+    if (micros > worst) worst = micros;
+  }
+
+  // One line per direction: "<2^b us>:<count>" for every non-empty bucket
+  static void printHistogram(const char* label, const uint32_t* hist) {
+    char line[256];
+    int len = snprintf(line, sizeof(line), "%s", label);
+    for (int b = 0; b < HIST_BUCKETS && len < (int)sizeof(line); b++) {
+      if (hist[b] == 0) continue;
+      len += snprintf(line + len, sizeof(line) - len, " %lu:%lu", 1ul << b, (unsigned long)hist[b]);
+    }
+    LOG("%s", line);
+  }
+
+  // --- SpscRing ---
+  typedef SpscRing<uint32_t, 256> BenchRing;
+  static const uint32_t STRESS_MS = 500;
+  static inline BenchRing* stressRing = nullptr;
+  static inline volatile uint32_t stressNext = 0;
+
+  // Producer for the stress test, runs in a timer interrupt like the audio ISR
+  static void stressProducer() {
+    uint32_t burst[4];
+    for (int i = 0; i < 4; i++) burst[i] = stressNext + i;
+    stressNext += stressRing->pushBulk(burst, 4);
+  }
+
+  // Ops/sec for single and bulk transfers, then an ISR -> loop() stress run
+  // that checks every value arrives once and in order.
+  static void spscRing() {
+    static BenchRing ring;
+    const int ops = BENCH_BLOCKS * 100;
+    uint32_t value = 0;
+
+    uint32_t start = cycles();
+    for (int i = 0; i < ops; i++) {
+      ring.push((uint32_t)i);
+      ring.pop(value);
+    }
+    uint32_t singleCycles = cycles() - start;
+
+    uint32_t batch[32];
+    for (int i = 0; i < 32; i++) batch[i] = i;
+    start = cycles();
+    for (int i = 0; i < ops / 32; i++) {
+      ring.pushBulk(batch, 32);
+      ring.popBulk(batch, 32);
+    }
+    uint32_t bulkCycles = cycles() - start;
+
+    LOG("SpscRing: push+pop %lu Mops/s, bulk(32) %lu Mops/s",
+        megaOpsPerSecond(ops, singleCycles), megaOpsPerSecond((ops / 32) * 32, bulkCycles));
+
+    // Stress: timer ISR produces, this loop consumes
+    ring.reset();
+    stressRing = &ring;
+    stressNext = 0;
+    uint32_t expected = 0, errors = 0;
+    IntervalTimer producer;
+    producer.begin(stressProducer, 5); // us
+    uint32_t until = millis() + STRESS_MS;
+    while ((int32_t)(millis() - until) < 0) {
+      uint32_t got[16];
+      size_t n = ring.popBulk(got, 16);
+      for (size_t i = 0; i < n; i++) {
+        if (got[i] != expected) errors++;
+        expected = got[i] + 1;
+      }
+    }
+    producer.end();
+    while (ring.pop(value)) {
+      if (value != expected) errors++;
+      expected = value + 1;
+    }
+
+    LOG("SpscRing stress: %lu values, %lu order errors, %lu overflows",
+        expected, errors, ring.getOverflows());
+  }
+
+  static uint32_t megaOpsPerSecond(uint32_t ops, uint32_t elapsedCycles) {
+    if (elapsedCycles == 0) return 0;
+    return (uint32_t)((uint64_t)ops * Hal::cyclesPerSecond() / elapsedCycles / 1000000);
+  }
+
+  // Keep roughly half the blocks inside a fade so both paths are exercised
+  static void restartFades(int block, GainControl& a, GainControl& b, GainControl& c) {
+    if (block % (FADE_DURATION_BLOCKS * 2) == 0) {
+      a.hardReset(1.0f); a.fadeOut();
+      b.hardReset(0.0f); b.setGain(1.0f); b.fadeIn();
+      c.hardReset(1.0f); c.fadeOut();
+    }
+  }
+
+  static void advance(GainControl& a, GainControl& b, GainControl& c) {
+    a.update();
+    b.update();
+    c.update();
+  }
+#endif // DEBUG_MODE
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,73 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <Arduino.h>
+#include "Definitions.h"
+#include "SampleClock.h"
+#include "SpscRing.h"
+
+// -------------------------------------------------------------------------
+// DeferredLog
+// Logging for the audio ISR. LOG() formats and writes to Serial on the
+// spot, which can take longer than a whole audio block when the USB buffer
+// is full. LOG_DEFER() only copies the format string pointer, the
+// SampleClock position and up to four integer arguments into a lock-free
+// ring. loop() calls drain() to format and print them.
+// Format strings must be literals (only the pointer is kept) and may only
+// use integer conversions (%d, %u, %x), every argument is stored as int32_t.
+// A full ring drops the record and counts it; drain() reports the drops.
+// With DEBUG_MODE at 0, LOG_DEFER() expands to nothing.
+// -------------------------------------------------------------------------
+class DeferredLog {
+public:
+  static const int MAX_ARGS = 4;
+
+  struct Record {
+    const char* format;
+    uint32_t timestamp; // SampleClock::now() at the call
+    int32_t args[MAX_ARGS];
+  };
+
+  // --- Audio ISR side (single producer) ---
+
+  template <typename... Args>
+  static void push(const char* format, Args... args) {
+    static_assert(sizeof...(Args) <= MAX_ARGS, "LOG_DEFER takes at most four arguments");
+    Record record = { format, SampleClock::now(), { (int32_t)args... } };
+    ring.push(record);
+  }
+
+  // --- Main Loop side ---
+
+  // Prints up to `maxRecords` queued records, oldest first, prefixed with
+  // their sample timestamp
+  static void drain(size_t maxRecords = LOG_DRAIN_RECORDS) {
+    Record record;
+    for (size_t i = 0; i < maxRecords && ring.pop(record); i++) {
+      Serial.printf("[%lu] ", (unsigned long)record.timestamp);
+      Serial.printf(record.format, record.args[0], record.args[1], record.args[2], record.args[3]);
+      Serial.println();
+    }
+
+    uint32_t dropped = ring.getOverflows();
+    if (dropped != reportedDrops) {
+      LOG("DeferredLog: %lu records dropped (ring full)", (unsigned long)(dropped - reportedDrops));
+      reportedDrops = dropped;
+    }
+  }
+
+  // Records lost to a full ring since boot
+  static uint32_t getDropped() { return ring.getOverflows(); }
+
+private:
+  static inline SpscRing<Record, LOG_RING_RECORDS> ring;
+  static inline uint32_t reportedDrops = 0;
+};
+
+#if DEBUG_MODE
+  #define LOG_DEFER(...) DeferredLog::push(__VA_ARGS__)
+#else
+  #define LOG_DEFER(...)
+#endif
+
+#endif // DEFERRED_LOG_H
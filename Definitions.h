@@ -2,6 +2,10 @@
 #define DEFINITIONS_H
 
 #define DEBUG_MODE 1
+#define RUN_BENCHMARKS 0 // Run on-device benchmarks once from setup()
+#ifndef PROFILER_ENABLED
+  #define PROFILER_ENABLED 0 // Cycle probes in the audio ISR, dump with 'p' on Serial
+#endif
 
 #if DEBUG_MODE
   #define LOG(...) do { Serial.printf(__VA_ARGS__); Serial.println(); } while (0)
@@ -9,6 +13,13 @@
   #define LOG(...)
 #endif
 
+// Deferred log for the audio ISR (see DeferredLog.h)
+#define LOG_RING_RECORDS 64 // power of two
+#define LOG_DRAIN_RECORDS 8 // printed per loop() pass
+
+// Control commands queued from loop() to the audio ISR (see AudioLooper)
+#define COMMAND_QUEUE_SIZE 64 // power of two
+
 // --- Hardware ---
 #define POT_CALIB_MIN 0
 #define POT_CALIB_MAX 1021
@@ -23,16 +34,112 @@
 #define NUM_LOOPS 8
 #define FEEDBACK_MULTIPLIER 0.95f
 
+// --- Storage Codec ---
+// How loop audio is stored in SPI RAM. Compressed codecs trade quality
+// for loop time and SPI bandwidth (see StorageCodec.h).
+#define CODEC_PCM16 0 // raw 16-bit, 128 words per block
+#define CODEC_BFP8  1 // block floating point, 65 words per block (~2:1)
+#define CODEC_ADPCM 2 // IMA-ADPCM, 34 words per block (~3.8:1)
+#define STORAGE_CODEC CODEC_PCM16
+
+#if STORAGE_CODEC == CODEC_BFP8
+  #define STORAGE_BLOCK_WORDS (1 + BLOCK_SIZE / 2)
+#elif STORAGE_CODEC == CODEC_ADPCM
+  #define STORAGE_BLOCK_WORDS (2 + BLOCK_SIZE / 4)
+#else
+  #define STORAGE_BLOCK_WORDS BLOCK_SIZE
+#endif
+
 // Helpers
 #define SAMPLES_TO_BYTES(x) (x * (BIT_RATE / 8))
 #define MS_TO_SAMPLES(x) ((x * SAMPLE_RATE) / 1000)
 #define SAMPLES_TO_MS(x) ((x * 1000) / SAMPLE_RATE)
 #define SAMPLE_LIMITER(x) (x > 32767 ? 32767 : (x < -32768 ? -32768 : x))
-#define BLOCKS_TO_ADDR(x) ((x) * BLOCK_SIZE)
+#define BLOCKS_TO_ADDR(x) ((x) * STORAGE_BLOCK_WORDS)
+
+// --- SPI RAM Paging ---
+#define PAGE_BLOCKS 64 // stored blocks per page, power of two
+#define PAGE_WORDS BLOCKS_TO_ADDR(PAGE_BLOCKS)
+#define TOTAL_PAGES (TOTAL_SRAM_SAMPLES / PAGE_WORDS)
+
+// --- SD Spill Settings ---
+// Recordings that outgrow SPI RAM keep their start in RAM and stream the
+// rest through MemorySd (SPI RAM ring -> SD file -> SPI RAM ring).
+#define SD_SPILL 1
+#define SPILL_RING_BLOCKS 256 // per direction, per track
+// Track files are preallocated as one contiguous extent at boot, so recording
+// never waits on FAT allocation. 400000 blocks is about 19 min (100 MB) each.
+#define SPILL_FILE_BLOCKS 400000
+#define SD_SECTOR_BYTES 512
+#define SD_SECTOR_BLOCKS (SD_SECTOR_BYTES / (BLOCK_SIZE * 2)) // audio blocks per sector
+// For buffers SD transfers from and to: word aligned for the SDIO DMA,
+// cache-line aligned so the cache flushes around a transfer stay inside
+// the buffer
+#define SD_DMA_ALIGNED alignas(32)
+#if SD_SPILL
+  // MemorySd rings are carved from the bottom of MEM0 by ExternalSramManager
+  #define SPILL_RESERVED_PAGES ((NUM_LOOPS * 2 * SPILL_RING_BLOCKS * BLOCK_SIZE + PAGE_WORDS - 1) / PAGE_WORDS)
+#else
+  #define SPILL_RESERVED_PAGES 0
+#endif
+
+// --- Read-Ahead Settings ---
+// Blocks per track that loop() keeps loaded ahead of the playhead
+#define PREFETCH_BLOCKS 8
 
 // Fade Settings
 #define FADE_DURATION_BLOCKS 3
 
+// --- MIDI Input ---
+// Incoming MIDI is captured by a timer interrupt and stamped on arrival
+// (see MidiInput.h)
+#define MIDI_POLL_US 250     // capture period, also the timestamp resolution
+#define MIDI_RING_BYTES 256  // power of two
+
+// --- Tempo Estimation (see TempoEstimator.h) ---
+#define TEMPO_WINDOW_TICKS 256    // longest fit, power of two (about 2.5 bars of 4/4)
+#define TEMPO_MIN_WINDOW_TICKS 12 // fit kept after a ramp is detected
+#define TEMPO_MIN_FIT_TICKS 6     // ticks before the estimate is used
+#define TEMPO_OUTLIER_SAMPLES 88  // 2 ms, smallest error that rejects a tick
+#define TEMPO_JUMP_TICKS 3        // rejected ticks in a row that mean a tempo jump
+#define TEMPO_TREND_TICKS 6       // one-sided residuals in a row that mean a ramp
+
+// --- MIDI Clock Sync ---
+// Close the base loop on a whole number of bars of the incoming MIDI clock
+// (see TempoSync.h). Toggled at runtime with CC 13.
+#define TEMPO_SYNC_DEFAULT 1
+
+// --- MIDI Clock Output ---
+// Without an external clock the looper sends its own, derived from the base
+// loop length (see MidiClockOut.h). CC 14 sets the beats per loop, 0 is off.
+#define MIDI_CLOCK_OUT_BEATS 4      // beats per loop at boot
+#define MIDI_CLOCK_OUT_MAX_BEATS 64
+#define MIDI_CLOCK_OUT_US 50        // send timer period, bounds the jitter
+#define MIDI_CLOCK_OUT_QUEUE 32     // scheduled events, power of two
+
+// --- Session Snapshot ---
+// CC 15 saves the closed loops to SD; boot restores the newest save and
+// starts the base loop after its first burst (see SessionStore.h)
+#define SESSION_RESTORE 1
+#define SESSION_BURST_BLOCKS 64 // stored blocks per SD transfer and loop() pass
+
+// --- Autosave Journal ---
+// While the loops play, blocks written since the last pass are appended to
+// a journal on SD, a little per loop() pass, and sealed by a commit record.
+// Boot restores the last commit unless a session was saved after it, or
+// there is none (see SessionJournal.h).
+#define AUTOSAVE 1
+#define AUTOSAVE_BUDGET_US 1000   // SD work aimed for per loop() pass
+#define AUTOSAVE_RECORD_BLOCKS 64 // most blocks per journal record
+#define AUTOSAVE_FILE_MB 64       // preallocated per journal file
+
+// --- Overdub Undo ---
+// Overdub passes write copies of the blocks they touch instead of writing
+// over the loop, so undo and redo (CC 17, 18) cost no audio copying
+// (see OverdubMap.h). CC 16 starts and ends a pass on the newest layer.
+#define OVERDUB_UNDO_LEVELS 4 // passes that can be undone, older ones are folded into the loop
+#define OVERDUB_MAP_PAGES 128 // copied pages per track across those passes, below 255
+
 // --- Stomp-Forgiveness Settings ---
 #define FORGIVENESS_MS 300
 #define FORGIVENESS_BLOCKS (MS_TO_SAMPLES(FORGIVENESS_MS) / BLOCK_SIZE + 1)
@@ -2,8 +2,23 @@
 #define GAINCONTROL_H
 
 #include <AudioStream.h>
+#include <utility/dspinst.h>
 #include "Definitions.h"
 
+// Block gains are Q16 fixed point (GAIN_UNITY == 1.0)
+#define GAIN_UNITY 65536
+#define GAIN_TO_Q16(x) ((int32_t)((x) * GAIN_UNITY))
+
+// Applies a Q16 gain to a 16-bit sample (SMULWB on target)
+static inline int32_t gainApply16(int32_t gainQ16, int32_t sample) {
+  return signed_multiply_32x16b(gainQ16, (uint32_t)sample);
+}
+
+// Applies a Q16 gain to a sample that may already exceed 16 bits
+static inline int32_t gainApply32(int32_t gainQ16, int32_t sample) {
+  return (int32_t)(((int64_t)gainQ16 * sample) >> 16);
+}
+
 class GainControl {
 public:
   GainControl() {
@@ -14,6 +29,7 @@ public:
     currentGain = 1.0f;
     // Set blockCounter to Duration so isDone() returns true initially
     blockCounter = FADE_DURATION_BLOCKS; 
+    fadeDelay = 0;
   }
 
   void setGain(float gain) {
@@ -26,8 +42,12 @@ public:
     }
   }
 
+  // Gain to fade to when unmuted
+  float getGain() const { return userGain; }
+
   bool isDone() {
-    return blockCounter >= FADE_DURATION_BLOCKS;
+    // A fade that starts inside a block ends inside the block after its last
+    return blockCounter >= FADE_DURATION_BLOCKS + (fadeDelay > 0 ? 1 : 0);
   }
 
   void fadeIn() { unmute(); }
@@ -40,6 +60,11 @@ public:
     startFadeTo(0.0f);
   }
 
+  // Sample-accurate variants: the fade starts `offset` samples into the
+  // current block, the samples before it keep the current gain
+  void fadeInAt(int offset) { startFadeTo(userGain, offset); }
+  void fadeOutAt(int offset) { startFadeTo(0.0f, offset); }
+
   void mute(bool willMute) {
    if (willMute) mute();
    else unmute();
@@ -69,6 +94,7 @@ public:
     startGain = gain;
     currentGain = gain;
     blockCounter = FADE_DURATION_BLOCKS;
+    fadeDelay = 0;
   }
 
   // This is expected to be called from the Audio Interrupt (update)
@@ -82,9 +108,10 @@ public:
     // Total samples in the fade duration
     float totalSamples = (float)(FADE_DURATION_BLOCKS * AUDIO_BLOCK_SAMPLES);
     // Current sample position in the fade
-    float currentSamplePos = (float)(blockCounter * AUDIO_BLOCK_SAMPLES + sampleNum);
+    float currentSamplePos = (float)(blockCounter * AUDIO_BLOCK_SAMPLES + sampleNum - fadeDelay);
 
     float t = currentSamplePos / totalSamples;
+    if (t < 0.0f) t = 0.0f;
     if (t > 1.0f) t = 1.0f;
 
     // Linear interpolation
@@ -92,9 +119,54 @@ public:
     return currentGain;
   }
 
+  // Block API, expected to be called from the Audio Interrupt once per block.
+  // Fills `gains` with the Q16 gain of every sample in the block using an
+  // incremental step. Returns true when the gain is constant for the whole
+  // block, in which case only gains[0] is written.
+  bool fillBlock(int32_t* gains) {
+    if (isDone()) {
+      gains[0] = GAIN_TO_Q16(targetGain);
+      return true;
+    }
+
+    float start = startGain;
+    float target = targetGain;
+    const int totalSamples = FADE_DURATION_BLOCKS * AUDIO_BLOCK_SAMPLES;
+    float step = (target - start) / (float)totalSamples;
+    // Fade position of sample 0, negative until a delayed fade starts
+    int pos = blockCounter * AUDIO_BLOCK_SAMPLES - fadeDelay;
+
+    int i = 0;
+    int32_t hold = (int32_t)(start * (GAIN_UNITY << 8)) >> 8;
+    for (; i < AUDIO_BLOCK_SAMPLES && pos + i < 0; i++) {
+      gains[i] = hold;
+    }
+
+    // Ramp in Q24 so the truncated step doesn't drift over the fade
+    int rampPos = pos + i;
+    float first = start + step * (float)rampPos;
+    int32_t g = (int32_t)(first * (GAIN_UNITY << 8));
+    int32_t step24 = (int32_t)(step * (GAIN_UNITY << 8));
+    for (; i < AUDIO_BLOCK_SAMPLES && pos + i < totalSamples; i++) {
+      gains[i] = g >> 8;
+      g += step24;
+    }
+
+    int32_t end = (int32_t)(target * (GAIN_UNITY << 8)) >> 8;
+    for (; i < AUDIO_BLOCK_SAMPLES; i++) {
+      gains[i] = end;
+    }
+
+    int lastPos = pos + AUDIO_BLOCK_SAMPLES - 1;
+    if (lastPos >= totalSamples) currentGain = target;
+    else if (lastPos < 0) currentGain = start;
+    else currentGain = first + step * (float)(lastPos - rampPos);
+    return false;
+  }
+
   // Must be called once per block by the owner to advance fades
   void update() {
-    if (blockCounter < FADE_DURATION_BLOCKS) {
+    if (!isDone()) {
       blockCounter++;
     }
   }
@@ -105,8 +177,9 @@ private:
   volatile float startGain;     // Where we started the fade
   volatile float currentGain;   // Current calculated value
   volatile int blockCounter;    // How many blocks have passed in this fade
+  volatile int fadeDelay;       // Samples into block 0 of the fade where it starts
 
-  void startFadeTo(float newTarget) {
+  void startFadeTo(float newTarget, int offset = 0) {
     // Protect critical section: multiple variables updated that are read by ISR
     if (targetGain == newTarget && isDone()) {
       return; // Already there
@@ -115,6 +188,7 @@ private:
     startGain = currentGain; // Start from wherever we are right now
     targetGain = newTarget;
     blockCounter = 0;
+    fadeDelay = offset;
   }
 };
 
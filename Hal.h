@@ -0,0 +1,59 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include <SD.h>
+#include "BALibrary.h"
+
+// -------------------------------------------------------------------------
+// Hal
+// The platform services the looper core uses outside the Audio library API:
+// the audio and timer IRQ guards, the clock, the SPI memory device and the streaming
+// file type. On the Teensy these are Teensyduino, BALibrary and SdFat.
+// Audio blocks come in and go out through AudioStream::receiveReadOnly()
+// and transmit().
+// The host build (host/) supplies stand-ins for those same headers, so the
+// core compiles unchanged on Linux.
+// -------------------------------------------------------------------------
+namespace Hal {
+
+// Holds off the audio update for its lifetime. Other interrupts keep running.
+class AudioIrqGuard {
+public:
+  AudioIrqGuard() { AudioNoInterrupts(); }
+  ~AudioIrqGuard() { AudioInterrupts(); }
+};
+
+// Holds off the IntervalTimer interrupts for its lifetime; they all share
+// the PIT interrupt. Audio, USB and DMA keep running.
+class TimerIrqGuard {
+public:
+  TimerIrqGuard() { NVIC_DISABLE_IRQ(IRQ_PIT); }
+  ~TimerIrqGuard() { NVIC_ENABLE_IRQ(IRQ_PIT); }
+};
+
+// --- Clock ---
+inline uint32_t cycles() { return ARM_DWT_CYCCNT; }
+inline uint32_t cyclesPerSecond() { return F_CPU_ACTUAL; }
+inline uint32_t microseconds() { return micros(); }
+
+// --- SPI memory device (byte addressed, 8/16-bit and burst access) ---
+typedef BALibrary::BASpiMemory SpiMemory;
+
+// --- File system ---
+// Random access file used for streaming track audio
+typedef FsFile StreamFile;
+
+inline StreamFile createStreamFile(const char* name) {
+  return SD.sdfs.open(name, O_RDWR | O_CREAT | O_TRUNC);
+}
+
+// Existing file, read only. Not open when it does not exist.
+inline StreamFile openStreamFile(const char* name) {
+  return SD.sdfs.open(name, O_RDONLY);
+}
+
+} // namespace Hal
+
+#endif // HAL_H
@@ -7,16 +7,26 @@
 #include "BALibrary.h"
 #include "LibMemoryManagement.h"
 #include "Definitions.h"
+#include "Hal.h"
+#include "SpscRing.h"
 
 using namespace BALibrary;
 
 // -------------------------------------------------------------------------
 // MemoryRam
 // A Ring Buffer wrapper around the external memory slots.
-// Handles circular wrapping and interrupt safety.
+// Single producer / single consumer: one side lives in the audio ISR, the
+// other in loop(). Each side only moves its own counter, so no index update
+// needs a critical section. The SPI transfer itself masks just the audio
+// interrupt (it shares the bus with the ISR's own transfers); USB and the
+// I2S DMA interrupts keep running.
 // -------------------------------------------------------------------------
 class MemoryRam {
 public:
+  // Longest single transfer, so loop() never holds the audio ISR off for long
+  // (1 KB is roughly 0.3 ms of SPI time)
+  static const size_t MAX_BURST_BLOCKS = 4;
+
   MemoryRam(int memChipIndex, size_t sizeInBlocks) 
     : m_memChipIndex(memChipIndex), m_sizeInBlocks(sizeInBlocks) 
   {
@@ -33,88 +43,113 @@ public:
     return push(block->data);
   }
 
-  // Thread-safe Push
   bool push(int16_t* data) {
-    __disable_irq(); // Begin Critical Section
+    return pushN(data, 1) == 1;
+  }
 
-    if (m_storedBlocks >= m_sizeInBlocks) {
-      __enable_irq();
-      return false;
-    }
+  bool pop(audio_block_t* block) {
+    return popN(block->data, 1) == 1;
+  }
 
-    // Force Position Update: Ensures chip address is correct even if shared
-    // Assuming setWritePosition takes BYTES. 
-    size_t offset = m_writeHead * AUDIO_BLOCK_SAMPLES * sizeof(int16_t);
-    m_memSlot.setWritePosition(offset);
+  // New helper to pop data into a raw buffer (for writing to SD)
+  bool popToBuffer(int16_t* buffer) {
+    return popN(buffer, 1) == 1;
+  }
 
-    bool success = m_memSlot.writeAdvance16(data, AUDIO_BLOCK_SAMPLES);
+  // Producer: copies up to `blocks` consecutive blocks in, returns how many fit
+  size_t pushN(const int16_t* data, size_t blocks) {
+    size_t space = getSpaceBlocks();
+    if (blocks > space) blocks = space;
+
+    size_t done = 0;
+    while (done < blocks) {
+      size_t head = m_written % m_sizeInBlocks;
+      size_t run = burstLength(head, blocks - done);
+
+      bool success;
+      {
+        Hal::AudioIrqGuard guard;
+        m_memSlot.setWritePosition(blocksToBytes(head));
+        success = m_memSlot.writeAdvance16((int16_t*)&data[done * AUDIO_BLOCK_SAMPLES], run * AUDIO_BLOCK_SAMPLES);
+      }
+      if (!success) break;
 
-    if (success) {
-      m_storedBlocks++;
-      m_writeHead++;
-      if (m_writeHead >= m_sizeInBlocks) m_writeHead = 0;
+      // Publish only after the data is in SPI RAM
+      m_written += run;
+      done += run;
     }
-
-    __enable_irq(); // End Critical Section
-    return success;
+    return done;
   }
 
-  bool pop(audio_block_t* block) {
-    return popInternal(block->data);
+  // Consumer: copies up to `blocks` consecutive blocks out, returns how many
+  size_t popN(int16_t* data, size_t blocks) {
+    size_t stored = getStoredBlocks();
+    if (blocks > stored) blocks = stored;
+
+    size_t done = 0;
+    while (done < blocks) {
+      size_t tail = m_read % m_sizeInBlocks;
+      size_t run = burstLength(tail, blocks - done);
+
+      bool success;
+      {
+        Hal::AudioIrqGuard guard;
+        m_memSlot.setReadPosition(blocksToBytes(tail));
+        success = m_memSlot.readAdvance16(&data[done * AUDIO_BLOCK_SAMPLES], run * AUDIO_BLOCK_SAMPLES);
+      }
+      if (!success) break;
+
+      // Hand the slots back only after the data has been read out
+      m_read += run;
+      done += run;
+    }
+    return done;
   }
 
-  // New helper to pop data into a raw buffer (for writing to SD)
-  bool popToBuffer(int16_t* buffer) {
-    return popInternal(buffer);
+  // Consumer: drops up to `blocks` blocks unread, returns how many
+  size_t discardN(size_t blocks) {
+    size_t stored = getStoredBlocks();
+    if (blocks > stored) blocks = stored;
+    m_read += blocks;
+    return blocks;
   }
 
-  // Thread-safe Reset
+  // Touches both counters, so the audio ISR is held off for the update
   void reset() {
-    __disable_irq();
+    Hal::AudioIrqGuard guard;
     m_memSlot.setWritePosition(0);
     m_memSlot.setReadPosition(0);
-    m_storedBlocks = 0;
-    m_writeHead = 0;
-    m_readHead = 0;
-    __enable_irq();
+    m_written = 0;
+    m_read = 0;
   }
 
-  size_t getStoredBlocks() const { return m_storedBlocks; }
-  size_t getSpaceBlocks() const { return m_sizeInBlocks - m_storedBlocks; }
+  size_t getStoredBlocks() const { return (size_t)(m_written - m_read); }
+  size_t getSpaceBlocks() const { return m_sizeInBlocks - getStoredBlocks(); }
   size_t getSizeInBlocks() const { return m_sizeInBlocks; }
+  // Blocks ever pushed and popped since the last reset
+  uint32_t getWrittenBlocks() const { return m_written; }
+  uint32_t getReadBlocks() const { return m_read; }
 
 protected:
   int m_memChipIndex;
   size_t m_sizeInBlocks;
   ExtMemSlot m_memSlot;
 
-  volatile size_t m_storedBlocks = 0;
-  size_t m_writeHead = 0;
-  size_t m_readHead = 0;
-
-  // Helper for popping to ensure consistent logic
-  bool popInternal(int16_t* dst) {
-    __disable_irq(); // Begin Critical Section
-
-    if (m_storedBlocks == 0) {
-      __enable_irq();
-      return false;
-    }
-
-    // Force Position Update
-    size_t offset = m_readHead * AUDIO_BLOCK_SAMPLES * sizeof(int16_t);
-    m_memSlot.setReadPosition(offset);
-
-    bool success = m_memSlot.readAdvance16(dst, AUDIO_BLOCK_SAMPLES);
+  // Free-running block counters. The producer only writes m_written, the
+  // consumer only writes m_read; the difference is the fill level.
+  volatile uint32_t m_written = 0;
+  volatile uint32_t m_read = 0;
 
-    if (success) {
-      m_storedBlocks--;
-      m_readHead++;
-      if (m_readHead >= m_sizeInBlocks) m_readHead = 0;
-    }
+  static size_t blocksToBytes(size_t blocks) {
+    return blocks * AUDIO_BLOCK_SAMPLES * sizeof(int16_t);
+  }
 
-    __enable_irq(); // End Critical Section
-    return success;
+  // Contiguous blocks from `index`, stopping at the ring end and the burst cap
+  size_t burstLength(size_t index, size_t wanted) const {
+    size_t run = m_sizeInBlocks - index;
+    if (run > wanted) run = wanted;
+    if (run > MAX_BURST_BLOCKS) run = MAX_BURST_BLOCKS;
+    return run;
   }
 
   static ExternalSramManager* getSramManager() {
@@ -187,7 +222,7 @@ public:
     LOG("Freed Track %d from MEM%d", m_uniqueId, m_assignedChipIndex);
   }
 
-  // --- Audio Thread Interface (ISR Safe via MemoryRam) ---
+  // --- Audio Thread Interface (ISR side of the MemoryRam rings) ---
 
   void writeSample(audio_block_t* block) {
     if (m_inputBuffer) m_inputBuffer->push(block);
@@ -198,6 +233,34 @@ public:
     return false;
   }
 
+  // Raw buffer variants (one AUDIO_BLOCK_SAMPLES block).
+  // A block the full input ring refuses still takes its place in the file:
+  // the flush writes silence there, so later blocks keep their positions.
+  bool writeSample(int16_t* data) {
+    if (!m_inputBuffer) return false;
+    // The gap is published before the block after it, so the flush knows where it ends
+    if (m_gapBlocks > 0) {
+      if (!m_gaps.push({m_gapAt, m_gapBlocks})) {
+        m_gapBlocks++;
+        return false;
+      }
+      m_gapBlocks = 0;
+    }
+    if (m_inputBuffer->push(data)) return true;
+    if (m_gapBlocks++ == 0) m_gapAt = m_inputBuffer->getWrittenBlocks();
+    return false;
+  }
+
+  // A block that is not back from SD in time is skipped when it does arrive,
+  // so the blocks after it still play in their own slots.
+  bool readSample(int16_t* data) {
+    if (!m_outputBuffer) return false;
+    if (m_lateBlocks > 0) m_lateBlocks -= m_outputBuffer->discardN(m_lateBlocks);
+    if (m_lateBlocks == 0 && m_outputBuffer->popToBuffer(data)) return true;
+    m_lateBlocks++;
+    return false;
+  }
+
   // --- Main Loop Interface (Maintenance) ---
 
   void update() {
@@ -209,13 +272,14 @@ public:
     if (!m_file) return;
 
     // 1. FLUSH INPUT: Move data from Input RAM -> SD
-    if (m_inputBuffer && m_inputBuffer->getStoredBlocks() > 0) {
+    if (m_inputBuffer) {
       flushInputToSd();
     }
 
     // 2. CHECK FLUSH COMPLETION
     if (m_waitingForFlush) {
-      if (m_inputBuffer && m_inputBuffer->getStoredBlocks() == 0) {
+      SpillGap gap;
+      if (m_inputBuffer && m_inputBuffer->getStoredBlocks() == 0 && !nextGap(gap)) {
         m_isLoopClosed = true;
         m_waitingForFlush = false;
         LOG("MemorySd: Loop Closed. Total Blocks: %d", m_fileSizeInBlocks);
@@ -224,37 +288,31 @@ public:
 
     // 3. REFILL OUTPUT: Move data from SD -> Output RAM
     // Only if file has data
-    if (m_outputBuffer && m_fileSizeInBlocks > 0) {
-      // Handle Looping logic at file level
-      size_t fileSizeBytes = m_fileSizeInBlocks * AUDIO_BLOCK_SAMPLES * sizeof(int16_t);
-      if (m_readCursor >= fileSizeBytes) {
-        if (m_isLoopClosed) {
-          m_readCursor = 0;
-        } else {
-          // Do nothing here, fetchSdToOutput will break
-        }
-      }
-
-      if (m_outputBuffer->getSpaceBlocks() > 0) {
-        fetchSdToOutput();
-      }
+    if (m_outputBuffer && m_fileSizeInBlocks > 0 && m_outputBuffer->getSpaceBlocks() > 0) {
+      fetchSdToOutput();
     }
   }
 
+  // Drops the recording. The file keeps its preallocated extent, only the
+  // logical length goes back to zero.
   void clearLoop() {
     if (m_inputBuffer) m_inputBuffer->reset();
     if (m_outputBuffer) m_outputBuffer->reset();
+    resetIsrState();
+    m_gapWritten = 0;
 
     m_readCursor = 0;
     m_writeCursor = 0;
     m_fileSizeInBlocks = 0;
 
-    m_shouldClear = true; // Defer file operations to update()
+    m_shouldClear = true; // Defer the flag reset to update()
   }
 
   void restartPlayback() {
     m_readCursor = 0;
     if (m_outputBuffer) m_outputBuffer->reset();
+    Hal::AudioIrqGuard guard;
+    m_lateBlocks = 0;
   }
 
   void finishRecording() { 
@@ -265,6 +323,16 @@ public:
   bool isClearing() const { return m_shouldClear; }
   size_t getRecordedBlocks() const { return m_fileSizeInBlocks; }
 
+  // Mounts the card once, shared with SessionStore
+  static bool ensureSdInit() {
+    static bool init = false;
+    if (!init) {
+      init = SD.begin(BUILTIN_SDCARD);
+      LOG("SD Init %s", init ? "OK" : "FAIL");
+    }
+    return init;
+  }
+
   static void removeAllFiles() {
     ensureSdInit();
     File root = SD.open("/");
@@ -289,7 +357,8 @@ public:
 private:
   int m_uniqueId;
   String m_binFileName;
-  File m_file;
+  Hal::StreamFile m_file;
+  size_t m_filePos = 0; // where the SD file position currently is, in bytes
 
   int m_assignedChipIndex = 0;
   size_t m_assignedSizeBlocks = 0;
@@ -305,37 +374,105 @@ private:
   bool m_shouldClear = false;
   bool m_isLoopClosed = false;
   bool m_waitingForFlush = false;
+  bool m_warnedExtent = false;
+
+  // Input blocks dropped at input block `at`, written back as silence
+  struct SpillGap {
+    uint32_t at;
+    uint32_t blocks;
+  };
+  SpscRing<SpillGap, 8> m_gaps;          // closed gaps, ISR -> loop()
+  volatile uint32_t m_gapAt = 0;         // gap still growing, ISR only until
+  volatile uint32_t m_gapBlocks = 0;     // the recording is finished
+  uint32_t m_gapWritten = 0;             // silent blocks of the oldest gap on SD
+  volatile uint32_t m_lateBlocks = 0;    // read misses still to skip, ISR only
 
   // Buffering constants
-  static const int BATCH_SIZE = 32; // 8KB buffer for optimal SD writes
-  int16_t m_tempBuffer[AUDIO_BLOCK_SAMPLES * BATCH_SIZE];
+  static const int BATCH_SIZE = 32; // 8KB buffer for optimal SD writes, a whole number of sectors
+  SD_DMA_ALIGNED int16_t m_tempBuffer[AUDIO_BLOCK_SAMPLES * BATCH_SIZE];
 
   void flushInputToSd() {
-    while (m_inputBuffer->getStoredBlocks() > 0) {
+    while (true) {
+      // Stop at the next gap and fill it before the blocks recorded after it
+      SpillGap gap;
+      bool hasGap = nextGap(gap);
       size_t available = m_inputBuffer->getStoredBlocks();
+      size_t toGap = hasGap ? gap.at - m_inputBuffer->getReadBlocks() : available;
+      if (hasGap && toGap == 0) {
+        if (!writeGap(gap)) break;
+        continue;
+      }
+      if (available > toGap) available = toGap;
       size_t toWrite = (available > BATCH_SIZE) ? BATCH_SIZE : available;
 
+      // Whole sectors only, so SdFat writes straight from our buffer instead
+      // of read-modify-writing its cache. The tail goes out once recording
+      // ends, or when a gap follows it.
+      if (!m_waitingForFlush && !(hasGap && toWrite == toGap)) toWrite -= toWrite % SD_SECTOR_BLOCKS;
       if (toWrite == 0) break;
 
-      if (!m_file.seek(m_writeCursor)) {
+      if (!seekTo(m_writeCursor)) {
         LOG("Err: seek write failed");
         break;
       }
-
-      // Pop from RAM into Temp Buffer (IRQ protected inside popToBuffer)
-      for (size_t i = 0; i < toWrite; i++) {
-        m_inputBuffer->popToBuffer(&m_tempBuffer[i * AUDIO_BLOCK_SAMPLES]);
+      if (m_fileSizeInBlocks + toWrite > SPILL_FILE_BLOCKS && !m_warnedExtent) {
+        LOG("MemorySd: Track %d past its preallocated extent", m_uniqueId);
+        m_warnedExtent = true;
       }
 
+      // Pop from RAM into Temp Buffer in a few bursts
+      toWrite = m_inputBuffer->popN(m_tempBuffer, toWrite);
+      if (toWrite == 0) break;
+
       // Write to SD (Blocking, IRQs enabled)
-      size_t bytesToWrite = toWrite * AUDIO_BLOCK_SAMPLES * sizeof(int16_t);
-      size_t written = m_file.write((uint8_t*)m_tempBuffer, bytesToWrite);
+      if (!writeBlocks(toWrite)) break;
+    }
+  }
 
-      m_writeCursor += written;
-      m_fileSizeInBlocks += (written / (AUDIO_BLOCK_SAMPLES * sizeof(int16_t)));
+  // Oldest gap not yet on SD. The open one only counts once the recording
+  // is finished, the ISR no longer grows it then.
+  bool nextGap(SpillGap& gap) {
+    if (m_gaps.peek(gap)) return true;
+    if (!m_waitingForFlush || m_gapBlocks == 0) return false;
+    gap = {m_gapAt, m_gapBlocks};
+    return true;
+  }
 
-      if (written < bytesToWrite) break;
+  // Writes the rest of `gap` as silence, a batch at a time
+  bool writeGap(const SpillGap& gap) {
+    if (!seekTo(m_writeCursor)) return false;
+    size_t blocks = gap.blocks - m_gapWritten;
+    if (blocks > BATCH_SIZE) blocks = BATCH_SIZE;
+    memset(m_tempBuffer, 0, blocks * AUDIO_BLOCK_SAMPLES * sizeof(int16_t));
+    size_t before = m_fileSizeInBlocks;
+    bool complete = writeBlocks(blocks);
+    m_gapWritten += m_fileSizeInBlocks - before;
+    if (m_gapWritten >= gap.blocks) {
+      SpillGap done;
+      if (!m_gaps.pop(done)) m_gapBlocks = 0;
+      m_gapWritten = 0;
     }
+    return complete;
+  }
+
+  // Appends `blocks` blocks of m_tempBuffer at the write cursor
+  bool writeBlocks(size_t blocks) {
+    size_t bytesToWrite = blocks * AUDIO_BLOCK_SAMPLES * sizeof(int16_t);
+    size_t written = m_file.write(m_tempBuffer, bytesToWrite);
+    m_filePos += written;
+
+    m_writeCursor += written;
+    m_fileSizeInBlocks += (written / (AUDIO_BLOCK_SAMPLES * sizeof(int16_t)));
+    return written == bytesToWrite;
+  }
+
+  // Gap and late block counters belong to the ISR, hold it off to reset them
+  void resetIsrState() {
+    Hal::AudioIrqGuard guard;
+    m_gaps.reset();
+    m_gapAt = 0;
+    m_gapBlocks = 0;
+    m_lateBlocks = 0;
   }
 
   void fetchSdToOutput() {
@@ -359,21 +496,22 @@ private:
       size_t space = m_outputBuffer->getSpaceBlocks();
       size_t toRead = (space > BATCH_SIZE) ? BATCH_SIZE : space;
 
+      // Whole sectors unless this is the end of the recording
+      if (toRead < blocksRemaining) toRead -= toRead % SD_SECTOR_BLOCKS;
       if (toRead > blocksRemaining) toRead = blocksRemaining;
       if (toRead == 0) break;
 
-      if (!m_file.seek(m_readCursor)) break;
+      if (!seekTo(m_readCursor)) break;
 
       // Read from SD (Blocking)
       size_t bytesToRead = toRead * AUDIO_BLOCK_SAMPLES * sizeof(int16_t);
-      size_t read = m_file.read((uint8_t*)m_tempBuffer, bytesToRead);
+      int read = m_file.read(m_tempBuffer, bytesToRead);
 
       if (read > 0) {
+        m_filePos += read;
         size_t blocksRead = read / (AUDIO_BLOCK_SAMPLES * sizeof(int16_t));
-        // Push to Output RAM (IRQ protected inside push)
-        for (size_t i = 0; i < blocksRead; i++) {
-          m_outputBuffer->push(&m_tempBuffer[i * AUDIO_BLOCK_SAMPLES]);
-        }
+        // Push to Output RAM in a few bursts (space was checked above)
+        m_outputBuffer->pushN(m_tempBuffer, blocksRead);
         m_readCursor += read;
       } else {
         break;
@@ -381,40 +519,50 @@ private:
     }
   }
 
-  void performClear() {
-    if (m_file) m_file.close();
-    if (SD.exists(m_binFileName.c_str())) SD.remove(m_binFileName.c_str());
-
-    m_file = SD.open(m_binFileName.c_str(), FILE_WRITE);
-    if (!m_file) LOG("Err: Failed recreate file");
+  // Reads and writes share one file position. Only seek when the other
+  // direction moved it, sequential batches go straight through.
+  bool seekTo(size_t position) {
+    if (position == m_filePos) return true;
+    if (!m_file.seekSet(position)) {
+      m_filePos = (size_t)-1; // unknown, force the next seek
+      return false;
+    }
+    m_filePos = position;
+    return true;
+  }
 
+  void performClear() {
     m_shouldClear = false;
     m_isLoopClosed = false;
     m_waitingForFlush = false;
+    m_warnedExtent = false;
     m_fileSizeInBlocks = 0;
     m_readCursor = 0;
     m_writeCursor = 0;
   }
 
+  // Creates the track file and reserves its whole extent up front
   void createAndOpenFile() {
     m_binFileName = "track_" + String(m_uniqueId) + ".bin";
     if (SD.exists(m_binFileName.c_str())) SD.remove(m_binFileName.c_str());
-    m_file = SD.open(m_binFileName.c_str(), FILE_WRITE);
+
+    m_file = Hal::createStreamFile(m_binFileName.c_str());
+    if (!m_file) {
+      LOG("Err: Failed to create %s", m_binFileName.c_str());
+      return;
+    }
+    m_filePos = 0;
+
+    uint64_t extentBytes = (uint64_t)SPILL_FILE_BLOCKS * AUDIO_BLOCK_SAMPLES * sizeof(int16_t);
+    if (!m_file.preAllocate(extentBytes)) {
+      LOG("MemorySd: preAllocate failed for %s, file will grow on demand", m_binFileName.c_str());
+    }
   }
 
   static int getNextId() {
     static int id = 0;
     return id++;
   }
-
-  static void ensureSdInit() {
-    static bool init = false;
-    if (!init) {
-      init = SD.begin(BUILTIN_SDCARD);
-      if (init) LOG("SD Init OK");
-      else LOG("SD Init FAIL");
-    }
-  }
 };
 
 #endif // MEMORY_H
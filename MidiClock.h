@@ -2,6 +2,8 @@
 #define MIDI_CLOCK_H
 
 #include <Arduino.h>
+#include "SampleClock.h"
+#include "TempoEstimator.h"
 
 class MidiClock {
 public:
@@ -11,23 +13,28 @@ public:
     LOCKED
   };
 
+  static const int TICKS_PER_BEAT = 24;
+
   MidiClock() {
     reset();
     _beatsPerMeasure = 4; // Default
     _state = IDLE;
   }
 
-  void handleClock() {
-    unsigned long now = micros();
-    
+  // `sample` is the SampleClock time the tick arrived at (see MidiInput).
+  // All timing below runs on arrival times, not on when loop() got here.
+  void handleClock(uint32_t sample = SampleClock::precise()) {
     // Check for timeout/reset condition (e.g. if we haven't received a clock in a long time)
-    if (_lastTickMicros > 0 && (now - _lastTickMicros > 500000)) { // 500ms timeout
+    if (_tickCount > 0 && (int32_t)(sample - _lastTickSample) > CLOCK_TIMEOUT) { // 500ms timeout
        // If the clock was stopped, we want to treat the next tick as a restart
-       _sampleCount = 0;
        _tickCounter = 23; // So next tick wraps to 0
        _currentBeatOfMeasure = 0; // So next beat becomes 1
+       _tempo.reset();
     }
-    _lastTickMicros = now;
+
+    _tickCount++;
+    _lastTickSample = sample;
+    _tempo.addTick(sample);
 
     // Pulse counting logic
     _tickCounter++;
@@ -55,24 +62,6 @@ public:
         }
       }
     }
-
-    // BPM Calculation (Existing logic)
-    _timestamps[_head] = now;
-    _head = (_head + 1) % CLOCK_WINDOW;
-    if (_sampleCount < CLOCK_WINDOW) {
-      _sampleCount++;
-    } else {
-      unsigned long oldest = _timestamps[_head];
-      unsigned long duration = now - oldest;
-      if (duration > 0) {
-        float instantBpm = 60000000.0f / duration;
-        if (_bpm == 0) {
-          _bpm = instantBpm;
-        } else {
-          _bpm = (_bpm * 0.9f) + (instantBpm * 0.1f);
-        }
-      }
-    }
   }
 
   void triggerMeasureSync() {
@@ -111,9 +100,9 @@ public:
     _currentBeatOfMeasure = 0; // So next beat is Beat 1
   }
 
-  void handleContinue() {
-     if (micros() - _lastTickMicros > 500000) {
-       _sampleCount = 0;
+  void handleContinue(uint32_t sample = SampleClock::precise()) {
+     if ((int32_t)(sample - _lastTickSample) > CLOCK_TIMEOUT) {
+       _tempo.reset();
      }
   }
 
@@ -121,12 +110,33 @@ public:
   }
 
   float getBpm() {
-    if (micros() - _lastTickMicros > 1000000) {
+    if (!hasTempo()) {
       return 0.0f;
     }
-    return _bpm;
+    return 60.0f * SAMPLE_RATE / (getSamplesPerTick() * TICKS_PER_BEAT);
   }
 
+  // Tick period in samples from the tempo fit, 0 until it has enough ticks
+  double getSamplesPerTick() const { return _tempo.getSamplesPerTick(); }
+
+  // A tick within the last second and enough of them for the fit
+  bool hasTempo() const {
+    return getSamplesPerTick() > 0.0 && SampleClock::elapsed(_lastTickSample) < SAMPLE_RATE;
+  }
+
+  // Predicted arrival of the next tick and of the next beat's first tick, in
+  // samples. Quantization can schedule against these instead of waiting for
+  // the tick to show up. Only meaningful while hasTempo().
+  uint32_t getNextTickSample() const { return _tempo.predictNext(1); }
+  uint32_t getNextBeatSample() const { return _tempo.predictNext(TICKS_PER_BEAT - _tickCounter); }
+
+  // Fit and jitter statistics
+  const TempoEstimator& getTempo() const { return _tempo; }
+
+  // Ticks received since boot and the sample the last one arrived at
+  uint32_t getTickCount() const { return _tickCount; }
+  uint32_t getLastTickSample() const { return _lastTickSample; }
+
   uint32_t getTotalBeats() const { return _totalBeatCount; }
   uint32_t getTotalMeasures() const { return _totalMeasureCount; }
   int getCurrentBeat() const { return _currentBeatOfMeasure; }
@@ -134,26 +144,24 @@ public:
   bool isLocked() const { return _state == LOCKED; }
 
   void reset() {
-    _head = 0;
-    _sampleCount = 0;
-    _bpm = 0.0f;
-    _lastTickMicros = 0;
     _tickCounter = 0;
     _absBeatCount = 0;
     _lastStompedBeat = 0;
     _totalBeatCount = 0;
     _totalMeasureCount = 0;
     _currentBeatOfMeasure = 1;
-    memset(_timestamps, 0, sizeof(_timestamps));
+    _tickCount = 0;
+    _lastTickSample = 0;
+    _tempo.reset();
   }
 
 private:
-  static const int CLOCK_WINDOW = 25; // Needs 25 samples to measure 24 intervals (1 Beat)
-  unsigned long _timestamps[CLOCK_WINDOW];
-  int _head;
-  int _sampleCount;
-  unsigned long _lastTickMicros;
-  float _bpm;
+  static const int32_t CLOCK_TIMEOUT = SAMPLE_RATE / 2; // samples without a tick that count as a stop
+  TempoEstimator _tempo;
+
+  // Tick arrival, in samples
+  uint32_t _tickCount;
+  uint32_t _lastTickSample;
 
   // Sync / Quantization logic
   SyncState _state;
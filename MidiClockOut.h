@@ -0,0 +1,225 @@
+#ifndef MIDI_CLOCK_OUT_H
+#define MIDI_CLOCK_OUT_H
+
+#include <Arduino.h>
+#include "Definitions.h"
+#include "Hal.h"
+#include "MidiClock.h"
+#include "MidiDefs.h"
+#include "SampleClock.h"
+#include "SpscRing.h"
+
+// -------------------------------------------------------------------------
+// MidiClockOut
+// Clock master for when no external clock runs. The base loop is taken as
+// a whole number of beats (setBeatsPerLoop()), so tick k of a lap sits on
+// loop position k * timeline / (beats * 24).
+// The audio ISR works out the samples the ticks of the next block land on
+// from the loop position and queues them; a timer interrupt every
+// MIDI_CLOCK_OUT_US sends each one once SampleClock::precise() reaches it.
+// Tick timing follows the audio clock and does not depend on loop().
+// Start goes out on the next loop start, Stop when the loop is cleared, the
+// beat count changes or an external clock shows up.
+// The timer measures how late every event went out and how far each tick
+// interval is from the ideal one; update() takes it once per lap, keeps it
+// for getReport() and logs it.
+// -------------------------------------------------------------------------
+class MidiClockOut {
+public:
+  // Sends one realtime byte to every MIDI output. Runs in the timer interrupt.
+  typedef void (*Output)(uint8_t status);
+
+  // Timing measured on the output, cleared on every report
+  struct Stats {
+    uint32_t events;
+    uint32_t lateSum, lateMax;  // samples after the scheduled one
+    uint32_t intervals;
+    float intervalSumSq;        // cycles squared
+    uint32_t intervalMax;       // cycles off the ideal tick interval
+
+    float lateMeanMicros() const { return events ? lateSum * 1e6f / SAMPLE_RATE / events : 0.0f; }
+    float lateMaxMicros() const { return lateMax * 1e6f / SAMPLE_RATE; }
+    float intervalRmsMicros() const {
+      return intervals ? sqrtf(intervalSumSq / intervals) * 1e6f / Hal::cyclesPerSecond() : 0.0f;
+    }
+    float intervalMaxMicros() const { return intervalMax * 1e6f / Hal::cyclesPerSecond(); }
+  };
+
+  // Sets the output and starts the timer
+  static void begin(Output send) {
+    setOutput(send);
+    timer.begin(poll, MIDI_CLOCK_OUT_US);
+  }
+
+  // Output only, for a caller that runs emit() itself (host build)
+  static void setOutput(Output send) { output = send; }
+
+  // Main Loop: beats in one base loop, 0 stops the clock
+  static void setBeatsPerLoop(uint32_t beats) {
+    if (beats > MIDI_CLOCK_OUT_MAX_BEATS) beats = MIDI_CLOCK_OUT_MAX_BEATS;
+    beatsPerLoop = beats;
+    LOG("MidiClockOut: %lu beats per loop", (unsigned long)beats);
+  }
+  static uint32_t getBeatsPerLoop() { return beatsPerLoop; }
+
+  // Main Loop: an external clock is running, leave the tempo to it
+  static void setFollowing(bool willFollow) {
+    if (willFollow != following) {
+      LOG("MidiClockOut: %s", willFollow ? "external clock, off" : "master");
+    }
+    following = willFollow;
+  }
+
+  static bool isRunning() { return running; }
+
+  // Audio ISR, once per processed block: queues the events of the next
+  // block. `playhead` is the loop position at `blockStart`.
+  static void schedule(uint32_t blockStart, size_t playhead, size_t timeline) {
+    if (!output) return;
+
+    uint32_t from = (int32_t)(scheduledUntil - blockStart) > 0 ? scheduledUntil : blockStart;
+    uint32_t to = blockStart + 2 * AUDIO_BLOCK_SAMPLES;
+    uint32_t beats = beatsPerLoop;
+
+    if (running && (timeline == 0 || following || beats != runningBeats)) {
+      push(from, MIDI_STATUS_STOP);
+      running = false;
+    }
+    if (timeline == 0 || following || beats == 0) {
+      scheduledUntil = from;
+      return;
+    }
+
+    uint64_t ticksPerLoop = (uint64_t)beats * MidiClock::TICKS_PER_BEAT;
+    while ((int32_t)(to - from) > 0) {
+      uint64_t position = (playhead + (from - blockStart)) % timeline;
+
+      // First tick at or after this position; a stopped clock waits for the loop start
+      uint64_t tick = (position * ticksPerLoop + timeline - 1) / timeline;
+      if (!running && position != 0) tick = ticksPerLoop;
+      uint64_t tickPosition = tick * timeline / ticksPerLoop;
+      uint32_t at = from + (uint32_t)(tickPosition - position);
+      if ((int32_t)(to - at) <= 0) break;
+
+      if (!running) {
+        push(at, MIDI_STATUS_START);
+        running = true;
+        runningBeats = beats;
+      }
+      push(at, MIDI_STATUS_CLOCK);
+      from = at + 1;
+    }
+    scheduledUntil = to;
+  }
+
+  // Sends every event due at `sample`; `cycles` is Hal::cycles() at that moment
+  static void emit(uint32_t sample, uint32_t cycles) {
+    if (hold || !output) return;
+
+    Event event;
+    while (events.peek(event) && (int32_t)(sample - event.sample) >= 0) {
+      events.pop(event);
+      output(event.status);
+      measure(event, sample, cycles);
+    }
+  }
+
+  // Holds the output while loop() writes to the same MIDI ports, so the
+  // timer never interleaves inside a send. Events wait for the next poll.
+  class Hold {
+  public:
+    Hold() { hold = true; __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+    ~Hold() { __atomic_signal_fence(__ATOMIC_SEQ_CST); hold = false; }
+  };
+
+  // Main Loop: takes the timing gathered since the last call. Only the
+  // timer that writes it is held off for the copy.
+  static Stats takeStats() {
+    Hal::TimerIrqGuard guard;
+    Stats taken = stats;
+    stats = Stats();
+    return taken;
+  }
+
+  // Main Loop: once per lap of ticks, takes the measured timing into the
+  // report and logs it. Returns whether a new report is in.
+  static bool update() {
+    uint32_t ticksPerLoop = beatsPerLoop * MidiClock::TICKS_PER_BEAT;
+    if (ticksPerLoop == 0 || stats.events < ticksPerLoop) return false;
+
+    report = takeStats();
+    LOG("MidiClockOut: %lu events, late mean %.0f us max %.0f us, interval rms %.1f us max %.1f us",
+        (unsigned long)report.events, report.lateMeanMicros(), report.lateMaxMicros(), report.intervalRmsMicros(),
+        report.intervalMaxMicros());
+
+    uint32_t overflows = events.getOverflows();
+    if (overflows != lastOverflows) {
+      LOG("MidiClockOut: queue full, %lu events lost", (unsigned long)(overflows - lastOverflows));
+      lastOverflows = overflows;
+    }
+    return true;
+  }
+
+  // The last lap's timing, from update()
+  static const Stats& getReport() { return report; }
+
+private:
+  struct Event {
+    uint32_t sample;
+    uint8_t status;
+  };
+
+  static inline IntervalTimer timer;
+  static inline Output output = nullptr;
+  static inline SpscRing<Event, MIDI_CLOCK_OUT_QUEUE> events; // audio ISR -> timer
+  static inline volatile uint32_t beatsPerLoop = MIDI_CLOCK_OUT_BEATS;
+  static inline volatile bool following = false;
+  static inline volatile bool hold = false;
+
+  // Audio ISR
+  static inline uint32_t scheduledUntil = 0; // end of the samples already queued
+  static inline volatile bool running = false;
+  static inline uint32_t runningBeats = 0;
+
+  // Timer interrupt
+  static inline Stats stats = Stats();
+  static inline bool hasLastTick = false;
+  static inline uint32_t lastTickSample = 0, lastTickCycles = 0;
+
+  // Main Loop
+  static inline uint32_t lastOverflows = 0;
+  static inline Stats report = Stats();
+
+  // Timer interrupt
+  static void poll() { emit(SampleClock::precise(), Hal::cycles()); }
+
+  static void push(uint32_t sample, uint8_t status) {
+    Event event = { sample, status };
+    events.push(event);
+  }
+
+  static void measure(const Event& event, uint32_t sample, uint32_t cycles) {
+    uint32_t late = sample - event.sample;
+    stats.events++;
+    stats.lateSum += late;
+    if (late > stats.lateMax) stats.lateMax = late;
+
+    if (event.status != MIDI_STATUS_CLOCK) {
+      hasLastTick = false;
+      return;
+    }
+    if (hasLastTick) {
+      uint32_t ideal = (uint32_t)((uint64_t)(event.sample - lastTickSample) * Hal::cyclesPerSecond() / SAMPLE_RATE);
+      int32_t error = (int32_t)(cycles - lastTickCycles - ideal);
+      uint32_t magnitude = error < 0 ? -error : error;
+      stats.intervals++;
+      stats.intervalSumSq += (float)error * error;
+      if (magnitude > stats.intervalMax) stats.intervalMax = magnitude;
+    }
+    hasLastTick = true;
+    lastTickSample = event.sample;
+    lastTickCycles = cycles;
+  }
+};
+
+#endif // MIDI_CLOCK_OUT_H
@@ -7,52 +7,67 @@
 #include "MidiDefs.h"
 #include "Definitions.h"
 #include "MidiClock.h"
+#include "MidiClockOut.h"
+#include "MidiInput.h"
+#include "MidiParser.h"
+#include "SessionStore.h"
+#include "TempoSync.h"
 
 // Define the Serial MIDI type alias for convenience
 typedef midi::MidiInterface<midi::SerialMIDI<HardwareSerial>> SerialMidiInterface;
 
 class MidiHandler {
 public:
-  MidiHandler(AudioLooper& looper, SerialMidiInterface& midi, MidiClock& clock) 
-    : _looper(looper), _midi(midi), _clock(clock) {}
+  MidiHandler(AudioLooper& looper, SerialMidiInterface& midi, MidiClock& clock, TempoSync& tempoSync,
+              SessionStore& session) 
+    : _looper(looper), _midi(midi), _clock(clock), _tempoSync(tempoSync), _session(session) {}
 
+  // Handles every message captured since the last pass (see MidiInput)
   void update() {
-    // 1. Process USB MIDI
-    if (usbMIDI.read()) {
-      byte type = usbMIDI.getType();
-      byte channel = usbMIDI.getChannel();
-      byte data1 = usbMIDI.getData1();
-      byte data2 = usbMIDI.getData2();
-
-      processCommonMidi(type, channel, data1, data2, "USB");
-
-      // Thru to Hardware MIDI (Include System Realtime)
-      if (type != MIDI_STATUS_SYSEX) { 
-        _midi.send((midi::MidiType)type, data1, data2, channel);
-      }
-    }
+    MidiInput::Byte in;
+    MidiParser::Message message;
+    MidiInput::capture();
+    while (MidiInput::pop(in)) {
+      if (in.port >= MidiInput::NUM_PORTS) continue;
+      if (!_parsers[in.port].parse(in.data, in.sample, message)) continue;
+
+      byte type = message.type();
+      byte channel = message.channel();
 
-    // 2. Process Hardware MIDI
-    if (_midi.read()) {
-      byte type = (byte)_midi.getType();
-      byte channel = _midi.getChannel();
-      byte data1 = _midi.getData1();
-      byte data2 = _midi.getData2();
+      if (in.port == MidiInput::PORT_USB) {
+        processCommonMidi(type, channel, message.data1, message.data2, message.sample, "USB");
 
-      processCommonMidi(type, channel, data1, data2, "Serial");
+        // Thru to Hardware MIDI (Include System Realtime)
+        MidiClockOut::Hold hold;
+        _midi.send((midi::MidiType)type, message.data1, message.data2, channel);
+      } else {
+        processCommonMidi(type, channel, message.data1, message.data2, message.sample, "Serial");
 
-      // Thru to USB MIDI (Include System Realtime)
-      if (type != MIDI_STATUS_SYSEX) {
-        usbMIDI.send(type, data1, data2, channel, 0); 
-        _midi.send((midi::MidiType)type, data1, data2, channel);
+        // Thru to USB MIDI (Include System Realtime)
+        MidiClockOut::Hold hold;
+        usbMIDI.send(type, message.data1, message.data2, channel, 0); 
+        _midi.send((midi::MidiType)type, message.data1, message.data2, channel);
       }
     }
+
+    // Our own clock only goes out while nobody else sends one
+    MidiClockOut::setFollowing(_clock.hasTempo());
+
+    uint32_t overflows = MidiInput::getOverflows();
+    if (overflows != _lastOverflows) {
+      LOG("MIDI: input ring full, %d bytes lost", overflows - _lastOverflows);
+      _lastOverflows = overflows;
+    }
   }
 
 private:
   AudioLooper& _looper;
   SerialMidiInterface& _midi;
   MidiClock& _clock;
+  TempoSync& _tempoSync;
+  SessionStore& _session;
+  MidiParser _parsers[MidiInput::NUM_PORTS];
+  uint32_t _lastOverflows = 0;
 
   const char* getMidiName(byte type) {
     // Check Control Change (Channel Voice Message)
@@ -71,7 +86,8 @@ private:
     return "Unknown";
   }
 
-  void processCommonMidi(byte type, byte channel, byte data1, byte data2, const char* source) {
+  // `sample` is when the message arrived
+  void processCommonMidi(byte type, byte channel, byte data1, byte data2, uint32_t sample, const char* source) {
     const char* name = getMidiName(type);
     
     // Application Logic
@@ -80,22 +96,39 @@ private:
       LOG("MIDI %s: %s (%d), Ch=%d, D1=%d, D2=%d", source, name, type, channel, data1, data2);
 
       if (data1 == 10) {
-        _looper.trigger();
+        _tempoSync.trigger(sample);
       } else if (data1 == 11) {
         _looper.reset();
       } else if (data1 == 12) {
         _clock.triggerMeasureSync();
+        _looper.sync(sample);
+      } else if (data1 == 13) {
+        _tempoSync.setEnabled(data2 >= 64);
+      } else if (data1 == 14) {
+        MidiClockOut::setBeatsPerLoop(data2);
+      } else if (data1 == 15) {
+        _session.save();
+      } else if (data1 >= 16 && data1 <= 18) {
+        // Overdub on the newest layer: 16 punches in (>= 64) and out, 17 undoes, 18 redoes
+        int track = _looper.getTrackCount() - 1;
+        if (track < 0) return;
+        if (data1 == 16) _looper.overdubTrack(track, data2 >= 64, sample);
+        else if (data1 == 17) _looper.undoOverdub(track);
+        else _looper.redoOverdub(track);
+      } else if (data1 == 19) {
+        // Collapse tracks 0..N into track 0, 0 takes every layer
+        _looper.collapse(data2 > 0 ? data2 : NUM_LOOPS - 1);
       }
     }
     // Realtime / Clock Logic
     else if (type == MIDI_STATUS_CLOCK) {
-      _clock.handleClock();
+      _clock.handleClock(sample);
     }
     else if (type == MIDI_STATUS_START) {
       _clock.handleStart();
     }
     else if (type == MIDI_STATUS_CONTINUE) {
-      _clock.handleContinue();
+      _clock.handleContinue(sample);
     }
     else if (type == MIDI_STATUS_STOP) {
       _clock.handleStop();
@@ -0,0 +1,85 @@
+#ifndef MIDI_INPUT_H
+#define MIDI_INPUT_H
+
+#include <Arduino.h>
+#include "Definitions.h"
+#include "MidiDefs.h"
+#include "Hal.h"
+#include "SampleClock.h"
+#include "SpscRing.h"
+
+// -------------------------------------------------------------------------
+// MidiInput
+// Captures incoming MIDI in a timer interrupt, every MIDI_POLL_US, so each
+// byte is stamped with the sample it arrived at rather than the moment
+// loop() got round to it. Serial1 is read raw; USB packets are turned back
+// into bytes. loop() drains the ring through one MidiParser per port, after
+// taking in what arrived since the last tick itself.
+// All usbMIDI reads happen here, loop() only sends.
+// -------------------------------------------------------------------------
+class MidiInput {
+public:
+  enum Port : uint8_t {
+    PORT_SERIAL,
+    PORT_USB,
+    NUM_PORTS
+  };
+
+  struct Byte {
+    uint32_t sample;
+    uint8_t data;
+    uint8_t port;
+  };
+
+  // Call after MIDI.begin() has opened Serial1
+  static void begin() {
+    timer.begin(poll, MIDI_POLL_US);
+  }
+
+  // Main Loop: captures the bytes waiting for the next tick now, so they are
+  // handled in this pass. The timer is held off, the ring keeps one producer.
+  static void capture() {
+    Hal::TimerIrqGuard guard;
+    poll();
+  }
+
+  // Main Loop: oldest captured byte
+  static bool pop(Byte& byte) { return ring.pop(byte); }
+
+  // Bytes lost because loop() did not drain the ring in time
+  static uint32_t getOverflows() { return ring.getOverflows(); }
+
+private:
+  static inline IntervalTimer timer;
+  static inline SpscRing<Byte, MIDI_RING_BYTES> ring;
+
+  // Timer interrupt, or loop() with the timer held off
+  static void poll() {
+    uint32_t sample = SampleClock::precise();
+
+    while (Serial1.available() > 0) {
+      push((uint8_t)Serial1.read(), PORT_SERIAL, sample);
+    }
+
+    while (usbMIDI.read()) {
+      uint8_t type = usbMIDI.getType();
+      if (type == MIDI_STATUS_SYSEX) continue;
+
+      uint8_t status = type < MIDI_STATUS_SYSEX ? type | ((usbMIDI.getChannel() - 1) & 0x0F) : type;
+      push(status, PORT_USB, sample);
+      if (type >= MIDI_STATUS_CLOCK || type == MIDI_STATUS_TUNE_REQ) continue;
+
+      push(usbMIDI.getData1(), PORT_USB, sample);
+      bool twoBytes = type != MIDI_STATUS_PROGRAM_CHANGE && type != MIDI_STATUS_CHANNEL_PRESS &&
+                      type != MIDI_STATUS_TIME_CODE && type != MIDI_STATUS_SONG_SEL;
+      if (twoBytes) push(usbMIDI.getData2(), PORT_USB, sample);
+    }
+  }
+
+  static void push(uint8_t data, uint8_t port, uint32_t sample) {
+    Byte byte = { sample, data, port };
+    ring.push(byte);
+  }
+};
+
+#endif // MIDI_INPUT_H
@@ -0,0 +1,113 @@
+#ifndef MIDI_PARSER_H
+#define MIDI_PARSER_H
+
+#include <Arduino.h>
+#include "MidiDefs.h"
+
+// -------------------------------------------------------------------------
+// MidiParser
+// Turns one port's raw MIDI byte stream into messages. Handles running
+// status and realtime bytes arriving in the middle of another message, and
+// skips SysEx. A message carries the sample its first byte arrived at.
+// Plain C++, so the host build can replay recorded streams through it.
+// -------------------------------------------------------------------------
+class MidiParser {
+public:
+  struct Message {
+    uint8_t status; // with the channel for channel messages
+    uint8_t data1;
+    uint8_t data2;
+    uint32_t sample;
+
+    // Status without the channel, e.g. MIDI_STATUS_CONTROL_CHANGE
+    uint8_t type() const { return status < MIDI_STATUS_SYSEX ? (status & 0xF0) : status; }
+    // 1..16, 0 for system messages
+    uint8_t channel() const { return status < MIDI_STATUS_SYSEX ? (status & 0x0F) + 1 : 0; }
+  };
+
+  MidiParser() { reset(); }
+
+  void reset() {
+    runningStatus = 0;
+    pending = 0;
+    needed = 0;
+    count = 0;
+    firstSample = 0;
+    stamped = false;
+    inSysex = false;
+  }
+
+  // Feeds one byte. Returns true with `message` filled when it completes one.
+  bool parse(uint8_t data, uint32_t sample, Message& message) {
+    // Realtime: a single byte that may land anywhere, even inside a message
+    if (data >= MIDI_STATUS_CLOCK) {
+      message = { data, 0, 0, sample };
+      return true;
+    }
+
+    if (data & 0x80) {
+      count = 0;
+      firstSample = sample;
+      stamped = true;
+      inSysex = data == MIDI_STATUS_SYSEX;
+      // System common cancels running status
+      runningStatus = data < MIDI_STATUS_SYSEX ? data : 0;
+      pending = data;
+      needed = dataBytes(data);
+
+      if (data >= MIDI_STATUS_SYSEX && needed == 0) {
+        pending = 0;
+        stamped = false;
+        // SysEx start and end carry nothing we use
+        if (data == MIDI_STATUS_SYSEX || data == 0xF7) return false;
+        message = { data, 0, 0, sample };
+        return true;
+      }
+      return false;
+    }
+
+    // Data byte
+    if (inSysex) return false;
+    if (pending == 0) return false; // stray data without a status
+    if (!stamped) {
+      // Running status: the first data byte starts the message
+      firstSample = sample;
+      stamped = true;
+    }
+
+    bytes[count++] = data;
+    if (count < needed) return false;
+
+    message = { pending, bytes[0], needed > 1 ? bytes[1] : (uint8_t)0, firstSample };
+    count = 0;
+    stamped = false;
+    pending = runningStatus;
+    return true;
+  }
+
+private:
+  uint8_t runningStatus; // last channel status, 0 when none
+  uint8_t pending;       // status of the message being assembled, 0 when none
+  uint8_t needed;        // data bytes it takes
+  uint8_t count;         // data bytes received so far
+  uint8_t bytes[2];
+  uint32_t firstSample;
+  bool stamped;          // firstSample belongs to the message being assembled
+  bool inSysex;
+
+  static uint8_t dataBytes(uint8_t status) {
+    switch (status & 0xF0) {
+      case MIDI_STATUS_PROGRAM_CHANGE:
+      case MIDI_STATUS_CHANNEL_PRESS:
+        return 1;
+      case 0xF0:
+        if (status == MIDI_STATUS_TIME_CODE || status == MIDI_STATUS_SONG_SEL) return 1;
+        if (status == MIDI_STATUS_SONG_POS) return 2;
+        return 0;
+      default:
+        return 2;
+    }
+  }
+};
+
+#endif // MIDI_PARSER_H
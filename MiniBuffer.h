@@ -3,84 +3,92 @@
 
 #include <Arduino.h>
 #include <AudioStream.h>
+#include "SpscRing.h"
 
 /**
  * A simple templated ring buffer for storing Audio Library blocks.
  * Maintains ownership of the blocks it holds (calls release() on clear/destruct).
+ * Lock-free between one producer and one consumer (e.g. audio ISR and loop()),
+ * see SpscRing. Capacity must be a power of two.
  */
 template <size_t Capacity>
 class MiniBuffer {
 public:
-  MiniBuffer() : head(0), tail(0), count(0) {
-    // Initialize pointers to null for safety
-    memset(buffer, 0, sizeof(buffer));
-  }
+  MiniBuffer() {}
 
   ~MiniBuffer() {
     clear();
   }
 
   /**
-   * Adds an audio block to the buffer.
-   * If buffer is full, the oldest block is released to make room.
-   * NOTE: The buffer takes ownership of the block.
+   * Adds an audio block to the buffer (producer side).
+   * If the buffer is full the new block is released and counted as an
+   * overflow; the consumer owns the oldest block, so it cannot be dropped here.
+   * NOTE: The buffer takes ownership of the block either way.
    */
-  void push(audio_block_t* block) {
-    if (count >= Capacity) {
-        audio_block_t* oldBlock = pop();
-        if (oldBlock) AudioStream::release(oldBlock);
-    }
+  bool push(audio_block_t* block) {
+    if (ring.push(block)) return true;
+    AudioStream::release(block);
+    return false;
+  }
 
-    buffer[head] = block;
-    head = (head + 1) % Capacity;
-    count++;
+  /**
+   * Adds up to `count` blocks in one go. Blocks that do not fit are released.
+   * Returns how many were queued.
+   */
+  size_t pushBulk(audio_block_t** blocks, size_t count) {
+    size_t queued = ring.pushBulk(blocks, count);
+    for (size_t i = queued; i < count; i++) {
+      AudioStream::release(blocks[i]);
+    }
+    return queued;
   }
 
   /**
-   * Removes and returns the oldest audio block.
+   * Removes and returns the oldest audio block (consumer side).
    * Returns nullptr if buffer is empty.
    * NOTE: Caller takes ownership of the block and is responsible for release() or transmit().
    */
   audio_block_t* pop() {
-    if (count == 0) return nullptr;
-
-    audio_block_t* block = buffer[tail];
-    buffer[tail] = nullptr; // Safety
-    tail = (tail + 1) % Capacity;
-    count--;
+    audio_block_t* block = nullptr;
+    ring.pop(block);
     return block;
   }
 
+  /**
+   * Removes up to `count` blocks into `blocks`. Returns how many.
+   * NOTE: Caller takes ownership of every returned block.
+   */
+  size_t popBulk(audio_block_t** blocks, size_t count) {
+    return ring.popBulk(blocks, count);
+  }
+
   /**
    * Returns the oldest audio block without removing it.
    */
   audio_block_t* peek() {
-    if (count == 0) return nullptr;
-    return buffer[tail];
+    audio_block_t* block = nullptr;
+    ring.peek(block);
+    return block;
   }
 
   /**
-   * Releases all held blocks back to the memory pool.
+   * Releases all held blocks back to the memory pool (consumer side).
    */
   void clear() {
-    while (count > 0) {
-      audio_block_t* block = pop();
+    audio_block_t* block;
+    while (ring.pop(block)) {
       if (block) AudioStream::release(block);
     }
-    // pop() resets count, tail, and buffer entries
-    head = 0;
-    tail = 0;
   }
 
-  bool isFull() const { return count >= Capacity; }
-  bool isEmpty() const { return count == 0; }
-  size_t size() const { return count; }
+  bool isFull() const { return ring.isFull(); }
+  bool isEmpty() const { return ring.isEmpty(); }
+  size_t size() const { return ring.size(); }
+  uint32_t getOverflows() const { return ring.getOverflows(); }
 
 private:
-  audio_block_t* buffer[Capacity];
-  size_t head;
-  size_t tail;
-  size_t count;
+  SpscRing<audio_block_t*, Capacity> ring;
 };
 
 #endif
@@ -0,0 +1,208 @@
+#ifndef OVERDUB_MAP_H
+#define OVERDUB_MAP_H
+
+#include <Arduino.h>
+#include "Definitions.h"
+#include "PageAllocator.h"
+
+// -------------------------------------------------------------------------
+// OverdubMap
+// Copy-on-write block map of one track's overdub passes. A pass never
+// writes over the loop: the first time it writes a stored block, the block
+// goes to a page of its own, and the pass flags it there. Reads take the
+// newest applied pass that holds the block, or the track's own page.
+// Undo and redo move the applied end by one pass, without copying audio.
+// Copies cost a page per loop page a pass touched, nothing for the rest.
+// Passes beyond OVERDUB_UNDO_LEVELS become permanent and are folded into the
+// track's pages from loop(), oldest first (see Track::updateOverdub()).
+// A new pass drops the undone ones.
+// NOTE: Not locked. Only call from the audio ISR, or from loop() inside an
+// AudioNoInterrupts() section.
+// -------------------------------------------------------------------------
+class OverdubMap {
+public:
+  static const uint8_t NONE = 0xFF;
+
+  // The blocks one pass wrote inside one loop page
+  struct Version {
+    uint16_t page;    // SPI RAM page holding them, NO_PAGE for a free entry
+    uint16_t logical; // loop page, stored block / PAGE_BLOCKS
+    uint8_t prev;     // next older version of the same loop page
+    uint32_t pass;
+    uint64_t mask;    // blocks of the page written, bit n for block n
+  };
+
+  OverdubMap() {
+    memset(head, NONE, sizeof(head));
+    freeCount = 0;
+    for (int i = OVERDUB_MAP_PAGES - 1; i >= 0; i--) {
+      versions[i].page = PageAllocator::NO_PAGE;
+      freeVersions[freeCount++] = (uint8_t)i;
+    }
+    endPass = 0;
+    appliedEnd = 0;
+    permanentEnd = 0;
+    drops = 0;
+  }
+
+  // Returns every copied page. The passes are gone, the track's pages are not touched.
+  void clear(PageAllocator* pager) {
+    for (int i = 0; i < OVERDUB_MAP_PAGES; i++) {
+      if (versions[i].page == PageAllocator::NO_PAGE) continue;
+      pager->release(versions[i].page);
+      versions[i].page = PageAllocator::NO_PAGE;
+      freeVersions[freeCount++] = (uint8_t)i;
+    }
+    memset(head, NONE, sizeof(head));
+    endPass = 0;
+    appliedEnd = 0;
+    permanentEnd = 0;
+  }
+
+  // Page holding stored block `block` as the listener hears it, NO_PAGE for
+  // the track's own page. A few compares per version of its loop page.
+  uint16_t find(size_t block) const {
+    uint8_t v = head[block / PAGE_BLOCKS];
+    uint64_t bit = 1ull << (block % PAGE_BLOCKS);
+    while (v != NONE) {
+      const Version& version = versions[v];
+      if (version.pass < appliedEnd && (version.mask & bit)) return version.page;
+      v = version.prev;
+    }
+    return PageAllocator::NO_PAGE;
+  }
+
+  // Starts a pass. The undone passes can no longer be redone and go.
+  void beginPass(PageAllocator* pager) {
+    dropUndone(pager);
+    endPass = appliedEnd + 1;
+    appliedEnd = endPass;
+    if (appliedEnd - permanentEnd > OVERDUB_UNDO_LEVELS) permanentEnd = appliedEnd - OVERDUB_UNDO_LEVELS;
+  }
+
+  // Makes the blocks as they sound now final: the undone passes go and the
+  // applied ones are folded in
+  void keepApplied(PageAllocator* pager) {
+    dropUndone(pager);
+    endPass = appliedEnd;
+    permanentEnd = appliedEnd;
+  }
+
+  // Page the open pass writes `block` to. NO_PAGE when no copy can be made,
+  // the block then keeps what it holds and the oldest pass is made
+  // permanent, so loop() frees its copies.
+  uint16_t writePage(size_t block, PageAllocator* pager) {
+    size_t logical = block / PAGE_BLOCKS;
+    uint32_t pass = endPass - 1;
+    uint8_t v = head[logical];
+    if (v == NONE || versions[v].pass != pass) {
+      uint16_t page = freeCount > 0 ? pager->allocate() : PageAllocator::NO_PAGE;
+      if (page == PageAllocator::NO_PAGE) {
+        if (permanentEnd < pass) permanentEnd++;
+        drops++;
+        return PageAllocator::NO_PAGE;
+      }
+      v = freeVersions[--freeCount];
+      Version& version = versions[v];
+      version.page = page;
+      version.logical = (uint16_t)logical;
+      version.prev = head[logical];
+      version.pass = pass;
+      version.mask = 0;
+      head[logical] = v;
+    }
+    versions[v].mask |= 1ull << (block % PAGE_BLOCKS);
+    return versions[v].page;
+  }
+
+  // Takes back the newest applied pass. Its blocks are flagged dirty on the
+  // track's pages `pageTable`, as they sound different now.
+  bool undo(PageAllocator* pager, const uint16_t* pageTable) {
+    if (appliedEnd <= permanentEnd) return false;
+    appliedEnd--;
+    markDirty(appliedEnd, pager, pageTable);
+    return true;
+  }
+
+  // Puts back the oldest undone pass
+  bool redo(PageAllocator* pager, const uint16_t* pageTable) {
+    if (appliedEnd >= endPass) return false;
+    markDirty(appliedEnd, pager, pageTable);
+    appliedEnd++;
+    return true;
+  }
+
+  // A version of the oldest permanent pass, NONE once they are all folded in
+  uint8_t nextFold() const {
+    uint8_t oldest = NONE;
+    for (int i = 0; i < OVERDUB_MAP_PAGES; i++) {
+      const Version& version = versions[i];
+      if (version.page == PageAllocator::NO_PAGE || version.pass >= permanentEnd) continue;
+      if (oldest == NONE || version.pass < versions[oldest].pass) oldest = (uint8_t)i;
+    }
+    return oldest;
+  }
+
+  const Version& getVersion(uint8_t v) const { return versions[v]; }
+
+  // Block `block` of version `v` now lives on the track's page. The version
+  // goes once it holds no blocks.
+  void folded(uint8_t v, size_t block, PageAllocator* pager) {
+    Version& version = versions[v];
+    version.mask &= ~(1ull << (block % PAGE_BLOCKS));
+    if (version.mask) return;
+
+    uint8_t* link = &head[version.logical];
+    while (*link != v) link = &versions[*link].prev;
+    *link = version.prev;
+    release(v, pager);
+  }
+
+  bool canUndo() const { return appliedEnd > permanentEnd; }
+  bool canRedo() const { return appliedEnd < endPass; }
+  bool isEmpty() const { return freeCount == OVERDUB_MAP_PAGES; }
+  // Pages holding copies, for every pass still kept
+  int getPages() const { return OVERDUB_MAP_PAGES - freeCount; }
+  // Overdubbed blocks lost because no copy could be made
+  uint32_t getDrops() const { return drops; }
+
+private:
+  static_assert(PAGE_BLOCKS <= 64, "one mask bit per block of a page");
+  static_assert(OVERDUB_MAP_PAGES < NONE, "versions are numbered in a byte");
+
+  Version versions[OVERDUB_MAP_PAGES];
+  uint8_t head[TOTAL_PAGES];               // loop page -> its newest version
+  uint8_t freeVersions[OVERDUB_MAP_PAGES];
+  int freeCount;
+  uint32_t endPass;      // passes recorded
+  uint32_t appliedEnd;   // passes heard, the rest are undone
+  uint32_t permanentEnd; // passes that can no longer be undone
+  uint32_t drops;
+
+  void dropUndone(PageAllocator* pager) {
+    for (size_t logical = 0; endPass > appliedEnd && logical < TOTAL_PAGES; logical++) {
+      // Undone passes are the newest, so they sit at the front of each chain
+      while (head[logical] != NONE && versions[head[logical]].pass >= appliedEnd) {
+        uint8_t v = head[logical];
+        head[logical] = versions[v].prev;
+        release(v, pager);
+      }
+    }
+  }
+
+  void release(uint8_t v, PageAllocator* pager) {
+    pager->release(versions[v].page);
+    versions[v].page = PageAllocator::NO_PAGE;
+    freeVersions[freeCount++] = v;
+  }
+
+  void markDirty(uint32_t pass, PageAllocator* pager, const uint16_t* pageTable) {
+    for (int i = 0; i < OVERDUB_MAP_PAGES; i++) {
+      const Version& version = versions[i];
+      if (version.page == PageAllocator::NO_PAGE || version.pass != pass) continue;
+      pager->markDirtyMask(pageTable[version.logical], version.mask);
+    }
+  }
+};
+
+#endif // OVERDUB_MAP_H
@@ -0,0 +1,98 @@
+#ifndef PAGE_ALLOCATOR_H
+#define PAGE_ALLOCATOR_H
+
+#include <Arduino.h>
+#include "Definitions.h"
+
+// -------------------------------------------------------------------------
+// PageAllocator
+// Hands out fixed-size pages of SPI RAM (PAGE_BLOCKS stored blocks each)
+// from a free list, so tracks can be freed in any order.
+// Pages are addressed in WORDS, same as Ram::read16/write16.
+// The first SPILL_RESERVED_PAGES pages belong to the SD spill rings.
+// Every stored block also has a dirty flag, set when the audio ISR writes
+// it and taken by the autosave journal (see SessionJournal.h).
+// NOTE: Not locked. Only call from the audio ISR, or from loop() inside an
+// AudioNoInterrupts() section.
+// -------------------------------------------------------------------------
+class PageAllocator {
+public:
+  static const uint16_t NO_PAGE = 0xFFFF;
+
+  PageAllocator() {
+    reset();
+  }
+
+  // Returns every page to the free list
+  void reset() {
+    // Stack is filled top-down so pages come out in ascending address order,
+    // which keeps a track's consecutive pages adjacent for burst transfers
+    freeCount = 0;
+    for (int i = TOTAL_PAGES - 1; i >= SPILL_RESERVED_PAGES; i--) {
+      freePages[freeCount++] = (uint16_t)i;
+    }
+    memset(dirty, 0, sizeof(dirty));
+    writes = 0;
+  }
+
+  // Returns NO_PAGE when SPI RAM is exhausted
+  uint16_t allocate() {
+    if (freeCount == 0) return NO_PAGE;
+    return freePages[--freeCount];
+  }
+
+  // A free page has no dirty blocks
+  void release(uint16_t page) {
+    if (page == NO_PAGE || freeCount >= TOTAL_PAGES - SPILL_RESERVED_PAGES) return;
+    for (int i = 0; i < DIRTY_WORDS; i++) dirty[page * DIRTY_WORDS + i] = 0;
+    freePages[freeCount++] = page;
+  }
+
+  static size_t pageAddress(uint16_t page) {
+    return (size_t)page * PAGE_WORDS;
+  }
+
+  int getFreePages() const { return freeCount; }
+  int getTotalPages() const { return TOTAL_PAGES - SPILL_RESERVED_PAGES; }
+
+  // Block `block` (0..PAGE_BLOCKS-1) of `page` was written
+  void markDirty(uint16_t page, size_t block) {
+    dirty[page * DIRTY_WORDS + block / 32] |= 1u << (block % 32);
+    writes++;
+  }
+
+  // Blocks of `page` set in `mask` (bit n for block n) sound different now
+  void markDirtyMask(uint16_t page, uint64_t mask) {
+    for (int i = 0; i < DIRTY_WORDS; i++) dirty[page * DIRTY_WORDS + i] |= (uint32_t)(mask >> (32 * i));
+    writes++;
+  }
+
+  // Clears the flag, returns whether it was set
+  bool takeDirty(uint16_t page, size_t block) {
+    uint32_t& word = dirty[page * DIRTY_WORDS + block / 32];
+    uint32_t bit = 1u << (block % 32);
+    if (!(word & bit)) return false;
+    word &= ~bit;
+    return true;
+  }
+
+  bool hasDirty(uint16_t page) const {
+    for (int i = 0; i < DIRTY_WORDS; i++) {
+      if (dirty[page * DIRTY_WORDS + i]) return true;
+    }
+    return false;
+  }
+
+  // Counts every markDirty(), so a reader can tell whether anything was written since it last looked
+  uint32_t getWrites() const { return writes; }
+
+private:
+  static const int DIRTY_WORDS = (PAGE_BLOCKS + 31) / 32; // per page
+
+  uint16_t freePages[TOTAL_PAGES];
+  volatile int freeCount;
+  uint32_t dirty[TOTAL_PAGES * DIRTY_WORDS];
+  volatile uint32_t writes;
+};
+
+#endif // PAGE_ALLOCATOR_H
@@ -0,0 +1,180 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include "Definitions.h"
+#include "Hal.h"
+
+// -------------------------------------------------------------------------
+// Profiler
+// Cycle-counter probes for the audio ISR. Every probe feeds a log2 histogram
+// and a per-block total. When a block sets a new worst case, its per-probe
+// totals and the looper state are kept as a snapshot.
+// Everything lives in fixed arrays, dump() prints from loop().
+// Cycles come from Hal::cycles(): DWT CYCCNT on the Teensy, std::chrono
+// scaled to Teensy cycles on the host.
+// With PROFILER_ENABLED at 0 the probe macros expand to nothing.
+// -------------------------------------------------------------------------
+
+enum ProfilePoint {
+  PROF_UPDATE,      // whole AudioLooper::update()
+  PROF_STATE,       // AudioLooper::updateState()
+  PROF_SCHEDULE,    // Track::schedule() for every track
+  PROF_SPI_READ,    // each read burst
+  PROF_SPI_WRITE,   // each write burst
+  PROF_MASTER,      // master gain, saturate and pack
+  PROF_TRACK_0,     // Track::update() per track, PROF_TRACK_0 + index
+  PROF_COUNT = PROF_TRACK_0 + NUM_LOOPS
+};
+
+class Profiler {
+public:
+  static const int BUCKETS = 24; // bucket b counts [2^b, 2^(b+1)) cycles
+
+  struct Point {
+    uint32_t count;
+    uint64_t total;
+    uint32_t max;
+    uint32_t histogram[BUCKETS];
+  };
+
+  struct Snapshot {
+    uint32_t block;                 // block number since boot
+    uint32_t cycles[PROF_COUNT];    // per-probe totals for that block
+    uint8_t looperState;
+    uint8_t activeTrack;
+    uint32_t playhead;
+    uint32_t timeline;
+    uint8_t trackState[NUM_LOOPS];
+  };
+
+  // --- Audio ISR side ---
+
+  static void beginBlock() {
+    memset(blockCycles, 0, sizeof(blockCycles));
+    blockStart = Hal::cycles();
+  }
+
+  // Returns true when this block is the new worst case. The caller then
+  // fills the state fields of worstSnapshot().
+  static bool endBlock() {
+    uint32_t elapsed = Hal::cycles() - blockStart;
+    record(PROF_UPDATE, elapsed);
+    blockCount++;
+
+    if (elapsed <= worst.cycles[PROF_UPDATE]) return false;
+    worst.block = blockCount;
+    memcpy(worst.cycles, blockCycles, sizeof(worst.cycles));
+    return true;
+  }
+
+  static void record(int point, uint32_t cycles) {
+    Point& p = points[point];
+    p.count++;
+    p.total += cycles;
+    if (cycles > p.max) p.max = cycles;
+    p.histogram[bucketOf(cycles)]++;
+    blockCycles[point] += cycles;
+  }
+
+  static Snapshot& worstSnapshot() { return worst; }
+
+  // --- Main Loop side ---
+
+  // Cycles one audio block may take
+  static uint32_t deadlineCycles() {
+    return (uint32_t)((uint64_t)Hal::cyclesPerSecond() * AUDIO_BLOCK_SAMPLES / SAMPLE_RATE);
+  }
+
+  // Prints every probe and the worst block. Copies under the IRQ guard so the
+  // numbers are from one consistent moment.
+  static void dump() {
+    static Point copy[PROF_COUNT];
+    static Snapshot worstCopy;
+    {
+      Hal::AudioIrqGuard guard;
+      memcpy(copy, points, sizeof(copy));
+      worstCopy = worst;
+    }
+
+    LOG("--- Profile (cycles, block deadline %lu) ---", (unsigned long)deadlineCycles());
+    for (int i = 0; i < PROF_COUNT; i++) {
+      const Point& p = copy[i];
+      if (p.count == 0) continue;
+      char line[256];
+      int len = snprintf(line, sizeof(line), "%-10s n=%lu mean=%lu max=%lu |", name(i),
+                         (unsigned long)p.count, (unsigned long)(p.total / p.count), (unsigned long)p.max);
+      for (int b = 0; b < BUCKETS && len < (int)sizeof(line); b++) {
+        if (p.histogram[b] == 0) continue;
+        len += snprintf(line + len, sizeof(line) - len, " %lu:%lu", 1ul << b, (unsigned long)p.histogram[b]);
+      }
+      LOG("%s", line);
+    }
+
+    LOG("Worst block #%lu: %lu cycles (%lu%% of deadline), looper state %d, track %d, playhead %lu/%lu",
+        (unsigned long)worstCopy.block, (unsigned long)worstCopy.cycles[PROF_UPDATE],
+        (unsigned long)((uint64_t)worstCopy.cycles[PROF_UPDATE] * 100 / deadlineCycles()),
+        worstCopy.looperState, worstCopy.activeTrack,
+        (unsigned long)worstCopy.playhead, (unsigned long)worstCopy.timeline);
+    for (int i = PROF_STATE; i < PROF_COUNT; i++) {
+      if (worstCopy.cycles[i] == 0) continue;
+      if (i >= PROF_TRACK_0) {
+        LOG("  %-10s %lu (state %d)", name(i), (unsigned long)worstCopy.cycles[i], worstCopy.trackState[i - PROF_TRACK_0]);
+      } else {
+        LOG("  %-10s %lu", name(i), (unsigned long)worstCopy.cycles[i]);
+      }
+    }
+  }
+
+  // Clears every histogram and the worst case (Main Loop)
+  static void reset() {
+    Hal::AudioIrqGuard guard;
+    memset(points, 0, sizeof(points));
+    memset(&worst, 0, sizeof(worst));
+    blockCount = 0;
+  }
+
+private:
+  static inline Point points[PROF_COUNT];
+  static inline uint32_t blockCycles[PROF_COUNT];
+  static inline uint32_t blockStart = 0;
+  static inline uint32_t blockCount = 0;
+  static inline Snapshot worst;
+
+  static int bucketOf(uint32_t cycles) {
+    int bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+  }
+
+  static const char* name(int point) {
+    static const char* names[PROF_TRACK_0] = { "update", "state", "schedule", "spi read", "spi write", "master" };
+    if (point < PROF_TRACK_0) return names[point];
+    static char trackName[PROF_COUNT - PROF_TRACK_0][12];
+    snprintf(trackName[point - PROF_TRACK_0], sizeof(trackName[0]), "track %d", point - PROF_TRACK_0);
+    return trackName[point - PROF_TRACK_0];
+  }
+};
+
+// Times the enclosing scope into `point`
+class ProfileScope {
+public:
+  ProfileScope(int point) : point(point), start(Hal::cycles()) {}
+  ~ProfileScope() { Profiler::record(point, Hal::cycles() - start); }
+
+private:
+  int point;
+  uint32_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILER_ENABLED
+  #define PROFILE_SCOPE(point) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(point)
+  #define PROFILE_BLOCK_BEGIN() Profiler::beginBlock()
+#else
+  #define PROFILE_SCOPE(point) do {} while (0)
+  #define PROFILE_BLOCK_BEGIN() do {} while (0)
+#endif
+
+#endif // PROFILER_H
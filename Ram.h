@@ -5,6 +5,7 @@
 #include <Audio.h>
 #include "BALibrary.h"
 #include "Definitions.h"
+#include "Hal.h"
 
 using namespace BALibrary;
 
@@ -174,8 +175,8 @@ public:
   }
 
 private:
-  BALibrary::BASpiMemory mem0;
-  BALibrary::BASpiMemory mem1;
+  Hal::SpiMemory mem0;
+  Hal::SpiMemory mem1;
   size_t mem0Size;
   size_t totalSize;
 };
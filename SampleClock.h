@@ -0,0 +1,69 @@
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "Definitions.h"
+#include "Hal.h"
+
+// -------------------------------------------------------------------------
+// SampleClock
+// Counts audio samples since boot. AudioLooper::update() advances it once
+// per block, whether or not the block could be processed, so it follows the
+// I2S clock rather than the CPU clock.
+// Inside the audio ISR now() is the first sample of the block being
+// processed; from loop() it is the first sample of the next block.
+// precise() adds the samples gone by since that block from the cycle
+// counter, so a footswitch or MIDI event read in loop() gets the sample it
+// landed on rather than the next block boundary.
+// 32 bits wrap after about 27 hours at 44.1 kHz, compare with signed
+// differences (see elapsed()).
+// -------------------------------------------------------------------------
+class SampleClock {
+public:
+  static uint32_t now() { return __atomic_load_n(&position, __ATOMIC_ACQUIRE); }
+
+  // Samples from `since` to now, safe across the wrap
+  static int32_t elapsed(uint32_t since) { return (int32_t)(now() - since); }
+
+  // Main Loop and IntervalTimer ISRs: now() plus the samples since the last
+  // advance(), kept inside the next block
+  static uint32_t precise() {
+    uint32_t seq, base, stamp;
+    do {
+      seq = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+      base = __atomic_load_n(&stamps[seq & 1].position, __ATOMIC_RELAXED);
+      stamp = __atomic_load_n(&stamps[seq & 1].cycles, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != __atomic_load_n(&sequence, __ATOMIC_RELAXED));
+
+    uint32_t samples = (uint32_t)((uint64_t)(Hal::cycles() - stamp) * SAMPLE_RATE / Hal::cyclesPerSecond());
+    return base + (samples < AUDIO_BLOCK_SAMPLES ? samples : AUDIO_BLOCK_SAMPLES - 1);
+  }
+
+  // Audio ISR only: one block has gone by.
+  // The position and its cycle stamp go into the slot readers are not on,
+  // then the sequence number flips them over. A MIDI timer ISR that lands in
+  // the middle cannot wait for advance() to finish, it reads the previous
+  // pair whole instead; loop() retries if the sequence moved under it.
+  static void advance() {
+    uint32_t next = sequence + 1;
+    Stamp& slot = stamps[next & 1];
+    __atomic_store_n(&slot.cycles, Hal::cycles(), __ATOMIC_RELAXED);
+    __atomic_store_n(&slot.position, position + AUDIO_BLOCK_SAMPLES, __ATOMIC_RELAXED);
+    __atomic_store_n(&sequence, next, __ATOMIC_RELEASE);
+    __atomic_store_n(&position, position + AUDIO_BLOCK_SAMPLES, __ATOMIC_RELEASE);
+  }
+
+private:
+  struct Stamp {
+    uint32_t position;
+    uint32_t cycles;
+  };
+
+  static inline uint32_t position = 0;
+  static inline Stamp stamps[2] = {};
+  static inline uint32_t sequence = 0; // stamps[sequence & 1] is current
+};
+
+#endif // SAMPLE_CLOCK_H
@@ -0,0 +1,639 @@
+#ifndef SESSION_JOURNAL_H
+#define SESSION_JOURNAL_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include <stddef.h>
+#include "Definitions.h"
+#include "AudioLooper.h"
+#include "Hal.h"
+#include "Memory.h"
+#include "SessionStore.h"
+#include "Track.h"
+
+// -------------------------------------------------------------------------
+// SessionJournal
+// Crash-safe autosave. Writes to SPI RAM flag their block dirty (see
+// PageAllocator); update() takes the dirty blocks of the closed tracks and
+// appends them to a journal file on SD, a few per loop() pass, sized from
+// the measured SD speed to aim at AUTOSAVE_BUDGET_US. The budget is an aim,
+// not a limit: a pass does at least one SD operation, and a sync takes as
+// long as the card does, so one sync alone in a pass is the floor. Once a
+// scan over every track is through, the data is synced, a commit record
+// listing the tracks (layout, volume, mute) goes in, and that is synced,
+// each in a pass of its own. A power cut at any point leaves the last
+// commit intact: a commit only goes in after the data before it is synced,
+// and every record is checksummed, so a torn one ends the journal.
+// A track seen for the first time (new recording, restored, or a new
+// journal file) gets a new epoch and all its blocks; its blocks records
+// carry the epoch, so a cleared slot's old blocks are never replayed.
+// Two files alternate: a full one, or one that holds four times the live
+// audio, is dropped for the other, started over with every block, and the
+// old one stays restorable until the new one has its first commit.
+// Spilled tracks are skipped, as in SessionStore. Main Loop only.
+// -------------------------------------------------------------------------
+class SessionJournal {
+public:
+  static const uint32_t MAGIC = 0x4C4E524A; // "JRNL"
+  static const uint16_t VERSION = 2;
+
+  // One track in a commit
+  struct Layout {
+    uint32_t epoch;       // its blocks records carry the same, 0 for no track
+    uint32_t startOffset; // as in SessionStore::Extent
+    uint32_t length;
+    float volume;
+    uint8_t slot;         // looper track the blocks records name
+    uint8_t muted;
+    uint8_t reserved[2];
+  };
+
+  enum Type : uint16_t { OPEN = 1, BLOCKS, COMMIT };
+
+  // Header sector in front of every record's data
+  struct Record {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint32_t sequence;     // OPEN: file, bumped per file; COMMIT: commit number
+    uint32_t saved;        // COMMIT: newest SessionStore save it knew of, 0 for none
+    uint32_t sampleRate;
+    uint16_t codec;
+    uint16_t blockWords;
+    uint32_t slot, epoch;  // BLOCKS
+    uint32_t count;        // BLOCKS: blocks, COMMIT: tracks
+    uint32_t dataBytes;    // after the header, sector padded
+    uint32_t dataChecksum;
+    union {
+      uint32_t blocks[AUTOSAVE_RECORD_BLOCKS]; // BLOCKS: stored block numbers
+      Layout tracks[NUM_LOOPS];                // COMMIT
+    };
+    uint32_t checksum;     // of everything above
+  };
+  static_assert(sizeof(Record) <= SD_SECTOR_BYTES, "journal record header must fit one sector");
+
+  // What the journal wrote since begin()
+  struct Stats {
+    uint32_t commits;
+    uint32_t blocks;
+    uint64_t bytes;         // records, data and padding
+    uint64_t snapshotBytes; // a full snapshot at every commit would have written this
+    uint32_t passes;        // update() calls that found work
+    uint32_t worstMicros;   // longest of them, the worst loop() stall
+    uint64_t totalMicros;
+  };
+
+  // `session`, when given, is weighed against the journal at boot
+  SessionJournal(AudioLooper& looper, SessionStore* session = nullptr) : looper(looper), session(session) {
+    active = false;
+    replay.running = false;
+    fileSlot = -1;
+    restoredSlot = -1;
+    fileSequence = 0;
+    memset(&stats, 0, sizeof(stats));
+    resetFile();
+  }
+
+  // setup(): starts restoring the last commit of the newest journal, which
+  // update() then replays a record per pass; the base loop plays once its
+  // blocks are in. Returns false when there is none, it holds no tracks, or
+  // a saved session is newer (autosave turned off after a write failure and
+  // the session was saved since). Call with the looper idle.
+  bool beginRestore() {
+    if (!MemorySd::ensureSdInit()) return false;
+    uint32_t began = Hal::microseconds();
+
+    // Newest file with a commit, and where each of its tracks' records end
+    int slot = -1;
+    uint32_t sequence = 0, end = 0;
+    Record commit;
+    memset(&commit, 0, sizeof(commit));
+    uint32_t lastRecord[NUM_LOOPS];
+    for (int i = 0; i < 2; i++) {
+      uint32_t fileSeq, commitEnd, ends[NUM_LOOPS];
+      Record last;
+      if (!scan(i, fileSeq, commitEnd, &last, ends)) continue;
+      if (commitEnd > 0 && (slot < 0 || (int32_t)(fileSeq - sequence) > 0)) {
+        slot = i;
+        sequence = fileSeq;
+        end = commitEnd;
+        commit = last;
+        memcpy(lastRecord, ends, sizeof(lastRecord));
+      }
+    }
+    if (slot < 0) {
+      LOG("SessionJournal: nothing to restore");
+      return false;
+    }
+    uint32_t saved = session ? session->findNewestSave() : 0;
+    if ((int32_t)(saved - commit.saved) > 0) {
+      LOG("SessionJournal: save %lu is newer than the last commit", (unsigned long)saved);
+      return false;
+    }
+    restoredSlot = slot;
+    if (commit.count == 0) {
+      LOG("SessionJournal: last commit holds no tracks");
+      return false;
+    }
+
+    // Tracks first, so the blocks have pages to go to
+    for (int i = 0; i < NUM_LOOPS; i++) replay.trackOf[i] = -1;
+    uint32_t count = 0;
+    {
+      Hal::AudioIrqGuard guard;
+      if (looper.isIdle()) {
+        for (; count < commit.count; count++) {
+          const Layout& layout = commit.tracks[count];
+          Track* track = looper.getTrack(count);
+          if (layout.slot >= NUM_LOOPS ||
+              !track->beginRestore(layout.startOffset, layout.length, layout.volume, layout.muted)) break;
+          replay.generations[count] = track->getGeneration();
+          replay.epochs[count] = layout.epoch;
+          replay.lastRecord[count] = lastRecord[layout.slot];
+          replay.trackOf[layout.slot] = count;
+        }
+        if (count > 0) looper.beginRestore(count);
+      }
+    }
+    if (count == 0) {
+      LOG("SessionJournal: cannot restore, SPI RAM full or looper busy");
+      return false;
+    }
+
+    replay.file = Hal::openStreamFile(NAMES[slot]);
+    replay.running = true;
+    replay.count = count;
+    replay.played = 0;
+    replay.at = 0;
+    replay.end = replay.file ? end : 0;
+    replay.blocks = 0;
+    replay.bytes = 0;
+    replay.began = began;
+    LOG("SessionJournal: restoring %lu tracks from %s (commit %lu)", (unsigned long)count, NAMES[slot],
+        (unsigned long)commit.sequence);
+    return true;
+  }
+
+  // setup(), after any restore: starts a journal file. The file restored
+  // from, or else the newer one, is left alone.
+  bool begin() {
+    if (!MemorySd::ensureSdInit()) return false;
+    uint32_t sequences[2] = { 0, 0 };
+    bool valid[2] = { false, false };
+    for (int i = 0; i < 2; i++) {
+      uint32_t commitEnd;
+      valid[i] = scan(i, sequences[i], commitEnd, nullptr);
+    }
+    int newer = valid[1] && (!valid[0] || (int32_t)(sequences[1] - sequences[0]) > 0) ? 1 : 0;
+    fileSequence = valid[newer] ? sequences[newer] : 0;
+    int keep = restoredSlot >= 0 ? restoredSlot : newer;
+    active = openFile(keep ^ 1);
+    return active;
+  }
+
+  // Main Loop: one step of journaling, SD work only when something changed
+  void update() {
+    if (replay.running) {
+      replayRecord();
+      return;
+    }
+    if (!active) return;
+    uint32_t began = Hal::microseconds();
+    if (!step()) return;
+
+    uint32_t took = Hal::microseconds() - began;
+    stats.passes++;
+    stats.totalMicros += took;
+    if (took > stats.worstMicros) stats.worstMicros = took;
+  }
+
+  const Stats& getStats() const { return stats; }
+  bool isActive() const { return active; }
+  bool isRestoring() const { return replay.running; }
+  // Nothing waiting to be journaled or committed
+  bool isIdle() const { return !passing && phase == SCAN && looper.getStoredWrites() == scannedWrites; }
+
+private:
+  enum Phase { SCAN, SYNC, SEAL, SYNC_SEAL };
+
+  static const size_t BLOCK_BYTES = STORAGE_BLOCK_WORDS * sizeof(int16_t);
+  static const uint32_t FILE_BYTES = (uint32_t)AUTOSAVE_FILE_MB * 1024 * 1024;
+  static inline const char* const NAMES[2] = { "journal_0.bin", "journal_1.bin" };
+
+  // What the journal knows about each looper track
+  struct Slot {
+    bool live;           // closed and being journaled
+    uint32_t generation; // Track::getGeneration() when its epoch began
+    Layout layout;       // as of the last scan
+  };
+
+  AudioLooper& looper;
+  SessionStore* session;
+  bool active;
+  Hal::StreamFile file;
+  int fileSlot, restoredSlot;
+  uint32_t fileSequence;
+  uint32_t offset;       // end of the last record written
+  uint32_t nextEpoch;
+  uint32_t commitCount;
+  Slot slots[NUM_LOOPS];
+  Layout committed[NUM_LOOPS];
+  Layout sealed[NUM_LOOPS]; // commit written, not yet synced
+  uint32_t sealedCount;
+  uint64_t sealedSnapshot;
+
+  // Scan state: a pass takes every dirty block of the live tracks, then commits
+  Phase phase;
+  bool passing;
+  int cursorSlot;
+  size_t cursorBlock;
+  uint32_t scannedWrites; // Looper::getStoredWrites() when the last pass began
+  uint32_t passBlocks;
+  float microsPerBlock;   // measured cost of journaling one block
+
+  // Restore under way: the commit's tracks, replayed a record per pass
+  struct Replay {
+    bool running;
+    Hal::StreamFile file;
+    uint32_t at, end;                // next record, end of the commit
+    uint32_t count;                  // tracks
+    uint32_t played;                 // tracks handed to the looper
+    uint32_t epochs[NUM_LOOPS];
+    uint32_t generations[NUM_LOOPS];
+    uint32_t lastRecord[NUM_LOOPS];  // end of each track's last record, 0 for none
+    int trackOf[NUM_LOOPS];          // journal slot -> looper track
+    uint32_t blocks, bytes, began;
+  } replay;
+
+  Stats stats;
+  Record header;
+  // Record header sector followed by the data
+  SD_DMA_ALIGNED uint8_t sector[SD_SECTOR_BYTES + AUTOSAVE_RECORD_BLOCKS * BLOCK_BYTES + SD_SECTOR_BYTES];
+  int16_t* const data = (int16_t*)(sector + SD_SECTOR_BYTES);
+
+  static uint32_t sectorAlign(uint32_t bytes) {
+    return (bytes + SD_SECTOR_BYTES - 1) / SD_SECTOR_BYTES * SD_SECTOR_BYTES;
+  }
+
+  // FNV-1a
+  static uint32_t checksum(const void* bytes, size_t count, uint32_t hash = 2166136261u) {
+    const uint8_t* p = (const uint8_t*)bytes;
+    for (size_t i = 0; i < count; i++) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+  }
+
+  void resetFile() {
+    offset = 0;
+    nextEpoch = 1;
+    commitCount = 0;
+    memset(slots, 0, sizeof(slots));
+    memset(committed, 0, sizeof(committed));
+    memset(sealed, 0, sizeof(sealed));
+    sealedCount = 0;
+    sealedSnapshot = 0;
+    phase = SCAN;
+    passing = false;
+    cursorSlot = 0;
+    cursorBlock = 0;
+    scannedWrites = looper.getStoredWrites() - 1; // first update() looks
+    passBlocks = 0;
+    microsPerBlock = 100.0f;
+  }
+
+  // --- Reading ---
+
+  // Reads and checks the record header at `at` into `header`
+  bool readRecord(Hal::StreamFile& from, uint32_t at) {
+    if (!from.seekSet(at) || from.read(sector, SD_SECTOR_BYTES) != SD_SECTOR_BYTES) return false;
+    memcpy(&header, sector, sizeof(header));
+    if (header.magic != MAGIC || header.version != VERSION) return false;
+    if (header.checksum != checksum(&header, offsetof(Record, checksum))) return false;
+    if (header.sampleRate != SAMPLE_RATE || header.codec != STORAGE_CODEC || header.blockWords != STORAGE_BLOCK_WORDS) return false;
+    if (header.type == BLOCKS) {
+      return header.count <= AUTOSAVE_RECORD_BLOCKS && header.dataBytes == sectorAlign(header.count * BLOCK_BYTES);
+    }
+    if (header.type == COMMIT) return header.count <= NUM_LOOPS && header.dataBytes == 0;
+    return header.type == OPEN && header.dataBytes == 0;
+  }
+
+  // Reads the data of the blocks record in `header`, right after it
+  bool readData(Hal::StreamFile& from) {
+    if (from.read(data, header.dataBytes) != (int)header.dataBytes) return false;
+    if (checksum(data, header.count * BLOCK_BYTES) == header.dataChecksum) return true;
+    LOG("SessionJournal: blocks record fails its checksum, skipped");
+    return false;
+  }
+
+  // Walks the record headers of journal `slot`. Returns false for no valid
+  // journal; `commitEnd` is the end of its last commit, 0 for none, and
+  // `lastCommit` gets that commit. Reads through `header`, so `lastCommit`
+  // must be another record. `lastRecord`, per journal slot, gets the end of
+  // the last blocks record of the epoch that commit holds, 0 for none.
+  bool scan(int slot, uint32_t& sequence, uint32_t& commitEnd, Record* lastCommit, uint32_t* lastRecord = nullptr) {
+    commitEnd = 0;
+    Hal::StreamFile source = Hal::openStreamFile(NAMES[slot]);
+    if (!source) return false;
+    bool valid = readRecord(source, 0) && header.type == OPEN;
+    sequence = header.sequence;
+    // An epoch's records are never written after the next one's
+    uint32_t epochs[NUM_LOOPS] = {}, ends[NUM_LOOPS] = {};
+    uint32_t at = SD_SECTOR_BYTES;
+    while (valid && readRecord(source, at)) {
+      at += SD_SECTOR_BYTES + header.dataBytes;
+      if (header.type == BLOCKS && header.slot < NUM_LOOPS) {
+        epochs[header.slot] = header.epoch;
+        ends[header.slot] = at;
+      }
+      if (header.type != COMMIT) continue;
+      commitEnd = at;
+      if (lastCommit) *lastCommit = header;
+      for (uint32_t i = 0; lastRecord && i < NUM_LOOPS; i++) lastRecord[i] = 0;
+      for (uint32_t i = 0; lastRecord && i < header.count; i++) {
+        const Layout& layout = header.tracks[i];
+        if (layout.slot < NUM_LOOPS && epochs[layout.slot] == layout.epoch) lastRecord[layout.slot] = ends[layout.slot];
+      }
+    }
+    source.close();
+    return valid;
+  }
+
+  // Main Loop: replays the next record of the restore. A track is handed to
+  // the looper once its last record is in, the base loop first.
+  void replayRecord() {
+    if (replay.at < replay.end && readRecord(replay.file, replay.at)) {
+      int track = header.type == BLOCKS && header.slot < NUM_LOOPS ? replay.trackOf[header.slot] : -1;
+      bool wanted = track >= 0 && header.epoch == replay.epochs[track];
+      if (wanted && readData(replay.file)) {
+        bool written = true;
+        for (uint32_t i = 0; i < header.count; i++) {
+          written &= looper.getTrack(track)->writeStored(replay.generations[track], header.blocks[i], 1,
+                                                          data + BLOCKS_TO_ADDR(i));
+        }
+        // Cleared meanwhile (reset, or a muted layer pruned), leave it
+        if (!written && looper.isIdle()) {
+          LOG("SessionJournal: looper reset, restore stopped");
+          replay.end = replay.at;
+          replay.played = replay.count;
+        }
+        replay.blocks += header.count;
+      }
+      replay.at += SD_SECTOR_BYTES + header.dataBytes;
+      replay.bytes += SD_SECTOR_BYTES + (wanted ? header.dataBytes : 0);
+    } else {
+      // Torn or unreadable: the tracks keep what they have
+      replay.end = replay.at;
+    }
+
+    // A later track joins at the loop start, so only once the base loop plays
+    for (; replay.played < replay.count; replay.played++) {
+      uint32_t i = replay.played;
+      if (replay.lastRecord[i] > replay.at && replay.at < replay.end) break;
+      looper.getTrack(i)->finishRestore(replay.generations[i]);
+      looper.playRestored(i);
+      if (i == 0) {
+        LOG("SessionJournal: base loop playing after %lu ms",
+            (unsigned long)((Hal::microseconds() - replay.began) / 1000));
+      }
+    }
+    if (replay.at < replay.end) return;
+
+    replay.file.close();
+    replay.running = false;
+    LOG("SessionJournal: restored %lu tracks, %lu blocks, %lu KB read in %lu ms", (unsigned long)replay.count,
+        (unsigned long)replay.blocks, (unsigned long)(replay.bytes / 1024),
+        (unsigned long)((Hal::microseconds() - replay.began) / 1000));
+  }
+
+  // --- Writing ---
+
+  void fillHeader(Type type) {
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.type = type;
+    header.sampleRate = SAMPLE_RATE;
+    header.codec = STORAGE_CODEC;
+    header.blockWords = STORAGE_BLOCK_WORDS;
+  }
+
+  // Writes `header`, and `header.dataBytes` of data after it
+  bool writeRecord() {
+    header.checksum = checksum(&header, offsetof(Record, checksum));
+    memset(sector, 0, SD_SECTOR_BYTES);
+    memcpy(sector, &header, sizeof(header));
+    size_t bytes = SD_SECTOR_BYTES + header.dataBytes;
+    if (file.write(sector, bytes) != bytes) {
+      LOG("SessionJournal: write failed, autosave off");
+      file.close();
+      active = false;
+      return false;
+    }
+    offset += bytes;
+    stats.bytes += bytes;
+    return true;
+  }
+
+  bool openFile(int slot) {
+    file = Hal::createStreamFile(NAMES[slot]);
+    if (!file) {
+      LOG("SessionJournal: cannot create %s", NAMES[slot]);
+      return false;
+    }
+    if (!file.preAllocate(FILE_BYTES)) {
+      LOG("SessionJournal: preAllocate failed for %s", NAMES[slot]);
+    }
+    fileSlot = slot;
+    resetFile();
+
+    memset(&header, 0, sizeof(header));
+    fillHeader(OPEN);
+    header.sequence = ++fileSequence;
+    if (!writeRecord() || !file.sync()) return false;
+    LOG("SessionJournal: journaling to %s", NAMES[slot]);
+    return true;
+  }
+
+  // One unit of SD work. Returns false when there was nothing to do.
+  bool step() {
+    if (phase == SYNC) {
+      // The data is on the card before the commit that vouches for it
+      if (!file.sync()) return fail("sync failed");
+      phase = SEAL;
+      return true;
+    }
+    if (phase == SEAL) return seal();
+    if (phase == SYNC_SEAL) return syncSeal();
+
+    if (!passing) {
+      // A collapse rewrites the base loop over a lap, commit what it leaves
+      if (looper.isCollapsing()) return false;
+      uint32_t writes = looper.getStoredWrites();
+      bool changed = refreshSlots();
+      if (writes == scannedWrites && !changed) return false;
+
+      // Too big to restore quickly, or out of room: start over in the other file
+      uint64_t live = liveBytes();
+      if (offset + (uint64_t)AUTOSAVE_RECORD_BLOCKS * BLOCK_BYTES * 2 > FILE_BYTES ||
+          (live > 0 && offset > 4 * live + FILE_BYTES / 16)) {
+        LOG("SessionJournal: %lu KB written for %lu KB live, starting over", (unsigned long)(offset / 1024),
+            (unsigned long)(live / 1024));
+        // Its first record and sync make this pass, the scan starts on the next
+        file.close();
+        active = openFile(fileSlot ^ 1);
+        return true;
+      }
+      scannedWrites = looper.getStoredWrites();
+      passing = true;
+      passBlocks = 0;
+      cursorSlot = 0;
+      cursorBlock = 0;
+    }
+
+    // Next dirty blocks, as many as the budget allows
+    size_t batch = (size_t)(AUTOSAVE_BUDGET_US / microsPerBlock);
+    if (batch < 1) batch = 1;
+    if (batch > AUTOSAVE_RECORD_BLOCKS) batch = AUTOSAVE_RECORD_BLOCKS;
+    uint32_t began = Hal::microseconds();
+    for (; cursorSlot < NUM_LOOPS; cursorSlot++, cursorBlock = 0) {
+      Slot& slot = slots[cursorSlot];
+      if (!slot.live) continue;
+
+      memset(&header, 0, sizeof(header));
+      size_t count = looper.getTrack(cursorSlot)->takeDirtyBlocks(slot.generation, cursorBlock, batch, header.blocks, data);
+      if (count == 0) continue;
+
+      fillHeader(BLOCKS);
+      header.slot = cursorSlot;
+      header.epoch = slot.layout.epoch;
+      header.count = count;
+      header.dataBytes = sectorAlign(count * BLOCK_BYTES);
+      header.dataChecksum = checksum(data, count * BLOCK_BYTES);
+      memset((uint8_t*)data + count * BLOCK_BYTES, 0, header.dataBytes - count * BLOCK_BYTES);
+      if (!writeRecord()) return true;
+      passBlocks += count;
+      stats.blocks += count;
+
+      float perBlock = (float)(Hal::microseconds() - began) / count;
+      microsPerBlock = microsPerBlock * 0.75f + perBlock * 0.25f;
+      if (microsPerBlock < 1.0f) microsPerBlock = 1.0f;
+      return true;
+    }
+
+    // Every track scanned
+    passing = false;
+    if (passBlocks > 0 || layoutsDiffer()) {
+      phase = SYNC;
+      return true;
+    }
+    return true;
+  }
+
+  // Writes the commit record for the tracks scanned in this pass; it is
+  // synced on the next
+  bool seal() {
+    phase = SCAN;
+    // A track cleared or rewritten since its blocks were taken: the next pass
+    // picks it up, a commit now could hold a mix of old and new tracks
+    for (int i = 0; i < NUM_LOOPS; i++) {
+      if (slots[i].live && looper.getTrack(i)->getGeneration() != slots[i].generation) return true;
+    }
+
+    memset(&header, 0, sizeof(header));
+    fillHeader(COMMIT);
+    header.sequence = ++commitCount;
+    header.saved = session ? session->getLastSequence() : 0;
+
+    uint32_t count = 0;
+    sealedSnapshot = 0;
+    memset(sealed, 0, sizeof(sealed));
+    for (int i = 0; i < NUM_LOOPS; i++) {
+      Track* track = looper.getTrack(i);
+      if (!slots[i].live) continue;
+      sealed[i] = slots[i].layout;
+      header.tracks[count++] = sealed[i];
+      sealedSnapshot += track->getStoredBlocks() * BLOCK_BYTES;
+    }
+    header.count = count;
+    sealedCount = count;
+    if (!writeRecord()) return true;
+    phase = SYNC_SEAL;
+    return true;
+  }
+
+  // Syncs the commit record written by seal(), the next pass
+  bool syncSeal() {
+    phase = SCAN;
+    if (!file.sync()) return fail("commit failed");
+
+    memcpy(committed, sealed, sizeof(committed));
+    stats.commits++;
+    stats.snapshotBytes += sealedSnapshot + SD_SECTOR_BYTES;
+    LOG("SessionJournal: commit %lu, %lu tracks; %lu KB written, %lu KB as full snapshots; worst pass %lu us",
+        (unsigned long)commitCount, (unsigned long)sealedCount, (unsigned long)(stats.bytes / 1024),
+        (unsigned long)(stats.snapshotBytes / 1024), (unsigned long)stats.worstMicros);
+    return true;
+  }
+
+  bool fail(const char* reason) {
+    LOG("SessionJournal: %s, autosave off", reason);
+    file.close();
+    active = false;
+    return true;
+  }
+
+  // Picks up new, cleared and changed tracks. A new one gets an epoch and
+  // every block flagged. Returns whether any layout differs from the commit.
+  bool refreshSlots() {
+    for (int i = 0; i < NUM_LOOPS; i++) {
+      Track* track = looper.getTrack(i);
+      Slot& slot = slots[i];
+      bool closed;
+      uint32_t generation;
+      Layout layout;
+      memset(&layout, 0, sizeof(layout));
+      {
+        Hal::AudioIrqGuard guard;
+        Track::State state = track->getState();
+        closed = (state == Track::PLAY || state == Track::OVERDUB || state == Track::STOP) && track->getLength() > 0 &&
+                 track->isXfadeComplete() && !track->isSpilled() && !track->isRestoring();
+        generation = track->getGeneration();
+        layout.startOffset = track->getStartOffset();
+        layout.length = track->getLength();
+        layout.volume = track->getVolume();
+        layout.muted = track->getMuteState();
+        layout.slot = i;
+      }
+
+      if (!closed) {
+        slot.live = false;
+        continue;
+      }
+      if (!slot.live || slot.generation != generation) {
+        slot.live = true;
+        slot.generation = generation;
+        slot.layout.epoch = nextEpoch++;
+        track->markStoredDirty(generation);
+      }
+      layout.epoch = slot.layout.epoch;
+      slot.layout = layout;
+    }
+    return layoutsDiffer();
+  }
+
+  bool layoutsDiffer() {
+    for (int i = 0; i < NUM_LOOPS; i++) {
+      const Layout& now = slots[i].live ? slots[i].layout : Layout();
+      if (memcmp(&now, &committed[i], sizeof(Layout)) != 0) return true;
+    }
+    return false;
+  }
+
+  uint64_t liveBytes() {
+    uint64_t bytes = 0;
+    for (int i = 0; i < NUM_LOOPS; i++) {
+      if (slots[i].live) bytes += looper.getTrack(i)->getStoredBlocks() * BLOCK_BYTES;
+    }
+    return bytes;
+  }
+};
+
+#endif // SESSION_JOURNAL_H
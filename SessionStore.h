@@ -0,0 +1,401 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include <stddef.h>
+#include "Definitions.h"
+#include "AudioLooper.h"
+#include "Hal.h"
+#include "Memory.h"
+#include "Track.h"
+
+// -------------------------------------------------------------------------
+// SessionStore
+// Saves the closed loops to SD and brings them back after a power cycle.
+// A session file is one header sector followed by every track's stored
+// blocks, exactly as they sit in SPI RAM (so in the STORAGE_CODEC format),
+// each track starting on a sector. The header holds an extent table: where
+// each track's blocks are, the loop edges and the track's volume and mute.
+// The crossfade tail is saved as the blocks after the loop.
+// Saves alternate between two files and write the header last, with a
+// sequence number and checksum, so a save cut short by power loss leaves
+// the previous one intact. Boot restores the newest valid file.
+// Both directions move SESSION_BURST_BLOCKS blocks per loop() pass. A
+// restore starts the base loop after its first burst and lets each layer
+// join at the loop start once all its blocks are in.
+// Tracks with a cold part spilled to SD are not saved. Main Loop only.
+// -------------------------------------------------------------------------
+class SessionStore {
+public:
+  static const uint32_t MAGIC = 0x53504C53; // "SLPS"
+  static const uint16_t VERSION = 1;
+
+  // One track in the session file
+  struct Extent {
+    uint32_t address;     // file byte offset of stored block 0, sector aligned
+    uint32_t blocks;      // stored blocks, loop and crossfade tail
+    uint32_t startOffset; // sample of stored block 0 the loop starts at
+    uint32_t length;      // loop length in samples
+    uint16_t tailBlocks;  // crossfade tail blocks at the end of `blocks`
+    uint8_t muted;
+    uint8_t reserved;
+    float volume;
+  };
+
+  struct Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerBytes;
+    uint32_t sequence;    // bumped on every save, the newest valid file wins
+    uint32_t sampleRate;
+    uint16_t codec;       // STORAGE_CODEC
+    uint16_t blockWords;  // STORAGE_BLOCK_WORDS
+    uint32_t timeline;    // base loop length in samples
+    uint32_t trackCount;
+    Extent tracks[NUM_LOOPS];
+    uint32_t checksum;    // of everything above
+  };
+  static_assert(sizeof(Header) <= SD_SECTOR_BYTES, "session header must fit one sector");
+
+  SessionStore(AudioLooper& looper) : looper(looper) {
+    mode = IDLE;
+    lastSequence = 0;
+    copyTrack = 0;
+    copyBlock = 0;
+    bytesMoved = 0;
+    startMicros = 0;
+    firstAudioMicros = 0;
+    elapsedMicros = 0;
+    memset(&header, 0, sizeof(header));
+  }
+
+  // Main Loop: starts saving every closed track. Needs the loop playing.
+  void save() {
+    if (mode != IDLE) {
+      LOG("SessionStore: busy, save ignored");
+      return;
+    }
+    if (!looper.isPlaying() || looper.isWaiting()) {
+      LOG("SessionStore: save needs a playing loop");
+      return;
+    }
+    if (!MemorySd::ensureSdInit()) return;
+    findNewest(nullptr);
+
+    memset(&header, 0, sizeof(header));
+    uint32_t address = SD_SECTOR_BYTES;
+    int skipped = 0;
+    {
+      // One consistent view of the track table
+      Hal::AudioIrqGuard guard;
+      header.timeline = looper.getTimeline();
+      for (int i = 0; i < looper.getTrackCount(); i++) {
+        Track* track = looper.getTrack(i);
+        Track::State state = track->getState();
+        bool closed = (state == Track::PLAY || state == Track::STOP) && track->getLength() > 0 && track->isXfadeComplete();
+        if (!closed || track->isSpilled() || track->isRestoring()) {
+          // A layer still recording, or audio that is not all in SPI RAM
+          skipped++;
+          if (i == 0) break;
+          continue;
+        }
+
+        Extent& extent = header.tracks[header.trackCount];
+        extent.address = address;
+        extent.blocks = track->getStoredBlocks();
+        extent.startOffset = track->getStartOffset();
+        extent.length = track->getLength();
+        extent.tailBlocks = FADE_DURATION_BLOCKS;
+        extent.muted = track->getMuteState();
+        extent.volume = track->getVolume();
+        sources[header.trackCount] = i;
+        generations[header.trackCount] = track->getGeneration();
+        address += sectorAlign(extent.blocks * BLOCK_BYTES);
+        header.trackCount++;
+      }
+    }
+    if (header.trackCount == 0 || sources[0] != 0) {
+      LOG("SessionStore: base loop cannot be saved (still recording or spilled to SD)");
+      return;
+    }
+
+    const char* name = SLOT_NAMES[(lastSequence + 1) & 1];
+    file = Hal::createStreamFile(name);
+    if (!file) {
+      LOG("SessionStore: cannot create %s", name);
+      return;
+    }
+    if (!file.preAllocate(address)) {
+      LOG("SessionStore: preAllocate failed for %s", name);
+    }
+
+    // Blank header first: the file only counts once the header goes in last
+    memset(buffer, 0, SD_SECTOR_BYTES);
+    if (file.write(buffer, SD_SECTOR_BYTES) != SD_SECTOR_BYTES) {
+      fail("header write failed");
+      return;
+    }
+
+    LOG("SessionStore: saving %lu tracks (%d skipped), %lu KB to %s", (unsigned long)header.trackCount,
+        skipped, (unsigned long)(address / 1024), name);
+    start(SAVING);
+  }
+
+  // setup(): restores the newest valid session, returns false when there is
+  // none. Call after looper.begin(), with the looper idle.
+  bool beginRestore() {
+    if (mode != IDLE || !MemorySd::ensureSdInit()) return false;
+    uint32_t began = Hal::microseconds();
+
+    int slot = findNewest(&header);
+    if (slot < 0) {
+      LOG("SessionStore: no saved session");
+      return false;
+    }
+    file = Hal::openStreamFile(SLOT_NAMES[slot]);
+    if (!file) return false;
+
+    uint32_t count = 0;
+    {
+      Hal::AudioIrqGuard guard;
+      if (looper.isIdle()) {
+        for (; count < header.trackCount; count++) {
+          const Extent& extent = header.tracks[count];
+          Track* track = looper.getTrack(count);
+          if (!track->beginRestore(extent.startOffset, extent.length, extent.volume, extent.muted)) break;
+          generations[count] = track->getGeneration();
+        }
+        if (count > 0) looper.beginRestore(count);
+      }
+    }
+    if (count == 0) {
+      fail("cannot restore, SPI RAM full or looper busy");
+      return false;
+    }
+    if (count < header.trackCount) {
+      LOG("SessionStore: SPI RAM full, restoring %lu of %lu tracks", (unsigned long)count,
+          (unsigned long)header.trackCount);
+    }
+    header.trackCount = count;
+
+    LOG("SessionStore: restoring %lu tracks from %s (save %lu)", (unsigned long)count, SLOT_NAMES[slot],
+        (unsigned long)header.sequence);
+    start(RESTORING);
+    startMicros = began;
+    return true;
+  }
+
+  // Main Loop: moves one burst
+  void update() {
+    if (mode == SAVING) saveBurst();
+    else if (mode == RESTORING) restoreBurst();
+  }
+
+  // Sequence of the newest valid save on the card, 0 for none
+  uint32_t findNewestSave() {
+    if (!MemorySd::ensureSdInit()) return 0;
+    return findNewest(nullptr) >= 0 ? lastSequence : 0;
+  }
+  // Newest save known of, found on the card or made since
+  uint32_t getLastSequence() const { return lastSequence; }
+
+  bool isBusy() const { return mode != IDLE; }
+  bool isRestoring() const { return mode == RESTORING; }
+
+  // Last save or restore: bytes moved and microseconds taken, and for a
+  // restore the microseconds until the base loop was queued to play
+  uint32_t getBytes() const { return bytesMoved; }
+  uint32_t getMicros() const { return elapsedMicros; }
+  uint32_t getFirstAudioMicros() const { return firstAudioMicros; }
+
+private:
+  enum Mode { IDLE, SAVING, RESTORING };
+
+  static const size_t BLOCK_BYTES = STORAGE_BLOCK_WORDS * sizeof(int16_t);
+  static inline const char* const SLOT_NAMES[2] = { "session_0.bin", "session_1.bin" };
+
+  AudioLooper& looper;
+  Mode mode;
+  Hal::StreamFile file;
+  Header header;
+  uint32_t lastSequence;           // newest save on the card
+  int sources[NUM_LOOPS];          // looper track of each saved extent
+  uint32_t generations[NUM_LOOPS]; // Track::getGeneration() when the copy started
+  uint32_t copyTrack;              // extent being copied
+  size_t copyBlock;                // next stored block of it
+  uint32_t bytesMoved;
+  uint32_t startMicros, firstAudioMicros, elapsedMicros;
+
+  // A burst plus a sector of padding
+  SD_DMA_ALIGNED int16_t buffer[(SESSION_BURST_BLOCKS * BLOCK_BYTES + SD_SECTOR_BYTES) / sizeof(int16_t)];
+
+  static uint32_t sectorAlign(uint32_t bytes) {
+    return (bytes + SD_SECTOR_BYTES - 1) / SD_SECTOR_BYTES * SD_SECTOR_BYTES;
+  }
+
+  // FNV-1a over the header up to the checksum
+  static uint32_t checksum(const Header& h) {
+    const uint8_t* bytes = (const uint8_t*)&h;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(Header, checksum); i++) {
+      hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+  }
+
+  // Written by this build, intact, and every extent fits the track layout
+  static bool isValid(const Header& h) {
+    if (h.magic != MAGIC || h.version != VERSION || h.headerBytes != sizeof(Header)) return false;
+    if (h.checksum != checksum(h)) return false;
+    if (h.sampleRate != SAMPLE_RATE || h.codec != STORAGE_CODEC || h.blockWords != STORAGE_BLOCK_WORDS) return false;
+    if (h.trackCount < 1 || h.trackCount > NUM_LOOPS) return false;
+    for (uint32_t i = 0; i < h.trackCount; i++) {
+      const Extent& extent = h.tracks[i];
+      size_t loopBlocks = (extent.startOffset + extent.length + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES;
+      if (extent.tailBlocks != FADE_DURATION_BLOCKS || extent.blocks != loopBlocks + FADE_DURATION_BLOCKS) return false;
+      if (extent.address % SD_SECTOR_BYTES != 0 || extent.address < SD_SECTOR_BYTES) return false;
+    }
+    return h.timeline == h.tracks[0].length;
+  }
+
+  // Slot holding the newest valid session, -1 for none. Remembers its
+  // sequence so the next save goes to the other slot.
+  int findNewest(Header* newest) {
+    int found = -1;
+    for (int slot = 0; slot < 2; slot++) {
+      Hal::StreamFile candidate = Hal::openStreamFile(SLOT_NAMES[slot]);
+      if (!candidate) continue;
+      Header h;
+      bool valid = candidate.read(&h, sizeof(h)) == (int)sizeof(h) && isValid(h);
+      candidate.close();
+      if (!valid || (found >= 0 && (int32_t)(h.sequence - lastSequence) <= 0)) continue;
+      found = slot;
+      lastSequence = h.sequence;
+      if (newest) *newest = h;
+    }
+    return found;
+  }
+
+  void start(Mode n_mode) {
+    mode = n_mode;
+    copyTrack = 0;
+    copyBlock = 0;
+    bytesMoved = 0;
+    firstAudioMicros = 0;
+    elapsedMicros = 0;
+    startMicros = Hal::microseconds();
+  }
+
+  void fail(const char* reason) {
+    LOG("SessionStore: %s", reason);
+    file.close();
+    mode = IDLE;
+  }
+
+  void saveBurst() {
+    const Extent& extent = header.tracks[copyTrack];
+    size_t count = extent.blocks - copyBlock;
+    if (count > SESSION_BURST_BLOCKS) count = SESSION_BURST_BLOCKS;
+
+    if (!looper.getTrack(sources[copyTrack])->readStored(generations[copyTrack], copyBlock, count, buffer)) {
+      fail("track cleared while saving, save dropped");
+      return;
+    }
+    copyBlock += count;
+
+    // The last burst of a track pads up to the next track's sector
+    size_t bytes = count * BLOCK_BYTES;
+    if (copyBlock == extent.blocks) {
+      size_t padded = sectorAlign(extent.blocks * BLOCK_BYTES) - (extent.blocks * BLOCK_BYTES);
+      memset((uint8_t*)buffer + bytes, 0, padded);
+      bytes += padded;
+    }
+    if (file.write(buffer, bytes) != bytes) {
+      fail("write failed, save dropped");
+      return;
+    }
+    bytesMoved += bytes;
+
+    if (copyBlock < extent.blocks) return;
+    copyTrack++;
+    copyBlock = 0;
+    if (copyTrack < header.trackCount) return;
+
+    // Everything is on the card, now the header makes it valid
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.headerBytes = sizeof(Header);
+    header.sequence = lastSequence + 1;
+    header.sampleRate = SAMPLE_RATE;
+    header.codec = STORAGE_CODEC;
+    header.blockWords = STORAGE_BLOCK_WORDS;
+    header.checksum = checksum(header);
+    memset(buffer, 0, SD_SECTOR_BYTES);
+    memcpy(buffer, &header, sizeof(header));
+    if (!file.seekSet(0) || file.write(buffer, SD_SECTOR_BYTES) != SD_SECTOR_BYTES || !file.sync()) {
+      fail("header write failed, save dropped");
+      return;
+    }
+    file.close();
+    lastSequence = header.sequence;
+    bytesMoved += SD_SECTOR_BYTES;
+    finish("saved");
+  }
+
+  void restoreBurst() {
+    const Extent& extent = header.tracks[copyTrack];
+    if (copyBlock == 0 && !file.seekSet(extent.address)) {
+      fail("seek failed, restore stopped");
+      return;
+    }
+
+    size_t count = extent.blocks - copyBlock;
+    if (count > SESSION_BURST_BLOCKS) count = SESSION_BURST_BLOCKS;
+    int bytes = file.read(buffer, count * BLOCK_BYTES);
+    if (bytes != (int)(count * BLOCK_BYTES)) {
+      fail("read failed, restore stopped");
+      return;
+    }
+    bytesMoved += bytes;
+
+    Track* track = looper.getTrack(copyTrack);
+    bool written = track->writeStored(generations[copyTrack], copyBlock, count, buffer);
+    copyBlock += count;
+
+    if (!written) {
+      // Cleared meanwhile (reset, or a muted layer pruned), leave it
+      LOG("SessionStore: track %lu cleared while restoring", (unsigned long)copyTrack);
+      if (looper.isIdle()) {
+        fail("looper reset, restore stopped");
+        return;
+      }
+      copyBlock = extent.blocks;
+    } else if (copyTrack == 0 && firstAudioMicros == 0) {
+      // The rest of the base loop loads far faster than it plays
+      looper.playRestored(0);
+      firstAudioMicros = Hal::microseconds() - startMicros;
+      LOG("SessionStore: base loop playing after %lu us", (unsigned long)firstAudioMicros);
+    }
+
+    if (copyBlock < extent.blocks) return;
+    if (written && copyTrack > 0) looper.playRestored(copyTrack);
+    copyTrack++;
+    copyBlock = 0;
+    if (copyTrack < header.trackCount) return;
+
+    file.close();
+    finish("restored");
+  }
+
+  void finish(const char* what) {
+    elapsedMicros = Hal::microseconds() - startMicros;
+    // Bytes per microsecond are MB/s
+    LOG("SessionStore: %s %lu tracks, %lu KB in %lu ms (%.2f MB/s)", what, (unsigned long)header.trackCount,
+        (unsigned long)(bytesMoved / 1024), (unsigned long)(elapsedMicros / 1000),
+        elapsedMicros > 0 ? (float)bytesMoved / elapsedMicros : 0.0f);
+    mode = IDLE;
+  }
+};
+
+#endif // SESSION_STORE_H
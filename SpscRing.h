@@ -0,0 +1,127 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <Arduino.h>
+
+/**
+ * Lock-free single producer / single consumer ring buffer.
+ * One side may live in an ISR and the other in loop(): the producer only
+ * writes `head`, the consumer only writes `tail`, and each publish is a
+ * release store paired with an acquire load on the other side.
+ * Indices are free-running counters masked into the buffer, so Capacity must
+ * be a power of two and every slot is usable.
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+
+public:
+  SpscRing() : head(0), tail(0), overflows(0) {}
+
+  // --- Producer side ---
+
+  /**
+   * Adds one item. Returns false (and counts an overflow) when full.
+   */
+  bool push(const T& item) {
+    uint32_t h = head;
+    if (h - load(tail) >= Capacity) {
+      overflows++;
+      return false;
+    }
+    buffer[h & MASK] = item;
+    store(head, h + 1);
+    return true;
+  }
+
+  /**
+   * Adds up to `count` items in one publish. Returns how many fit; the rest
+   * are counted as overflows.
+   */
+  size_t pushBulk(const T* items, size_t count) {
+    uint32_t h = head;
+    size_t space = Capacity - (h - load(tail));
+    size_t n = count < space ? count : space;
+    for (size_t i = 0; i < n; i++) {
+      buffer[(h + i) & MASK] = items[i];
+    }
+    store(head, h + (uint32_t)n);
+    overflows += (uint32_t)(count - n);
+    return n;
+  }
+
+  // --- Consumer side ---
+
+  /**
+   * Removes the oldest item into `item`. Returns false when empty.
+   */
+  bool pop(T& item) {
+    uint32_t t = tail;
+    if (load(head) == t) return false;
+    item = buffer[t & MASK];
+    store(tail, t + 1);
+    return true;
+  }
+
+  /**
+   * Removes up to `count` items in one publish. Returns how many were read.
+   */
+  size_t popBulk(T* items, size_t count) {
+    uint32_t t = tail;
+    size_t stored = load(head) - t;
+    size_t n = count < stored ? count : stored;
+    for (size_t i = 0; i < n; i++) {
+      items[i] = buffer[(t + i) & MASK];
+    }
+    store(tail, t + (uint32_t)n);
+    return n;
+  }
+
+  /**
+   * Copies the oldest item without removing it. Returns false when empty.
+   */
+  bool peek(T& item) const {
+    uint32_t t = tail;
+    if (load(head) == t) return false;
+    item = buffer[t & MASK];
+    return true;
+  }
+
+  // --- Either side (a snapshot, may be stale by the time it is used) ---
+
+  size_t size() const { return load(head) - load(tail); }
+  bool isEmpty() const { return size() == 0; }
+  bool isFull() const { return size() >= Capacity; }
+  size_t capacity() const { return Capacity; }
+
+  // Pushes refused because the ring was full
+  uint32_t getOverflows() const { return overflows; }
+
+  /**
+   * Empties the ring. Only safe while neither side is running.
+   */
+  void reset() {
+    head = 0;
+    tail = 0;
+    overflows = 0;
+  }
+
+private:
+  static const uint32_t MASK = Capacity - 1;
+
+  T buffer[Capacity];
+  uint32_t head;      // next slot to write, producer only
+  uint32_t tail;      // next slot to read, consumer only
+  volatile uint32_t overflows;
+
+  static inline uint32_t load(const uint32_t& index) {
+    return __atomic_load_n(&index, __ATOMIC_ACQUIRE);
+  }
+
+  static inline void store(uint32_t& index, uint32_t value) {
+    __atomic_store_n(&index, value, __ATOMIC_RELEASE);
+  }
+};
+
+#endif // SPSC_RING_H
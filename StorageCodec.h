@@ -0,0 +1,160 @@
+#ifndef STORAGE_CODEC_H
+#define STORAGE_CODEC_H
+
+#include <AudioStream.h>
+#include "Definitions.h"
+
+// -------------------------------------------------------------------------
+// StorageCodec
+// Converts one audio block of PCM to and from the STORAGE_BLOCK_WORDS words
+// kept in SPI RAM. Every stored block carries its own header, so any block
+// can be decoded on its own (random access at block granularity).
+// Selected at compile time with STORAGE_CODEC in Definitions.h.
+// -------------------------------------------------------------------------
+class StorageCodec {
+public:
+  // Raw PCM: callers can skip the encode/decode copies entirely
+  static const bool IS_RAW = (STORAGE_CODEC == CODEC_PCM16);
+
+  static void encode(const int16_t* pcm, int16_t* stored) {
+#if STORAGE_CODEC == CODEC_BFP8
+    encodeBfp8(pcm, stored);
+#elif STORAGE_CODEC == CODEC_ADPCM
+    encodeAdpcm(pcm, stored);
+#else
+    memcpy(stored, pcm, AUDIO_BLOCK_SAMPLES * sizeof(int16_t));
+#endif
+  }
+
+  static void decode(const int16_t* stored, int16_t* pcm) {
+#if STORAGE_CODEC == CODEC_BFP8
+    decodeBfp8(stored, pcm);
+#elif STORAGE_CODEC == CODEC_ADPCM
+    decodeAdpcm(stored, pcm);
+#else
+    memcpy(pcm, stored, AUDIO_BLOCK_SAMPLES * sizeof(int16_t));
+#endif
+  }
+
+  // --- Block Floating Point, 8-bit mantissa (2:1) ---
+  // Word 0: shift. Words 1..64: two int8 mantissas each (low byte first).
+
+  static void encodeBfp8(const int16_t* pcm, int16_t* stored) {
+    int32_t peak = 0;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      int32_t v = pcm[i] < 0 ? -(pcm[i] + 1) : pcm[i];
+      if (v > peak) peak = v;
+    }
+
+    int shift = 0;
+    while ((peak >> shift) > 127) shift++;
+
+    stored[0] = (int16_t)shift;
+    int32_t round = shift ? (1 << (shift - 1)) : 0;
+    uint8_t* mantissas = (uint8_t*)&stored[1];
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      int32_t m = (pcm[i] + round) >> shift;
+      if (m > 127) m = 127; // rounding can push the peak over
+      mantissas[i] = (uint8_t)(int8_t)m;
+    }
+  }
+
+  static void decodeBfp8(const int16_t* stored, int16_t* pcm) {
+    int shift = stored[0];
+    const int8_t* mantissas = (const int8_t*)&stored[1];
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      pcm[i] = (int16_t)(mantissas[i] * (1 << shift));
+    }
+  }
+
+  // --- IMA-ADPCM (4:1 plus header) ---
+  // Word 0: predictor. Word 1: step index. Words 2..33: four 4-bit codes each.
+
+  static void encodeAdpcm(const int16_t* pcm, int16_t* stored) {
+    // Start from a step that matches the block's largest jump, since every
+    // block is coded independently
+    int32_t maxDelta = 0;
+    for (int i = 1; i < AUDIO_BLOCK_SAMPLES; i++) {
+      int32_t d = pcm[i] - pcm[i - 1];
+      if (d < 0) d = -d;
+      if (d > maxDelta) maxDelta = d;
+    }
+    int index = 0;
+    while (index < 88 && STEP_TABLE[index] * 2 < maxDelta) index++;
+
+    int32_t predictor = pcm[0];
+    stored[0] = (int16_t)predictor;
+    stored[1] = (int16_t)index;
+
+    uint16_t* codes = (uint16_t*)&stored[2];
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      int32_t step = STEP_TABLE[index];
+      int32_t diff = pcm[i] - predictor;
+      uint8_t code = 0;
+      if (diff < 0) {
+        code = 8;
+        diff = -diff;
+      }
+
+      int32_t vpdiff = step >> 3;
+      if (diff >= step) { code |= 4; diff -= step; vpdiff += step; }
+      step >>= 1;
+      if (diff >= step) { code |= 2; diff -= step; vpdiff += step; }
+      step >>= 1;
+      if (diff >= step) { code |= 1; vpdiff += step; }
+
+      predictor = stepPredictor(predictor, code, vpdiff);
+      index = stepIndex(index, code);
+
+      if ((i & 3) == 0) codes[i >> 2] = 0;
+      codes[i >> 2] |= (uint16_t)code << ((i & 3) * 4);
+    }
+  }
+
+  static void decodeAdpcm(const int16_t* stored, int16_t* pcm) {
+    int32_t predictor = stored[0];
+    int index = stored[1];
+    const uint16_t* codes = (const uint16_t*)&stored[2];
+
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      uint8_t code = (codes[i >> 2] >> ((i & 3) * 4)) & 0x0F;
+      int32_t step = STEP_TABLE[index];
+
+      int32_t vpdiff = step >> 3;
+      if (code & 4) vpdiff += step;
+      if (code & 2) vpdiff += step >> 1;
+      if (code & 1) vpdiff += step >> 2;
+
+      predictor = stepPredictor(predictor, code, vpdiff);
+      index = stepIndex(index, code);
+      pcm[i] = (int16_t)predictor;
+    }
+  }
+
+private:
+  static inline int32_t stepPredictor(int32_t predictor, uint8_t code, int32_t vpdiff) {
+    predictor += (code & 8) ? -vpdiff : vpdiff;
+    return SAMPLE_LIMITER(predictor);
+  }
+
+  static inline int stepIndex(int index, uint8_t code) {
+    index += INDEX_TABLE[code & 7];
+    if (index < 0) return 0;
+    if (index > 88) return 88;
+    return index;
+  }
+
+  static constexpr int8_t INDEX_TABLE[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+  static constexpr int16_t STEP_TABLE[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+  };
+};
+
+#endif // STORAGE_CODEC_H
@@ -12,6 +12,10 @@
 #include "Pot.h"
 #include "MidiHandler.h"
 #include "MidiClock.h"
+#include "TempoSync.h"
+#include "SessionStore.h"
+#include "SessionJournal.h"
+#include "Benchmark.h"
 
 // #define USB_AUDIO
 // #ifndef USB_AUDIO
@@ -68,10 +72,14 @@ void handlePot();
 void handleFootswitch();
 void handleLed();
 void handleBpmLogging();
+void sendClockOut(uint8_t status);
 
 MIDI_CREATE_INSTANCE(HardwareSerial, Serial1, MIDI);
 MidiClock midiClock;
-MidiHandler midiHandler(looper, MIDI, midiClock);
+TempoSync tempoSync(looper, midiClock);
+SessionStore session(looper);
+SessionJournal journal(looper, SESSION_RESTORE ? &session : nullptr);
+MidiHandler midiHandler(looper, MIDI, midiClock, tempoSync, session);
 
 // -------------------------------------------------------------------------
 // Setup
@@ -99,6 +107,8 @@ void setup() {
 
   // MIDI Setup
   MIDI.begin(MIDI_CHANNEL_OMNI);
+  MidiInput::begin();
+  MidiClockOut::begin(sendClockOut);
 
 #if DEBUG_MODE
   // --- RAM TEST ---
@@ -133,6 +143,10 @@ void setup() {
   // ----------------
 #endif
 
+#if RUN_BENCHMARKS
+  Benchmark::runAll();
+#endif
+
   // Mixer Gain Settings (Unity)
   inputMixer.gain(0, 1.0f); // Hardware Input
   inputMixer.gain(1, 1.0f); // USB Input
@@ -161,6 +175,20 @@ void setup() {
   }
   pot1.setInitialValue(1.0f);
 
+  // After the RAM test and benchmarks, which write SPI RAM. The journal
+  // steps aside for a session saved after its last commit; loop() streams
+  // whichever was picked.
+  bool restored = false;
+#if AUTOSAVE
+  restored = journal.beginRestore();
+#endif
+#if SESSION_RESTORE
+  if (!restored) session.beginRestore();
+#endif
+#if AUTOSAVE
+  journal.begin();
+#endif
+
   LOG("Setup Complete!");
 }
 
@@ -168,11 +196,27 @@ void setup() {
 // Main Loop
 // -------------------------------------------------------------------------
 void loop() {
+  looper.prefetch();
+  looper.updateStorage();
   handlePot();
   handleFootswitch();
   handleLed();
   midiHandler.update();
+  tempoSync.update();
   handleBpmLogging();
+  MidiClockOut::update();
+  session.update();
+  journal.update();
+  DeferredLog::drain();
+
+#if PROFILER_ENABLED
+  // 'p' dumps the ISR profile, 'r' clears it
+  if (Serial.available()) {
+    int command = Serial.read();
+    if (command == 'p') Profiler::dump();
+    else if (command == 'r') Profiler::reset();
+  }
+#endif
 }
 
 void handlePot() {
@@ -195,11 +239,12 @@ void handleFootswitch() {
   fs2.update();
 
   if (fs1.pressed()) {
-    looper.trigger();
+    tempoSync.trigger();
   }
 
   if (fs2.pressed()) {
     midiClock.triggerMeasureSync();
+    looper.sync();
     LOG("Sync Triggered via FS2");
   }
 }
@@ -256,11 +301,14 @@ void handleBpmLogging() {
   if (currentTotalBeats > lastBeat) {
     float bpm = midiClock.getBpm();
     if (bpm > 0) {
-      LOG("Beat %d/%d (Total: %d) | BPM: %.2f", 
+      LOG("Beat %d/%d (Total: %d) | BPM: %.2f | Jitter: %.1f smp, max %.0f, outliers %lu", 
           midiClock.getCurrentBeat(), 
           midiClock.getBeatsPerMeasure(),
           currentTotalBeats,
-          bpm);
+          bpm,
+          midiClock.getTempo().getErrorStdDev(),
+          midiClock.getTempo().getErrorMax(),
+          (unsigned long)midiClock.getTempo().getOutliers());
     }
     lastBeat = currentTotalBeats;
   }
@@ -270,3 +318,10 @@ void handleBpmLogging() {
 // MIDI Handling
 // -------------------------------------------------------------------------
 // (Moved to MidiHandler.h)
+
+// Clock master output, called from the MidiClockOut timer interrupt
+void sendClockOut(uint8_t status) {
+  usbMIDI.sendRealTime(status);
+  usbMIDI.send_now();
+  MIDI.sendRealTime((midi::MidiType)status);
+}
@@ -0,0 +1,185 @@
+#ifndef TEMPO_ESTIMATOR_H
+#define TEMPO_ESTIMATOR_H
+
+#include <Arduino.h>
+#include "Definitions.h"
+
+// -------------------------------------------------------------------------
+// TempoEstimator
+// Tick period and phase of an incoming clock from a least-squares line
+// through the last tick arrival times (tick index -> sample).
+// The window grows up to TEMPO_WINDOW_TICKS while the tempo holds, so
+// jitter averages out, and shrinks to TEMPO_MIN_WINDOW_TICKS when the
+// residuals show a ramp. A tick far off the line is left out of the fit;
+// a few in a row are taken as a tempo jump and restart the window there.
+// Every tick is first checked against the prediction, which gives the
+// jitter statistics. Main Loop only.
+// -------------------------------------------------------------------------
+class TempoEstimator {
+public:
+  TempoEstimator() { reset(); }
+
+  void reset() {
+    ticks = 0;
+    windowStart = 0;
+    fitCount = 0;
+    originIndex = 0;
+    originSample = 0;
+    slope = 0.0;
+    intercept = 0.0;
+    fitRms = 0.0;
+    valid = false;
+    outlierRun = 0;
+    trendRun = 0;
+    errorCount = 0;
+    errorMean = 0.0;
+    errorM2 = 0.0;
+    errorMax = 0.0;
+    outliers = 0;
+    tempoChanges = 0;
+  }
+
+  // Adds the arrival sample of the next tick. Returns false when the tick
+  // was too far off the prediction to be used.
+  bool addTick(uint32_t sample) {
+    uint32_t index = ticks++;
+    samples[index & MASK] = sample;
+    accepted[index & MASK] = true;
+    bool kept = true;
+
+    if (isValid()) {
+      double error = (double)(int32_t)(sample - predict(index));
+      double threshold = 6.0 * fitRms;
+      if (threshold < TEMPO_OUTLIER_SAMPLES) threshold = TEMPO_OUTLIER_SAMPLES;
+
+      if (fabs(error) > threshold) {
+        accepted[index & MASK] = false;
+        kept = false;
+        outliers++;
+        trendRun = 0;
+        if (++outlierRun >= TEMPO_JUMP_TICKS) {
+          // Not a stray tick: the clock jumped, start over from the run
+          windowStart = ticks - outlierRun;
+          for (uint32_t i = windowStart; i < ticks; i++) accepted[i & MASK] = true;
+          outlierRun = 0;
+          tempoChanges++;
+          kept = true;
+        }
+      } else {
+        outlierRun = 0;
+        addError(error);
+
+        // Residuals piling up on one side: the tempo is moving, drop the old ticks
+        bool sameSide = trendRun == 0 || (error > 0) == (lastError > 0);
+        trendRun = (sameSide && fabs(error) > fitRms + 1.0) ? trendRun + 1 : 0;
+        lastError = error;
+        if (trendRun >= TEMPO_TREND_TICKS && ticks - windowStart > TEMPO_MIN_WINDOW_TICKS) {
+          windowStart = ticks - TEMPO_MIN_WINDOW_TICKS;
+          trendRun = 0;
+          tempoChanges++;
+        }
+      }
+    }
+
+    if (ticks - windowStart > TEMPO_WINDOW_TICKS) windowStart = ticks - TEMPO_WINDOW_TICKS;
+    fit();
+    return kept;
+  }
+
+  // Enough ticks seen to trust the fit. Stays valid through a jump restart,
+  // which refits from the few ticks at the new tempo.
+  bool isValid() const { return valid; }
+
+  // Tick period in samples, 0 until valid
+  double getSamplesPerTick() const { return isValid() ? slope : 0.0; }
+
+  // Predicted arrival of the tick `ahead` ticks after the last one (1 = next)
+  uint32_t predictNext(uint32_t ahead = 1) const { return predict(ticks - 1 + ahead); }
+
+  // Residual RMS of the current fit, in samples
+  double getJitter() const { return fitRms; }
+
+  // Prediction error of every accepted tick since reset(), in samples
+  double getErrorMean() const { return errorMean; }
+  double getErrorStdDev() const { return errorCount > 1 ? sqrt(errorM2 / (errorCount - 1)) : 0.0; }
+  double getErrorMax() const { return errorMax; }
+
+  uint32_t getTicks() const { return ticks; }
+  uint32_t getWindowTicks() const { return ticks - windowStart; }
+  uint32_t getOutliers() const { return outliers; }
+  uint32_t getTempoChanges() const { return tempoChanges; }
+
+private:
+  static const uint32_t MASK = TEMPO_WINDOW_TICKS - 1;
+  static_assert((TEMPO_WINDOW_TICKS & MASK) == 0, "TEMPO_WINDOW_TICKS must be a power of two");
+
+  uint32_t samples[TEMPO_WINDOW_TICKS];
+  bool accepted[TEMPO_WINDOW_TICKS];
+  uint32_t ticks;       // ticks added since reset()
+  uint32_t windowStart; // first tick index in the fit
+
+  // Fit: sample(index) = originSample + intercept + slope * (index - originIndex)
+  uint32_t originIndex, originSample;
+  uint32_t fitCount;
+  double slope, intercept, fitRms;
+  bool valid;
+
+  uint32_t outlierRun, trendRun;
+  double lastError;
+
+  // Welford running statistics of the prediction error
+  uint32_t errorCount;
+  double errorMean, errorM2, errorMax;
+  uint32_t outliers, tempoChanges;
+
+  uint32_t predict(uint32_t index) const {
+    double offset = intercept + slope * (double)(int32_t)(index - originIndex);
+    return originSample + (uint32_t)(int32_t)lround(offset);
+  }
+
+  void addError(double error) {
+    errorCount++;
+    double delta = error - errorMean;
+    errorMean += delta / errorCount;
+    errorM2 += delta * (error - errorMean);
+    if (fabs(error) > errorMax) errorMax = fabs(error);
+  }
+
+  void fit() {
+    // Relative to the first tick in the window, so doubles keep full precision
+    uint32_t index0 = windowStart;
+    uint32_t sample0 = samples[windowStart & MASK];
+
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (uint32_t i = windowStart; i < ticks; i++) {
+      if (!accepted[i & MASK]) continue;
+      double x = (double)(i - index0);
+      double y = (double)(int32_t)(samples[i & MASK] - sample0);
+      n += 1.0;
+      sx += x;
+      sy += y;
+      sxx += x * x;
+      sxy += x * y;
+    }
+
+    double det = n * sxx - sx * sx;
+    if (n < 2 || det <= 0.0) return; // keep the last line
+    originIndex = index0;
+    originSample = sample0;
+    fitCount = (uint32_t)n;
+    slope = (n * sxy - sx * sy) / det;
+    intercept = (sy - slope * sx) / n;
+
+    double sse = 0;
+    for (uint32_t i = windowStart; i < ticks; i++) {
+      if (!accepted[i & MASK]) continue;
+      double x = (double)(i - originIndex);
+      double r = (double)(int32_t)(samples[i & MASK] - originSample) - (intercept + slope * x);
+      sse += r * r;
+    }
+    fitRms = n > 2 ? sqrt(sse / (n - 2)) : 0.0;
+    if (fitCount >= TEMPO_MIN_FIT_TICKS) valid = true;
+  }
+};
+
+#endif // TEMPO_ESTIMATOR_H
@@ -0,0 +1,119 @@
+#ifndef TEMPO_SYNC_H
+#define TEMPO_SYNC_H
+
+#include <Arduino.h>
+#include "Definitions.h"
+#include "AudioLooper.h"
+#include "MidiClock.h"
+#include "SampleClock.h"
+
+// -------------------------------------------------------------------------
+// TempoSync
+// Bar-locked base loop. While a MIDI clock runs, stopping the base recording
+// rounds it to a whole number of bars measured from the tick timestamps, and
+// the looper closes the loop on that exact sample, even if it is still ahead.
+// Once the loop plays, every tick is compared with where the loop puts it;
+// the difference is the drift of the loop against the clock, reported once
+// per lap. Main Loop only.
+// -------------------------------------------------------------------------
+class TempoSync {
+public:
+  TempoSync(AudioLooper& looper, MidiClock& clock) : looper(looper), clock(clock) {
+    enabled = TEMPO_SYNC_DEFAULT;
+    reset();
+  }
+
+  void setEnabled(bool willEnable) {
+    enabled = willEnable;
+    LOG("TempoSync: %s", enabled ? "on" : "off");
+  }
+  bool isEnabled() const { return enabled; }
+
+  // Footswitch / MIDI trigger. Stopping the base recording with a clock
+  // running closes it on the nearest bar line, anything else goes straight
+  // to the looper. A second press while waiting for the bar stops right away.
+  void trigger(uint32_t at = SampleClock::precise()) {
+    bool closingBase = looper.isRecording() && looper.getTimeline() == 0;
+    if (closingBase) loopTicks = 0;
+    if (!enabled || !closingBase || looper.isWaiting() || !clock.hasTempo()) {
+      looper.trigger(at);
+      return;
+    }
+
+    uint32_t ticksPerBar = MidiClock::TICKS_PER_BEAT * clock.getBeatsPerMeasure();
+    double barSamples = clock.getSamplesPerTick() * ticksPerBar;
+    uint32_t start = looper.getRecordStartSample();
+    double recorded = (double)(int32_t)(at - start);
+
+    uint32_t bars = (uint32_t)(recorded / barSamples + 0.5);
+    if (bars < 1) bars = 1;
+    uint32_t length = (uint32_t)(bars * barSamples + 0.5);
+
+    loopTicks = bars * ticksPerBar;
+    looper.closeLoopAt(start + length);
+    LOG("TempoSync: closing loop at %d bars, %d samples (%.2f BPM)", bars, length,
+        60.0 * SAMPLE_RATE / (clock.getSamplesPerTick() * MidiClock::TICKS_PER_BEAT));
+  }
+
+  // Main Loop: measures each new tick against the closed loop
+  void update() {
+    if (looper.isIdle()) {
+      reset();
+      return;
+    }
+
+    uint32_t ticks = clock.getTickCount();
+    size_t length = looper.getTimeline();
+    if (ticks == lastTick || length == 0 || loopTicks == 0) return;
+    lastTick = ticks;
+
+    // The first tick after the loop closes anchors the grid
+    uint32_t sample = clock.getLastTickSample();
+    if (!anchored) {
+      anchorTick = ticks;
+      anchorSample = sample;
+      anchored = true;
+      return;
+    }
+
+    uint32_t elapsedTicks = ticks - anchorTick;
+    double expected = (double)elapsedTicks * length / loopTicks;
+    drift = (int32_t)((double)(uint32_t)(sample - anchorSample) - expected);
+    if (abs(drift) > maxDrift) maxDrift = abs(drift);
+
+    uint32_t lap = elapsedTicks / loopTicks;
+    if (lap > lastLap) {
+      lastLap = lap;
+      LOG("TempoSync: lap %d drift %d samples (%.2f ms), max %d", lap, drift,
+          drift * 1000.0f / SAMPLE_RATE, maxDrift);
+    }
+  }
+
+  // Samples the clock runs behind (positive) or ahead of the loop, at the last tick
+  int32_t getDrift() const { return drift; }
+  int32_t getMaxDrift() const { return maxDrift; }
+
+private:
+  AudioLooper& looper;
+  MidiClock& clock;
+  bool enabled;
+
+  uint32_t loopTicks; // clock ticks per lap, 0 unless this loop was closed on a bar
+  bool anchored;
+  uint32_t anchorTick, anchorSample;
+  uint32_t lastTick, lastLap;
+  int32_t drift, maxDrift;
+
+  void reset() {
+    loopTicks = 0;
+    anchored = false;
+    anchorTick = 0;
+    anchorSample = 0;
+    lastTick = 0;
+    lastLap = 0;
+    drift = 0;
+    maxDrift = 0;
+  }
+};
+
+#endif // TEMPO_SYNC_H
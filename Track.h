@@ -4,8 +4,26 @@
 #include <AudioStream.h>
 #include "Definitions.h"
 #include "Ram.h"
+#include "TransferScheduler.h"
+#include "StorageCodec.h"
+#include "PageAllocator.h"
+#include "OverdubMap.h"
+#include "Memory.h"
 #include "GainControl.h"
-
+#include "Hal.h"
+#include "DeferredLog.h"
+
+// -------------------------------------------------------------------------
+// Track
+// Stored blocks hold the input exactly as it arrived, starting with the block
+// recording began in. The loop itself starts `startOffset` samples into
+// stored block 0 and is `length` samples long, so both edges are sample
+// accurate. Its crossfade tail is simply what was recorded after the end.
+// State changes take a sample offset: the block they land in is split there.
+// Playback builds every output block from pieces of up to two stored blocks
+// on each side of the loop end.
+// Overdub passes write to copies kept by an OverdubMap, so they can be undone.
+// -------------------------------------------------------------------------
 class Track {
 public:
   enum State {
@@ -16,100 +34,175 @@ public:
     STOP
   };
 
-  Track(Ram* ram) : ram(ram)
+  // Shortest loop: the crossfade plus one block, so a block never holds two
+  // loop starts and the crossfade never crosses one
+  static const size_t FADE_SAMPLES = FADE_DURATION_BLOCKS * AUDIO_BLOCK_SAMPLES;
+  static const size_t MIN_LOOP_SAMPLES = FADE_SAMPLES + AUDIO_BLOCK_SAMPLES;
+
+  Track(Ram* ram, PageAllocator* pager) : ram(ram), pager(pager)
   {
-    allocationId = 0;
-    address = 0;
+    numPages = 0;
+    spill = nullptr;
+    spilled = false;
+    spillStart = 0;
+    spillClearPending = false;
+    spillRestartPending = false;
+    spillUnderruns = 0;
+    prefetchMisses = 0;
+    prefetchGeneration = 0;
+    restoreUnderruns = 0;
     hardReset();
   }
-  ~Track() {}
+  ~Track() {
+    if (spill) delete spill;
+  }
 
-  // Audio Interrupt Callback
-  void update(audio_block_t* inBlock, audio_block_t* outBlock) {
-    // --- Safety Checks ---
-    // Output Block should already be zeroed coming in!!
-    if (!inBlock || !outBlock) return;
+  // Creates the SD spill stream. Call from setup(), after the SPI RAM is up.
+  void beginSpill() {
+#if SD_SPILL
+    if (!spill) spill = new MemorySd(SPILL_RING_BLOCKS);
+#endif
+  }
 
+  // Audio Interrupt Callback (phase 1)
+  // Advances the state machine and queues the SPI reads this block needs.
+  void schedule(TransferScheduler& xfer) {
     updateState();
 
-    switch (state) {
-      case RECORD: {
-        size_t addrOffset = address + BLOCKS_TO_ADDR(timeline);
-        int16_t buffer[AUDIO_BLOCK_SAMPLES];
-
-        // Debug: Log start of recording
-        if (timeline == 0) {
-          LOG("Track::update() -> Recording started at RAM Addr: %d", addrOffset);
+    numPlayPieces = 0;
+    numTailPieces = 0;
+    recordXfade = false;
+    processXfade = false;
+    silent = isSilent();
+
+    if (state == PLAY || state == OVERDUB) {
+      // The tail is recorded through the first lap, a stop block already covers this one
+      recordXfade = xfadeBlockCount < FADE_DURATION_BLOCKS && recordTo == 0;
+      bool tailReady = xfadeBlockCount >= FADE_DURATION_BLOCKS;
+
+      // At most two stretches: up to the loop end, then from the loop start
+      size_t pos = (playhead + playFrom) % length;
+      int i = playFrom;
+      while (i < AUDIO_BLOCK_SAMPLES) {
+        if (pos == 0) {
+          gc_xfade.hardReset(1.0f);
+          gc_xfade.fadeOutAt(i);
+          // A new lap takes every spilled block from the SD stream again
+          spillWindowTag[0] = PREFETCH_EMPTY;
+          spillWindowTag[1] = PREFETCH_EMPTY;
         }
 
-        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
-          buffer[i] = (int16_t)(inBlock->data[i] * gc_record.get(i));
+        int count = AUDIO_BLOCK_SAMPLES - i;
+        if ((size_t)count > length - pos) count = (int)(length - pos);
+        if (!silent) stagePieces(xfer, startOffset + pos, count, i, false);
+
+        if (!silent && tailReady && pos < FADE_SAMPLES) {
+          int tailCount = count;
+          if ((size_t)tailCount > FADE_SAMPLES - pos) tailCount = (int)(FADE_SAMPLES - pos);
+          stagePieces(xfer, startOffset + length + pos, tailCount, i, true);
+          processXfade = true;
         }
-        ram->write16(addrOffset, buffer, AUDIO_BLOCK_SAMPLES);
 
+        i += count;
+        pos += count;
+        if (pos >= length) pos = 0;
+      }
+    }
+  }
+
+  // Audio Interrupt Callback (phase 2)
+  // Runs after the scheduler has executed the reads queued in schedule().
+  // Adds this track's output into the looper's 32-bit mix bus, unsaturated.
+  void update(audio_block_t* inBlock, int32_t* mixBus, TransferScheduler& xfer) {
+    // --- Safety Checks ---
+    // Mix bus should already be zeroed coming in!!
+    if (!inBlock || !mixBus) return;
+
+    switch (state) {
+      case RECORD:
+        recordBlock(inBlock->data, AUDIO_BLOCK_SAMPLES, timeline, xfer);
         timeline++;
         break;
-      }
 
       case OVERDUB:
       case PLAY: {
-        size_t addrOffset = address + BLOCKS_TO_ADDR(playhead);
-        size_t xfadeOffset = address + BLOCKS_TO_ADDR(timeline + playhead);
-        int16_t playBuffer[AUDIO_BLOCK_SAMPLES];
-        int16_t xfadeBuffer[AUDIO_BLOCK_SAMPLES];
-        int16_t overdubBuffer[AUDIO_BLOCK_SAMPLES];
-        
-        bool recordXfade = xfadeBlockCount < FADE_DURATION_BLOCKS;
-        bool processXfade = !recordXfade && playhead < FADE_DURATION_BLOCKS;
-
-        if (playhead == 0) {
-          gc_xfade.hardReset(1.0f);
-          gc_xfade.fadeOut();
+        // Stop block: the samples before the stop point still close the recording
+        if (recordTo > 0) {
+          recordBlock(inBlock->data, recordTo, stopBlock, xfer);
+          gc_record.hardReset(0.0f);
         }
 
-        // 1. Bulk Read Main Audio into local buffer
-        ram->read16(addrOffset, playBuffer, AUDIO_BLOCK_SAMPLES);
-
         if (recordXfade) {
-          ram->write16(xfadeOffset, inBlock->data, AUDIO_BLOCK_SAMPLES);
-        } else if (processXfade) {
-          ram->read16(xfadeOffset, xfadeBuffer, AUDIO_BLOCK_SAMPLES);
+          StorageCodec::encode(inBlock->data, requestStoredWrite(xfer, tailBlock(timeline + xfadeBlockCount)));
         }
 
-        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        // Nothing to hear: the loop moves on unread, so an unmute lands in phase
+        if (silent) {
+          if (recordXfade) xfadeBlockCount++;
+          playhead = (playhead + AUDIO_BLOCK_SAMPLES) % length;
+          break;
+        }
+
+        // Loop and tail samples of this block, from the pieces staged by schedule()
+        int16_t play[AUDIO_BLOCK_SAMPLES];
+        int16_t xfade[AUDIO_BLOCK_SAMPLES];
+        int16_t scratch[MAX_PIECES][AUDIO_BLOCK_SAMPLES];
+        assemblePieces(playPieces, numPlayPieces, play, scratch);
+        if (processXfade) {
+          memset(xfade, 0, sizeof(xfade));
+          assemblePieces(tailPieces, numTailPieces, xfade, &scratch[numPlayPieces]);
+        }
+
+        // Gain curves for the whole block, computed once
+        int32_t volGains[AUDIO_BLOCK_SAMPLES];
+        int32_t recGains[AUDIO_BLOCK_SAMPLES];
+        int32_t xfadeGains[AUDIO_BLOCK_SAMPLES];
+        int volMask = gc_volume.fillBlock(volGains) ? 0 : ~0;
+        int recMask = 0;
+        int xfadeMask = 0;
+        if (state == OVERDUB) recMask = gc_record.fillBlock(recGains) ? 0 : ~0;
+        if (processXfade) xfadeMask = gc_xfade.fillBlock(xfadeGains) ? 0 : ~0;
+        const int32_t feedback = GAIN_TO_Q16(FEEDBACK_MULTIPLIER);
+
+        // Punch-in point: samples before it keep what was stored
+        int16_t overdub[AUDIO_BLOCK_SAMPLES];
+        if (state == OVERDUB) memcpy(overdub, play, sizeof(int16_t) * overdubFrom);
+
+        for (int i = playFrom; i < AUDIO_BLOCK_SAMPLES; i++) {
           int32_t s_in = inBlock->data[i];
-          int32_t s_out = playBuffer[i];
+          int32_t s_out = play[i];
 
-          // If processXfade add xfadeBuffer to s_out
-          if (processXfade) s_out += (int32_t)(xfadeBuffer[i] * gc_xfade.get(i));
+          // If processXfade add xfade to s_out
+          if (processXfade) s_out += gainApply16(xfadeGains[i & xfadeMask], xfade[i]);
 
-          if (state == OVERDUB) {
-            int32_t s_rec = (int32_t)(s_in * gc_record.get(i));
+          if (state == OVERDUB && i >= overdubFrom) {
+            int32_t s_rec = gainApply16(recGains[i & recMask], s_in);
             s_rec += s_out;
-            s_rec *= FEEDBACK_MULTIPLIER;
-            overdubBuffer[i] = (int16_t)s_rec;
+            overdub[i] = saturate16(gainApply32(feedback, s_rec));
           }
 
-          s_out *= gc_volume.get(i);
-          s_out = SAMPLE_LIMITER(s_out);
-          
-          // SUM into output block instead of assigning
-          int32_t finalOut = outBlock->data[i] + s_out;
-          outBlock->data[i] = (int16_t)SAMPLE_LIMITER(finalOut);
+          // SUM into the mix bus, AudioLooper saturates once after all tracks
+          mixBus[i] += gainApply32(volGains[i & volMask], s_out);
         }
 
-        if (state == OVERDUB) {
-          ram->write16(addrOffset, overdubBuffer, AUDIO_BLOCK_SAMPLES);
+        // The SD stream is append-only, overdub only lands on the RAM part
+        if (state == OVERDUB) writeBackPieces(overdub, xfer);
+        if (bounceTo > bounceFrom) writeBouncePieces(mixBus, xfer);
+        if (bounceHandover) {
+          // The lap is stored: from here on the loop already holds the mix and plays it alone
+          for (int i = bounceTo; i < AUDIO_BLOCK_SAMPLES; i++) mixBus[i] = play[i];
         }
 
         if (recordXfade) xfadeBlockCount++;
-        playhead++;
-        if (playhead >= timeline) playhead = 0;
+        playhead = (playhead + AUDIO_BLOCK_SAMPLES) % length;
         break;
       }
 
       case STOP:
+        if (spilled && playhead != 0) spillRestartPending = true;
         playhead = 0;
+        spillWindowTag[0] = PREFETCH_EMPTY;
+        spillWindowTag[1] = PREFETCH_EMPTY;
         break;
 
       default:
@@ -122,13 +215,88 @@ public:
     gc_xfade.update();
   }
 
-  void record() { reqState = RECORD; }
-  void play() { reqState = PLAY; }
-  void overdub() { reqState = OVERDUB; }
-  void stop() { reqState = STOP; }
+  // Main Loop: load the next blocks after the playhead into the read-ahead ring.
+  // Each fill runs with the audio ISR held off, so a slot is never seen half
+  // written and a track reset by the ISR mid-pass never gets a stale tag.
+  void prefetch() {
+    if (state != PLAY && state != OVERDUB) return;
+    // A silent track reads nothing, an unmute takes its first blocks straight from SPI
+    if (isSilent()) return;
+
+    uint32_t generation = prefetchGeneration;
+    size_t blocks = timeline;
+    size_t hot = hotBlocks();
+    size_t head = (startOffset + playhead) / AUDIO_BLOCK_SAMPLES;
+    if (blocks < 2) return;
+    if (head >= blocks) head = 0;
+
+    // Stay one slot short of a full lap so we never refill the slot being played
+    size_t depth = PREFETCH_BLOCKS - 1;
+    if (depth > blocks - 1) depth = blocks - 1;
+
+    for (size_t n = 1; n <= depth; n++) {
+      size_t block = head + n;
+      if (block >= blocks) block -= blocks;
+
+      // Spilled blocks come from the SD stream, not SPI pages
+      if (block >= hot || block >= restoredBlocks) continue;
+
+      size_t slot = block % PREFETCH_BLOCKS;
+      if (prefetchTag[slot] == block) continue;
+
+      int16_t stored[STORAGE_BLOCK_WORDS];
+      bool valid;
+      {
+        Hal::AudioIrqGuard guard;
+        valid = generation == prefetchGeneration;
+        if (valid) {
+          if (StorageCodec::IS_RAW) {
+            ram->read16(blockAddress(block), prefetchData[slot], AUDIO_BLOCK_SAMPLES);
+          } else {
+            // Decode outside the ISR so the play path stays a plain pointer
+            ram->read16(blockAddress(block), stored, STORAGE_BLOCK_WORDS);
+            StorageCodec::decode(stored, prefetchData[slot]);
+          }
+          prefetchTag[slot] = block;
+        }
+      }
+
+      if (!valid) return;
+    }
+  }
+
+  uint32_t getPrefetchMisses() { return prefetchMisses; }
 
-  void trimLength(size_t n_actualBlockLength) {
-    actualBlockLength = n_actualBlockLength;
+  // Main Loop: SD maintenance for the spilled part of the loop.
+  // Requests raised in the ISR are serviced here, SD never runs in the ISR.
+  void updateSpill() {
+    if (!spill) return;
+
+    if (spillClearPending) {
+      spillClearPending = false;
+      spill->clearLoop();
+    }
+    if (spillRestartPending) {
+      spillRestartPending = false;
+      spill->restartPlayback();
+    }
+
+    spill->update();
+  }
+
+  // Spilled blocks that could not be queued to, or read back from, SD in time
+  uint32_t getSpillUnderruns() { return spillUnderruns; }
+  bool isSpilled() { return spilled; }
+
+  // State requests take effect `offset` samples into the next block
+  void record(int offset = 0) { request(RECORD, offset); }
+  void play(int offset = 0) { request(PLAY, offset); }
+  void overdub(int offset = 0) { request(OVERDUB, offset); }
+  void stop(int offset = 0) { request(STOP, offset); }
+
+  // Cuts the loop to `samples` when recording stops
+  void trimLength(size_t samples) {
+    actualLength = samples;
     trim = true;
   }
 
@@ -147,6 +315,13 @@ public:
     return muteState && gc_volume.isMuteDone();
   }
 
+  // Playing at zero gain with the fade done, so schedule() queues no reads
+  // and update() mixes nothing. A spilled loop still streams its SD blocks,
+  // which come in order once per lap, and a collapse target still stores.
+  bool isSilent() {
+    return state == PLAY && gc_volume.isMuteDone() && !spilled && !bouncing;
+  }
+
   bool isStopped() {
     return state == STOP;
   }
@@ -163,30 +338,20 @@ public:
     gc_volume.setGain(n_volume);
   }
 
-  // NOTE: This function modifies shared static memory counters.
+  // NOTE: This function returns pages to the shared PageAllocator.
   // The user MUST include an AudioNoInterrupt wrapper around this function
   // (or the caller) to prevent race conditions with the audio update interrupt.
   void clear() {
-    // STRICT LIFO CHECK
-    // Only clear if this is the most recently allocated track
-    if (allocationId != activeAllocationCount) {
-      LOG("##> 1. Cant Clear Track! %d", allocationId);
-      return;
-    }
-
     if (!isStopped() && !isMuted() && !isNone()) {
-      LOG("##> 2. Cant Clear Track! %d", allocationId);
+      LOG_DEFER("##> Cant Clear Track! State: %d", state);
       return;
     }
 
-    // Reclaim memory
-    if (activeAllocationCount > 0) activeAllocationCount--;
-    allocationId = 0;
-
-    if (address > 0) {
-      nextAvailableAddress = address;
-      address = 0;
-    }
+    // Reclaim memory, any order is fine
+    history.clear(pager);
+    releasePagesFrom(0);
+    if (spilled) spillClearPending = true;
+    spilled = false;
 
     hardReset();
   }
@@ -195,7 +360,6 @@ public:
   // MUST be called within AudioNoInterrupt() context.
   void forceClear() {
     state = NONE;
-    lock_nextAvailableAddress = false;
     clear();
   }
 
@@ -207,72 +371,632 @@ public:
     return xfadeBlockCount >= FADE_DURATION_BLOCKS;
   }
 
-  size_t getTimelineLength() { return timeline; }
+  // Loop length in samples, 0 until recording stops
+  size_t getLength() { return length; }
+  // Loop position of the first sample of the block being processed
+  size_t getPlayhead() { return playhead; }
+
+  // --- Session save and restore (see SessionStore) ---
+
+  size_t getStartOffset() { return startOffset; }
+  float getVolume() { return gc_volume.getGain(); }
+  // Stored blocks of a closed loop, its crossfade tail included
+  size_t getStoredBlocks() { return length > 0 ? timeline + FADE_DURATION_BLOCKS : 0; }
+  // New on every reset and collapse, unique across tracks. Copies check it,
+  // so a track cleared or rewritten meanwhile is left alone.
+  uint32_t getGeneration() { return prefetchGeneration; }
+
+  // Main Loop, with the audio ISR held off: turns a cleared track into a
+  // stopped loop whose stored blocks arrive later through writeStored().
+  // Blocks not written yet play as silence. Returns false when SPI RAM is full.
+  bool beginRestore(size_t n_startOffset, size_t n_length, float volume, bool muted) {
+    if (state != NONE || n_length < MIN_LOOP_SAMPLES || n_startOffset >= AUDIO_BLOCK_SAMPLES) return false;
+    hardReset();
+
+    size_t blocks = (n_startOffset + n_length + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES;
+    if (!reserveBlocks(blocks + 1 + FADE_DURATION_BLOCKS)) {
+      releasePagesFrom(0);
+      hardReset();
+      return false;
+    }
+
+    startOffset = n_startOffset;
+    length = n_length;
+    timeline = blocks;
+    stopBlock = blocks;
+    xfadeBlockCount = FADE_DURATION_BLOCKS;
+    restoredBlocks = 0;
+
+    // Silent until play() fades it in, unless it was saved muted
+    gc_volume.hardReset(0.0f);
+    gc_volume.setGain(volume);
+    muteState = muted;
+    state = STOP;
+    return true;
+  }
+
+  // Main Loop: copies stored blocks [first, first + count) between SPI RAM and
+  // `data` in short bursts, each with the audio ISR held off. Returns false,
+  // without touching the pages, once the track was reset after `generation`.
+  bool readStored(uint32_t generation, size_t first, size_t count, int16_t* data) {
+    return copyStored(generation, first, count, data, false);
+  }
+
+  // Writing in order past the restored blocks makes them playable
+  bool writeStored(uint32_t generation, size_t first, size_t count, const int16_t* data) {
+    return copyStored(generation, first, count, (int16_t*)data, true);
+  }
+
+  bool isRestoring() { return restoredBlocks < getStoredBlocks(); }
+
+  // Main Loop: every block was written through writeStored(), in any order
+  void finishRestore(uint32_t generation) {
+    Hal::AudioIrqGuard guard;
+    if (generation == prefetchGeneration) restoredBlocks = RESTORE_NONE;
+  }
+
+  // --- Autosave journal (see SessionJournal) ---
+
+  // Main Loop: flags every stored block, so the journal takes the whole loop
+  void markStoredDirty(uint32_t generation) {
+    for (size_t block = 0;; block++) {
+      Hal::AudioIrqGuard guard;
+      if (generation != prefetchGeneration || block >= getStoredBlocks()) return;
+      pager->markDirty(pageTable[block / PAGE_BLOCKS], block % PAGE_BLOCKS);
+    }
+  }
+
+  // Main Loop: copies out up to `max` blocks written since they were last
+  // taken, scanning from `cursor` on, and clears their flags. `indices` gets
+  // their block numbers, `data` the stored words. Returns how many were
+  // taken; `cursor` ends past the last block scanned, at getStoredBlocks()
+  // once the scan is through. Takes the audio ISR off for a few blocks at a
+  // time, so a block never changes between the copy and the clear.
+  size_t takeDirtyBlocks(uint32_t generation, size_t& cursor, size_t max, uint32_t* indices, int16_t* data) {
+    size_t taken = 0;
+    while (taken < max) {
+      Hal::AudioIrqGuard guard;
+      size_t end = getStoredBlocks();
+      if (generation != prefetchGeneration || cursor >= end) break;
+
+      size_t pageEnd = (cursor / PAGE_BLOCKS + 1) * PAGE_BLOCKS;
+      if (pageEnd > end) pageEnd = end;
+      uint16_t page = pageTable[cursor / PAGE_BLOCKS];
+      if (!pager->hasDirty(page)) {
+        cursor = pageEnd;
+        continue;
+      }
+      size_t burst = 0;
+      for (; cursor < pageEnd && taken < max && burst < MemoryRam::MAX_BURST_BLOCKS; cursor++) {
+        if (!pager->takeDirty(page, cursor % PAGE_BLOCKS)) continue;
+        ram->read16(blockAddress(cursor), data + BLOCKS_TO_ADDR(taken), STORAGE_BLOCK_WORDS);
+        indices[taken++] = (uint32_t)cursor;
+        burst++;
+      }
+    }
+    return taken;
+  }
+
+  // Blocks played as silence because the restore had not reached them yet
+  uint32_t getRestoreUnderruns() { return restoreUnderruns; }
+
+  // --- Overdub undo (see OverdubMap) ---
+
+  // Audio ISR: takes back the last overdub pass, or puts the last one taken
+  // back. Not while a pass is running. Effective from the next block.
+  bool undo() {
+    if (state == OVERDUB || !history.undo(pager, pageTable)) return false;
+    dropPrefetch();
+    return true;
+  }
+
+  bool redo() {
+    if (state == OVERDUB || !history.redo(pager, pageTable)) return false;
+    dropPrefetch();
+    return true;
+  }
+
+  bool canUndo() { return state != OVERDUB && history.canUndo(); }
+  bool canRedo() { return state != OVERDUB && history.canRedo(); }
+
+  // Main Loop: copies the passes that can no longer be undone into the
+  // loop's own pages and frees their copies, a few blocks per audio ISR hold-off
+  void updateOverdub() {
+    for (size_t burst = 0; burst < PAGE_BLOCKS / MemoryRam::MAX_BURST_BLOCKS; burst++) {
+      Hal::AudioIrqGuard guard;
+      uint8_t v = history.nextFold();
+      if (v == OverdubMap::NONE) return;
+
+      const OverdubMap::Version& version = history.getVersion(v);
+      size_t first = (size_t)version.logical * PAGE_BLOCKS;
+      size_t base = PageAllocator::pageAddress(pageTable[version.logical]);
+      for (size_t n = 0; n < MemoryRam::MAX_BURST_BLOCKS; n++) {
+        uint64_t mask = version.mask;
+        int offset = 0;
+        while (!(mask & 1)) {
+          mask >>= 1;
+          offset++;
+        }
+        int16_t stored[STORAGE_BLOCK_WORDS];
+        ram->read16(PageAllocator::pageAddress(version.page) + BLOCKS_TO_ADDR(offset), stored, STORAGE_BLOCK_WORDS);
+        ram->write16(base + BLOCKS_TO_ADDR(offset), stored, STORAGE_BLOCK_WORDS);
+        bool last = version.mask == (1ull << offset);
+        history.folded(v, first + offset, pager);
+        if (last) break;
+      }
+    }
+  }
+
+  // --- Collapse (see AudioLooper::collapse()) ---
+
+  // Could be mixed into a collapse of loops `loopLength` samples long
+  bool canBounce(size_t loopLength) {
+    return (state == PLAY || state == STOP) && length == loopLength && !spilled && !isRestoring() &&
+           isXfadeComplete() && !bouncing;
+  }
+
+  // Audio ISR, on a loop start: this track becomes the collapse target. It
+  // must be playing and a block longer than the shortest loop, so a block
+  // written with the crossfade tail is never one the loop start plays.
+  bool beginBounce() {
+    if (state != PLAY || !canBounce(length) || length < MIN_LOOP_SAMPLES + AUDIO_BLOCK_SAMPLES) return false;
+    // The mix lands on the blocks as they sound now, undo stops here
+    history.keepApplied(pager);
+    prefetchGeneration = ++generations;
+    bouncing = true;
+    return true;
+  }
+
+  // Audio ISR, before update(): output samples [from, to) of this block go
+  // to the loop as the bus they are mixed into holds them. On the last block
+  // (`handover`) the samples from `to` on take the stored mix instead of
+  // the bus, as the sources stop there.
+  void setBounceWindow(int from, int to, bool handover) {
+    bounceFrom = from;
+    bounceTo = to;
+    bounceHandover = handover;
+  }
+
+  // Audio ISR, after the lap: the loop now holds the mix at unity gain
+  void endBounce() {
+    bounceFrom = 0;
+    bounceTo = 0;
+    bounceHandover = false;
+    bouncing = false;
+    gc_volume.hardReset(1.0f);
+    muteState = false;
+    prefetchGeneration = ++generations;
+  }
+
+  bool isBouncing() { return bouncing; }
+
+  // SPI RAM pages holding overdub copies, and overdubbed blocks lost for want of one
+  int getOverdubPages() { return history.getPages(); }
+  uint32_t getOverdubDrops() { return history.getDrops(); }
 
 private:
-  static inline size_t nextAvailableAddress = 1; // should be 1, leave 0 empty
-  static inline bool lock_nextAvailableAddress = false;
-  static inline int activeAllocationCount = 0;
+  static const size_t PREFETCH_EMPTY = (size_t)-1;
+  static const size_t RESTORE_NONE = (size_t)-1; // every block is valid
+  static inline const int16_t SILENCE[AUDIO_BLOCK_SAMPLES] = {};
+  // Two stretches of up to two stored blocks for the loop, two for the tail
+  static const int MAX_PIECES = 6;
+
+  // One stretch of the output block, copied out of one stored block
+  struct Piece {
+    const int16_t* data; // the whole stored block, PCM once isPcm is set
+    size_t block;        // stored block index
+    bool isPcm;
+    bool hot;            // lives in SPI RAM pages, overdub can write it back
+    uint8_t from;        // first sample used inside the stored block
+    uint8_t to;          // where that sample goes in the output block
+    uint8_t count;
+  };
 
   Ram* ram;
-  int allocationId;
+  PageAllocator* pager;
   volatile State state, nextState, reqState;
+  volatile int reqOffset;
   GainControl gc_volume, gc_record, gc_xfade;
 
-  size_t address; // start pos in ram
-  size_t playhead;  // pos on timeline in audio blocks
-  size_t timeline;  // length of playable loop in audio blocks
-  uint16_t xfadeBlockCount;  // block pos for crossfade samples
-  size_t actualBlockLength;
+  uint16_t pageTable[TOTAL_PAGES]; // logical page -> physical page
+  size_t numPages;                 // pages currently owned
+  OverdubMap history;              // overdub passes, on top of pageTable
+
+  // SD spill: blocks [0, spillStart) live in SPI RAM, the rest in `spill`.
+  // The crossfade tail sits right after the RAM part, behind a RAM copy of
+  // the block the loop ends in (see tailAddress()).
+  MemorySd* spill;
+  volatile bool spilled;
+  size_t spillStart;
+  volatile bool spillClearPending;
+  volatile bool spillRestartPending;
+  volatile uint32_t spillUnderruns;
+  // Last two blocks taken from the SD stream, a block can feed two outputs
+  int16_t spillWindow[2][AUDIO_BLOCK_SAMPLES];
+  size_t spillWindowTag[2];
+
+  size_t startOffset; // sample of stored block 0 the loop starts at
+  size_t length;      // loop length in samples, 0 while recording
+  size_t timeline;    // stored blocks of the loop (blocks recorded so far while recording)
+  size_t playhead;    // loop position of the first sample of the current block
+  size_t stopBlock;   // stored block the recording stopped in
+  uint16_t xfadeBlockCount;  // tail blocks recorded after the loop blocks
+  bool recordXfade, processXfade;
+  bool silent; // this block, see isSilent()
+
+  // Where this block switches state, set by updateState()
+  int playFrom;    // first sample that plays
+  int recordTo;    // samples that still record after a stop inside the block
+  int overdubFrom; // punch-in point
+
+  Piece playPieces[MAX_PIECES - 2];
+  Piece tailPieces[2];
+  int numPlayPieces, numTailPieces;
+
+  // Read-ahead ring filled by prefetch() from loop()
+  int16_t prefetchData[PREFETCH_BLOCKS][AUDIO_BLOCK_SAMPLES];
+  volatile size_t prefetchTag[PREFETCH_BLOCKS]; // block held by each slot
+  volatile uint32_t prefetchMisses;
+  volatile uint32_t prefetchGeneration; // new on every reset, see getGeneration()
+  static inline uint32_t generations = 0;
+  volatile size_t restoredBlocks;       // stored blocks loaded by a session restore
+  volatile uint32_t restoreUnderruns;
+  size_t actualLength;
   volatile bool trim;
   volatile bool muteState;
+  bool bouncing;            // collapse target, see beginBounce()
+  int bounceFrom, bounceTo; // output samples of this block that go to the loop
+  bool bounceHandover;
 
-  void hardReset() {
-    // allocationId = 0; // only reset from clear()
+  void request(State n_state, int offset) {
+    reqOffset = offset;
+    reqState = n_state;
+  }
 
+  void hardReset() {
     state = NONE;
     nextState = NONE;
     reqState = NONE;
+    reqOffset = 0;
 
     gc_volume.hardReset(1.0f);
     // Set user gain to 1.0 so fadeIn() has a target, while keeping current state at 0.0
-    gc_record.hardReset(0.0f); gc_record.setGain(1.0f); 
+    gc_record.hardReset(0.0f); gc_record.setGain(1.0f);
     gc_xfade.hardReset(1.0f);
 
-    // address = 0; // only reset from clear()
+    // pages are only released from clear()
+    startOffset = 0;
+    length = 0;
     playhead = 0;
     timeline = 0;
+    stopBlock = 0;
     xfadeBlockCount = 0;
-    actualBlockLength = 0;
+    recordXfade = false;
+    processXfade = false;
+    playFrom = 0;
+    recordTo = 0;
+    overdubFrom = 0;
+    numPlayPieces = 0;
+    numTailPieces = 0;
+    spillWindowTag[0] = PREFETCH_EMPTY;
+    spillWindowTag[1] = PREFETCH_EMPTY;
+    dropPrefetch();
+    prefetchGeneration = ++generations;
+    restoredBlocks = RESTORE_NONE;
+    actualLength = 0;
     trim = false;
     muteState = false;
+    bouncing = false;
+    bounceFrom = 0;
+    bounceTo = 0;
+    bounceHandover = false;
+    silent = false;
+  }
+
+  // Read-ahead blocks are stale once the blocks behind them change
+  void dropPrefetch() {
+    for (int i = 0; i < PREFETCH_BLOCKS; i++) prefetchTag[i] = PREFETCH_EMPTY;
+  }
+
+  // Records one input block into stored block `block`. Samples from `loopSamples`
+  // on come after the stop point: they start the crossfade tail and stay raw.
+  void recordBlock(const int16_t* in, int loopSamples, size_t block, TransferScheduler& xfer) {
+    // Spilled recordings go to the SD input ring as raw PCM
+    bool toSd = spilled && block >= spillStart;
+    int16_t pcm[AUDIO_BLOCK_SAMPLES];
+    int16_t* stored = nullptr;
+    int16_t* buffer = pcm;
+    if (!toSd) {
+      stored = requestStoredWrite(xfer, tailBlock(block));
+      buffer = encodeTarget(stored, pcm);
+    }
+
+    // Debug: Log start of recording
+    if (block == 0) {
+      LOG_DEFER("Track::update() -> Recording started at RAM Addr: %d, sample %d", toSd ? 0 : tailAddress(block),
+                startOffset);
+    }
+
+    int32_t recGains[AUDIO_BLOCK_SAMPLES];
+    // Constant-gain blocks only fill index 0, mask reads back to it
+    int recMask = gc_record.fillBlock(recGains) ? 0 : ~0;
+
+    for (int i = 0; i < loopSamples; i++) {
+      buffer[i] = saturate16(gainApply16(recGains[i & recMask], in[i]));
+    }
+    for (int i = loopSamples; i < AUDIO_BLOCK_SAMPLES; i++) {
+      buffer[i] = in[i];
+    }
+
+    if (!toSd) {
+      commitEncoded(buffer, stored);
+    } else {
+      if (!spill->writeSample(buffer)) {
+        spillUnderruns++; // SD fell behind, the block plays back as silence
+      }
+      // The crossfade tail reads the end of the stop block back from SPI RAM
+      if (loopSamples < AUDIO_BLOCK_SAMPLES) {
+        StorageCodec::encode(buffer, requestStoredWrite(xfer, spillStart));
+      }
+    }
+  }
+
+  // Queues the stored samples [storagePos, storagePos + count) for output
+  // samples starting at `to`, one piece per stored block touched
+  void stagePieces(TransferScheduler& xfer, size_t storagePos, int count, int to, bool tail) {
+    while (count > 0) {
+      size_t block = storagePos / AUDIO_BLOCK_SAMPLES;
+      int from = (int)(storagePos % AUDIO_BLOCK_SAMPLES);
+      int n = AUDIO_BLOCK_SAMPLES - from;
+      if (n > count) n = count;
+
+      Piece& piece = tail ? tailPieces[numTailPieces++] : playPieces[numPlayPieces++];
+      piece.block = block;
+      piece.from = (uint8_t)from;
+      piece.to = (uint8_t)to;
+      piece.count = (uint8_t)n;
+
+      if (block >= restoredBlocks) {
+        // Not restored yet. The tail of the lap before a restored loop starts is silent anyway.
+        piece.data = SILENCE;
+        piece.isPcm = true;
+        piece.hot = false;
+        if (!tail) restoreUnderruns++;
+      } else if (tail) {
+        // Tail reads are rare (the first blocks of a lap), always straight from SPI
+        piece.data = xfer.requestRead(tailAddress(block), STORAGE_BLOCK_WORDS);
+        piece.isPcm = false;
+        piece.hot = false;
+      } else if (block >= hotBlocks()) {
+        // Cold part of a spilled loop, streamed back in order from SD
+        piece.data = spillBlock(block);
+        piece.isPcm = true;
+        piece.hot = false;
+      } else {
+        size_t slot = block % PREFETCH_BLOCKS;
+        piece.hot = true;
+        if (prefetchTag[slot] == block) {
+          // Serve the play block from the read-ahead ring
+          piece.data = prefetchData[slot];
+          piece.isPcm = true;
+        } else {
+          // Miss: fall back to a direct SPI read
+          piece.data = xfer.requestRead(blockAddress(block), STORAGE_BLOCK_WORDS);
+          piece.isPcm = false;
+          prefetchMisses++;
+        }
+      }
+
+      storagePos += n;
+      to += n;
+      count -= n;
+    }
+  }
+
+  // Next spilled block from the SD stream. Each is popped once per lap; one
+  // that misses its slot is skipped when it arrives, the stream keeps its place.
+  const int16_t* spillBlock(size_t block) {
+    int16_t* window = spillWindow[block & 1];
+    if (spillWindowTag[block & 1] != block) {
+      if (!spill || !spill->readSample(window)) {
+        memset(window, 0, sizeof(spillWindow[0]));
+        spillUnderruns++;
+      }
+      spillWindowTag[block & 1] = block;
+    }
+    return window;
+  }
+
+  // Decodes every piece once and copies its stretch into `out`
+  static void assemblePieces(Piece* pieces, int count, int16_t* out, int16_t (*scratch)[AUDIO_BLOCK_SAMPLES]) {
+    for (int k = 0; k < count; k++) {
+      Piece& piece = pieces[k];
+      if (!piece.isPcm) {
+        piece.data = decoded(piece.data, scratch[k]);
+        piece.isPcm = true;
+      }
+      memcpy(&out[piece.to], &piece.data[piece.from], sizeof(int16_t) * piece.count);
+    }
   }
 
-  bool isRamOutOfBounds(uint32_t extraBlocks) {
-    size_t end_pos_words = address + BLOCKS_TO_ADDR(timeline + extraBlocks);
-    return end_pos_words >= TOTAL_SRAM_SAMPLES;
+  // Stores the overdubbed stretches. Each touched block is written whole, so
+  // the part of it outside this output block is carried over unchanged, to
+  // the pass's copy of the block.
+  void writeBackPieces(const int16_t* overdub, TransferScheduler& xfer) {
+    for (int k = 0; k < numPlayPieces; k++) {
+      const Piece& piece = playPieces[k];
+      if (!piece.hot) continue;
+
+      int16_t pcm[AUDIO_BLOCK_SAMPLES];
+      int16_t* stored = requestOverdubWrite(xfer, piece.block);
+      if (!stored) continue; // no room for a copy, the block stays as it was
+      int16_t* buffer = encodeTarget(stored, pcm);
+      memcpy(buffer, piece.data, sizeof(pcm));
+      memcpy(&buffer[piece.from], &overdub[piece.to], sizeof(int16_t) * piece.count);
+
+      // Keep a prefetched copy in step, the next output block may read it again
+      size_t slot = piece.block % PREFETCH_BLOCKS;
+      if (prefetchTag[slot] == piece.block) memcpy(prefetchData[slot], buffer, sizeof(pcm));
+
+      commitEncoded(buffer, stored);
+    }
+  }
+
+  // Collapse: stores the mix on `bus` over output samples [bounceFrom,
+  // bounceTo), carrying the rest of each touched block over. The crossfade
+  // tail is already in the mix, so it is silenced as it is played.
+  void writeBouncePieces(const int32_t* bus, TransferScheduler& xfer) {
+    for (int k = 0; k < numPlayPieces + numTailPieces; k++) {
+      bool tail = k >= numPlayPieces;
+      const Piece& piece = tail ? tailPieces[k - numPlayPieces] : playPieces[k];
+      int first = piece.to > bounceFrom ? piece.to : bounceFrom;
+      int end = piece.to + piece.count < bounceTo ? piece.to + piece.count : bounceTo;
+      if (first >= end || (!tail && !piece.hot) || (tail && !processXfade)) continue;
+
+      int16_t pcm[AUDIO_BLOCK_SAMPLES];
+      int16_t* stored = requestStoredWrite(xfer, tail ? tailBlock(piece.block) : piece.block);
+      int16_t* buffer = encodeTarget(stored, pcm);
+      memcpy(buffer, piece.data, sizeof(pcm));
+      for (int i = first; i < end; i++) {
+        buffer[piece.from + i - piece.to] = tail ? 0 : saturate16(bus[i]);
+      }
+
+      size_t slot = piece.block % PREFETCH_BLOCKS;
+      if (prefetchTag[slot] == piece.block) memcpy(prefetchData[slot], buffer, sizeof(pcm));
+
+      commitEncoded(buffer, stored);
+    }
+  }
+
+  // PCM view of a stored block: the stored block itself for raw PCM storage
+  static const int16_t* decoded(const int16_t* stored, int16_t* scratch) {
+    if (StorageCodec::IS_RAW) return stored;
+    StorageCodec::decode(stored, scratch);
+    return scratch;
+  }
+
+  // Where to build PCM that commitEncoded() will turn into `stored`
+  static int16_t* encodeTarget(int16_t* stored, int16_t* scratch) {
+    return StorageCodec::IS_RAW ? stored : scratch;
+  }
+
+  static void commitEncoded(const int16_t* pcm, int16_t* stored) {
+    if (pcm != stored) StorageCodec::encode(pcm, stored);
+  }
+
+  bool copyStored(uint32_t generation, size_t first, size_t count, int16_t* data, bool write) {
+    while (count > 0) {
+      // Consecutive blocks inside one page are adjacent in SPI RAM, unless
+      // overdub copies hold some of them
+      size_t most = PAGE_BLOCKS - first % PAGE_BLOCKS;
+      if (most > count) most = count;
+      if (most > MemoryRam::MAX_BURST_BLOCKS) most = MemoryRam::MAX_BURST_BLOCKS;
+      size_t run = 1;
+      {
+        Hal::AudioIrqGuard guard;
+        if (generation != prefetchGeneration || first + most > getStoredBlocks()) return false;
+        size_t address = blockAddress(first);
+        while (run < most && blockAddress(first + run) == address + BLOCKS_TO_ADDR(run)) run++;
+        if (write) {
+          ram->write16(address, data, BLOCKS_TO_ADDR(run));
+          if (restoredBlocks == first) restoredBlocks = first + run;
+        } else {
+          ram->read16(address, data, BLOCKS_TO_ADDR(run));
+        }
+      }
+      first += run;
+      count -= run;
+      data += BLOCKS_TO_ADDR(run);
+    }
+    return true;
+  }
+
+  // Logical stored block -> SPI RAM word address, through the newest applied
+  // overdub pass that holds it. O(1) for a page no pass touched, ISR safe.
+  size_t blockAddress(size_t block) {
+    uint16_t page = history.find(block);
+    if (page == PageAllocator::NO_PAGE) page = pageTable[block / PAGE_BLOCKS];
+    return PageAllocator::pageAddress(page) + BLOCKS_TO_ADDR(block % PAGE_BLOCKS);
+  }
+
+  // Address of a stored block from the last loop block on. A spilled loop
+  // keeps that block's copy at spillStart and the tail right after it.
+  size_t tailAddress(size_t block) {
+    return blockAddress(tailBlock(block));
+  }
+
+  // The page-backed block tailAddress() resolves to
+  size_t tailBlock(size_t block) {
+    if (!spilled || block < spillStart) return block;
+    return spillStart + 1 + block - timeline;
+  }
+
+  // Queues a write of a whole page-backed block and flags it for the autosave journal
+  int16_t* requestStoredWrite(TransferScheduler& xfer, size_t block) {
+    pager->markDirty(pageTable[block / PAGE_BLOCKS], block % PAGE_BLOCKS);
+    return xfer.requestWrite(blockAddress(block), STORAGE_BLOCK_WORDS);
+  }
+
+  // Queues the write of an overdubbed block to the open pass's copy of it.
+  // Returns nullptr when no copy can be made.
+  int16_t* requestOverdubWrite(TransferScheduler& xfer, size_t block) {
+    uint16_t page = history.writePage(block, pager);
+    if (page == PageAllocator::NO_PAGE) return nullptr;
+    pager->markDirty(pageTable[block / PAGE_BLOCKS], block % PAGE_BLOCKS);
+    return xfer.requestWrite(PageAllocator::pageAddress(page) + BLOCKS_TO_ADDR(block % PAGE_BLOCKS), STORAGE_BLOCK_WORDS);
+  }
+
+  // Blocks of the loop that are backed by SPI RAM pages
+  size_t hotBlocks() {
+    return spilled ? spillStart : timeline;
+  }
+
+  bool canSpill() {
+    return spill && !spillClearPending && !spill->isClearing();
+  }
+
+  // Makes sure pages cover stored blocks [0, blocks).
+  // Returns false when SPI RAM is full.
+  bool reserveBlocks(size_t blocks) {
+    while (numPages * PAGE_BLOCKS < blocks) {
+      if (numPages >= TOTAL_PAGES) return false;
+      uint16_t page = pager->allocate();
+      if (page == PageAllocator::NO_PAGE) return false;
+      pageTable[numPages++] = page;
+    }
+    return true;
+  }
+
+  void releasePagesFrom(size_t keepPages) {
+    while (numPages > keepPages) {
+      pager->release(pageTable[--numPages]);
+    }
   }
 
   void updateState() {
+    int offset = reqOffset;
+    playFrom = 0;
+    recordTo = 0;
+    overdubFrom = 0;
+
     switch (state) {
       case NONE:
         if (reqState == RECORD) {
           hardReset();
 
-          if (!address) {
-            if (lock_nextAvailableAddress) return;
-
-            address = nextAvailableAddress;
-            lock_nextAvailableAddress = true;
-            
-            // Assign allocation ID
-            activeAllocationCount++;
-            allocationId = activeAllocationCount;
+          // First block, the crossfade tail and a spare for the spill copy
+          // must be backed before we write
+          if (!reserveBlocks(2 + FADE_DURATION_BLOCKS)) {
+            LOG_DEFER("Track::updateState() -> Cannot RECORD (RAM Full)");
+            reqState = NONE;
+            return;
           }
 
-          gc_record.fadeIn();
+          // Stored block 0 is this whole input block, the loop starts at `offset`
+          startOffset = offset;
+          gc_record.fadeInAt(offset);
 
-          LOG("Track::updateState() -> NONE to RECORD. Address: %d", address);
+          LOG_DEFER("Track::updateState() -> NONE to RECORD at sample %d. Free Pages: %d", offset, pager->getFreePages());
           state = RECORD;
           nextState = NONE;
           reqState = NONE;
@@ -280,24 +1004,56 @@ private:
         break;
 
       case RECORD:
-        if (isRamOutOfBounds(1)) {
-           LOG("Track::updateState() -> RECORD to PLAY (RAM Full)");
-           reqState = PLAY; // RAM Bounds Check
+        // Pages for this block, the crossfade tail recorded after it and the spill copy
+        if (!spilled && !reserveBlocks(timeline + 2 + FADE_DURATION_BLOCKS)) {
+          if (canSpill()) {
+            // The pages already reserved past `timeline` become the crossfade tail
+            LOG_DEFER("Track::updateState() -> RAM Full, spilling to SD at block %d", timeline);
+            spillStart = timeline;
+            spilled = true;
+          } else {
+            LOG_DEFER("Track::updateState() -> RECORD to PLAY (RAM Full)");
+            reqState = PLAY; // RAM Bounds Check
+            offset = 0;
+          }
         }
 
         if (reqState == PLAY) {
-          gc_record.hardReset(0.0f);
+          // Stored samples up to the stop point
+          size_t end = timeline * AUDIO_BLOCK_SAMPLES + offset;
+          if (end < startOffset + MIN_LOOP_SAMPLES) {
+            // Too short to loop: keep recording and stop at the next block
+            reqOffset = 0;
+            break;
+          }
+
+          length = end - startOffset;
+          stopBlock = timeline;
           xfadeBlockCount = 0;
 
-          if (trim && timeline > actualBlockLength) {
-            xfadeBlockCount = timeline - actualBlockLength;
-            timeline = actualBlockLength;
+          if (trim && !spilled && length > actualLength && actualLength >= MIN_LOOP_SAMPLES) {
+            length = actualLength;
           }
+          timeline = (startOffset + length + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES;
 
-          nextAvailableAddress += BLOCKS_TO_ADDR(timeline + FADE_DURATION_BLOCKS);
-          lock_nextAvailableAddress = false;
+          // Blocks already recorded past the loop end are the start of its tail
+          size_t recordedBlocks = stopBlock + (offset > 0 ? 1 : 0);
+          if (recordedBlocks > timeline) {
+            size_t extra = recordedBlocks - timeline;
+            xfadeBlockCount = extra < FADE_DURATION_BLOCKS ? extra : FADE_DURATION_BLOCKS;
+          }
+
+          // Give back pages reserved past the crossfade tail
+          releasePagesFrom((hotBlocks() + 1 + FADE_DURATION_BLOCKS + PAGE_BLOCKS - 1) / PAGE_BLOCKS);
+          if (spilled) spill->finishRecording();
+
+          // This block records up to the stop point and plays from it
+          recordTo = offset;
+          playFrom = offset;
+          playhead = (length - offset) % length;
+          if (offset == 0) gc_record.hardReset(0.0f);
 
-          LOG("Track::updateState() -> RECORD to PLAY. Timeline: %d blocks", timeline);
+          LOG_DEFER("Track::updateState() -> RECORD to PLAY at sample %d. Length: %d samples", offset, length);
           state = reqState;
           nextState = NONE;
           reqState = NONE;
@@ -306,22 +1062,24 @@ private:
 
       case PLAY:
         if (reqState == OVERDUB) {
-          gc_record.fadeIn();
+          gc_record.fadeInAt(offset);
+          overdubFrom = offset;
+          history.beginPass(pager);
 
-          LOG("Track::updateState() -> PLAY to OVERDUB");
+          LOG_DEFER("Track::updateState() -> PLAY to OVERDUB at sample %d", offset);
           state = reqState;
           nextState = NONE;
           reqState = NONE;
         }
 
         if (reqState == STOP) {
-          gc_volume.mute();
+          gc_volume.fadeOutAt(offset);
 
           nextState = reqState;
           reqState = NONE;
         }
         if (nextState == STOP && gc_volume.isDone()) {
-          LOG("Track::updateState() -> PLAY to STOP");
+          LOG_DEFER("Track::updateState() -> PLAY to STOP");
           state = nextState;
           nextState = NONE;
           reqState = NONE;
@@ -330,13 +1088,13 @@ private:
 
       case OVERDUB:
         if (reqState == PLAY) {
-          gc_record.fadeOut();
+          gc_record.fadeOutAt(offset);
 
           nextState = reqState;
           reqState = NONE;
         }
         if (nextState == PLAY && gc_record.isDone()) {
-          LOG("Track::updateState() -> OVERDUB to PLAY");
+          LOG_DEFER("Track::updateState() -> OVERDUB to PLAY");
           state = nextState;
           nextState = NONE;
           reqState = NONE;
@@ -344,10 +1102,15 @@ private:
         break;
 
       case STOP:
-        if (reqState == PLAY) {
-          if (!muteState) gc_volume.unmute();
+        // Wait for loop() to rewind the SD stream before playing again
+        if (reqState == PLAY && !spillRestartPending) {
+          if (!muteState) gc_volume.fadeInAt(offset);
+
+          // The loop start lands on `offset`
+          playFrom = offset;
+          playhead = (length - offset) % length;
 
-          LOG("Track::updateState() -> STOP to PLAY");
+          LOG_DEFER("Track::updateState() -> STOP to PLAY at sample %d", offset);
           state = reqState;
           nextState = NONE;
           reqState = NONE;
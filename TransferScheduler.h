@@ -0,0 +1,176 @@
+#ifndef TRANSFER_SCHEDULER_H
+#define TRANSFER_SCHEDULER_H
+
+#include <AudioStream.h>
+#include "Definitions.h"
+#include "Ram.h"
+#include "Profiler.h"
+
+// -------------------------------------------------------------------------
+// TransferScheduler
+// Collects every SPI RAM read and write the tracks need for one audio block,
+// sorts them by address (MEM0 sits below MEM1, so this also groups by chip)
+// and issues each run of contiguous addresses as a single burst.
+// Tracks work on the staging buffers handed out by requestRead/requestWrite.
+// Addresses and lengths are in WORDS, same as Ram::read16/write16.
+// -------------------------------------------------------------------------
+class TransferScheduler {
+public:
+  // Worst case per track per block: a block that wraps the loop reads two
+  // stored blocks on each side of the loop end plus two tail blocks, and
+  // writes the record/tail block, the spill copy and up to four overdubs
+  static const int MAX_READS = NUM_LOOPS * 6;
+  static const int MAX_WRITES = NUM_LOOPS * 6;
+
+  TransferScheduler(Ram* ram) : ram(ram) {
+    reset();
+    lastTransactions = 0;
+    lastBytes = 0;
+  }
+
+  // Must be called at the start of every block before tracks queue transfers
+  void reset() {
+    numReads = 0;
+    numWrites = 0;
+    transactions = 0;
+    bytes = 0;
+  }
+
+  // Queue a read. The returned buffer is only valid after executeReads().
+  int16_t* requestRead(size_t address, size_t length) {
+    if (numReads >= MAX_READS) return nullptr;
+    Transfer& t = reads[numReads];
+    t.address = address;
+    t.length = length;
+    t.data = readStaging[numReads];
+    numReads++;
+    return t.data;
+  }
+
+  // Queue a write. The caller fills the returned buffer before executeWrites().
+  int16_t* requestWrite(size_t address, size_t length) {
+    if (numWrites >= MAX_WRITES) return nullptr;
+    Transfer& t = writes[numWrites];
+    t.address = address;
+    t.length = length;
+    t.data = writeStaging[numWrites];
+    numWrites++;
+    return t.data;
+  }
+
+  void executeReads() {
+    sortByAddress(reads, numReads);
+
+    int i = 0;
+    while (i < numReads) {
+      PROFILE_SCOPE(PROF_SPI_READ);
+      int runEnd = findRunEnd(reads, numReads, i);
+
+      if (runEnd == i + 1) {
+        // Single transfer: read straight into its staging buffer
+        ram->read16(reads[i].address, reads[i].data, reads[i].length);
+        countTransaction(reads[i].length);
+      } else {
+        // Contiguous run: one burst into the bounce buffer, then scatter
+        size_t total = gather(reads, i, runEnd, false);
+        ram->read16(reads[i].address, bounce, total);
+        countTransaction(total);
+        gather(reads, i, runEnd, true);
+      }
+      i = runEnd;
+    }
+    numReads = 0;
+  }
+
+  void executeWrites() {
+    sortByAddress(writes, numWrites);
+
+    int i = 0;
+    while (i < numWrites) {
+      PROFILE_SCOPE(PROF_SPI_WRITE);
+      int runEnd = findRunEnd(writes, numWrites, i);
+
+      if (runEnd == i + 1) {
+        ram->write16(writes[i].address, writes[i].data, writes[i].length);
+        countTransaction(writes[i].length);
+      } else {
+        size_t total = gather(writes, i, runEnd, false);
+        ram->write16(writes[i].address, bounce, total);
+        countTransaction(total);
+      }
+      i = runEnd;
+    }
+    numWrites = 0;
+
+    // Publish the stats for the block that just finished
+    lastTransactions = transactions;
+    lastBytes = bytes;
+  }
+
+  // SPI transactions issued during the last completed block
+  uint32_t getTransactionCount() const { return lastTransactions; }
+  // Bytes moved over SPI during the last completed block
+  uint32_t getBytesMoved() const { return lastBytes; }
+
+private:
+  struct Transfer {
+    size_t address;
+    size_t length;
+    int16_t* data;
+  };
+
+  Ram* ram;
+
+  Transfer reads[MAX_READS];
+  Transfer writes[MAX_WRITES];
+  int numReads;
+  int numWrites;
+
+  int16_t readStaging[MAX_READS][AUDIO_BLOCK_SAMPLES];
+  int16_t writeStaging[MAX_WRITES][AUDIO_BLOCK_SAMPLES];
+  int16_t bounce[(MAX_READS > MAX_WRITES ? MAX_READS : MAX_WRITES) * AUDIO_BLOCK_SAMPLES];
+
+  uint32_t transactions, bytes;
+  volatile uint32_t lastTransactions, lastBytes;
+
+  void countTransaction(size_t words) {
+    transactions++;
+    bytes += SAMPLES_TO_BYTES(words);
+  }
+
+  // Insertion sort: at most a couple dozen entries, usually already close to ordered
+  static void sortByAddress(Transfer* list, int count) {
+    for (int i = 1; i < count; i++) {
+      Transfer key = list[i];
+      int j = i - 1;
+      while (j >= 0 && list[j].address > key.address) {
+        list[j + 1] = list[j];
+        j--;
+      }
+      list[j + 1] = key;
+    }
+  }
+
+  // Returns one past the last entry of the contiguous run starting at `start`
+  static int findRunEnd(Transfer* list, int count, int start) {
+    int end = start + 1;
+    while (end < count && list[end - 1].address + list[end - 1].length == list[end].address) {
+      end++;
+    }
+    return end;
+  }
+
+  // Copies a run into the bounce buffer, or back out of it when scatter is true.
+  // Returns the run length in words.
+  size_t gather(Transfer* list, int start, int end, bool scatter) {
+    size_t offset = 0;
+    for (int i = start; i < end; i++) {
+      if (scatter) memcpy(list[i].data, &bounce[offset], SAMPLES_TO_BYTES(list[i].length));
+      else memcpy(&bounce[offset], list[i].data, SAMPLES_TO_BYTES(list[i].length));
+      offset += list[i].length;
+    }
+    return offset;
+  }
+};
+
+#endif // TRANSFER_SCHEDULER_H
@@ -0,0 +1,132 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// -------------------------------------------------------------------------
+// Host stand-in for the parts of Teensyduino's Arduino.h the core uses.
+// -------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <cmath>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+typedef uint8_t byte;
+
+#define F_CPU_ACTUAL 600000000
+#define BUILTIN_SDCARD 254
+
+namespace HostClock {
+  inline std::chrono::steady_clock::time_point start() {
+    static const auto t0 = std::chrono::steady_clock::now();
+    return t0;
+  }
+
+  inline uint64_t nanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start()).count();
+  }
+
+  // Wall time expressed in Teensy cycles, so cycle counts compare with the pedal
+  inline uint32_t cycles() {
+    return (uint32_t)(nanos() * (F_CPU_ACTUAL / 1000000) / 1000);
+  }
+}
+
+#define ARM_DWT_CYCCNT (HostClock::cycles())
+
+inline unsigned long micros() { return (unsigned long)(HostClock::nanos() / 1000); }
+inline unsigned long millis() { return (unsigned long)(HostClock::nanos() / 1000000); }
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+inline void delayMicroseconds(unsigned long us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+inline void yield() {}
+
+// No interrupts on the host: the offline renderer calls update() and loop()
+// work from one thread
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+
+// The IntervalTimer threads stand in for the PIT interrupt they share on the
+// Teensy; masking IRQ_PIT holds them off
+#define IRQ_PIT 122
+namespace HostIrq {
+  inline std::mutex pit;
+}
+inline void NVIC_DISABLE_IRQ(int irq) {
+  if (irq == IRQ_PIT) HostIrq::pit.lock();
+}
+inline void NVIC_ENABLE_IRQ(int irq) {
+  if (irq == IRQ_PIT) HostIrq::pit.unlock();
+}
+
+class HostSerial {
+public:
+  void begin(unsigned long) {}
+  int printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vfprintf(stderr, format, args);
+    va_end(args);
+    return written;
+  }
+  void println() { fputc('\n', stderr); }
+  void print(const char* text) { fputs(text, stderr); }
+  explicit operator bool() const { return true; }
+};
+
+inline HostSerial Serial;
+
+class String : public std::string {
+public:
+  String() {}
+  String(const char* text) : std::string(text) {}
+  String(const std::string& text) : std::string(text) {}
+  String(int value) : std::string(std::to_string(value)) {}
+  bool startsWith(const char* prefix) const { return rfind(prefix, 0) == 0; }
+};
+
+inline String operator+(const String& a, const String& b) { return String(std::string(a) + std::string(b)); }
+inline String operator+(const String& a, const char* b) { return String(std::string(a) + b); }
+inline String operator+(const char* a, const String& b) { return String(a + std::string(b)); }
+
+// Runs the callback from a second thread, standing in for a timer interrupt
+class IntervalTimer {
+public:
+  ~IntervalTimer() { end(); }
+
+  bool begin(void (*callback)(), float periodMicros) {
+    end();
+    running = true;
+    worker = std::thread([this, callback, periodMicros]() {
+      auto period = std::chrono::nanoseconds((int64_t)(periodMicros * 1000.0f));
+      auto next = std::chrono::steady_clock::now();
+      while (running) {
+        {
+          std::lock_guard<std::mutex> lock(HostIrq::pit);
+          callback();
+        }
+        next += period;
+        std::this_thread::sleep_until(next);
+      }
+    });
+    return true;
+  }
+
+  void end() {
+    running = false;
+    if (worker.joinable()) worker.join();
+  }
+
+  void priority(int) {}
+
+private:
+  std::atomic<bool> running{false};
+  std::thread worker;
+};
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,6 @@
+#ifndef HOST_AUDIO_H
+#define HOST_AUDIO_H
+
+#include <AudioStream.h>
+
+#endif // HOST_AUDIO_H
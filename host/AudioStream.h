@@ -0,0 +1,71 @@
+#ifndef HOST_AUDIO_STREAM_H
+#define HOST_AUDIO_STREAM_H
+
+// -------------------------------------------------------------------------
+// Host stand-in for the Teensy Audio library's AudioStream.
+// There is no audio graph: receiveReadOnly()/receiveWritable() pull from
+// HostAudio::source and transmit() pushes to HostAudio::sink.
+// -------------------------------------------------------------------------
+
+#include <Arduino.h>
+#include <functional>
+
+#define AUDIO_BLOCK_SAMPLES 128
+#define AUDIO_SAMPLE_RATE_EXACT 44117.64706f
+#define AUDIO_SAMPLE_RATE AUDIO_SAMPLE_RATE_EXACT
+
+typedef struct audio_block_struct {
+  uint8_t ref_count;
+  uint8_t reserved1;
+  uint16_t memory_pool_index;
+  int16_t data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+namespace HostAudio {
+  // Fills `block` with the next input for `channel`. Return false for no input.
+  inline std::function<bool(int channel, int16_t* block)> source;
+  // Receives every transmitted block
+  inline std::function<void(int channel, const int16_t* block)> sink;
+}
+
+class AudioStream {
+public:
+  AudioStream(unsigned char, audio_block_t**) {}
+  virtual ~AudioStream() {}
+  virtual void update(void) = 0;
+
+  static audio_block_t* allocate(void) {
+    audio_block_t* block = new audio_block_t();
+    block->ref_count = 1;
+    return block;
+  }
+
+  static void release(audio_block_t* block) {
+    if (block && --block->ref_count == 0) delete block;
+  }
+
+protected:
+  audio_block_t* receiveReadOnly(unsigned int index = 0) {
+    if (!HostAudio::source) return nullptr;
+    audio_block_t* block = allocate();
+    if (!HostAudio::source(index, block->data)) {
+      release(block);
+      return nullptr;
+    }
+    return block;
+  }
+
+  audio_block_t* receiveWritable(unsigned int index = 0) {
+    return receiveReadOnly(index);
+  }
+
+  void transmit(audio_block_t* block, unsigned char index = 0) {
+    if (HostAudio::sink) HostAudio::sink(index, block->data);
+  }
+};
+
+// The offline renderer runs update() and loop() work on one thread
+#define AudioNoInterrupts() do {} while (0)
+#define AudioInterrupts() do {} while (0)
+
+#endif // HOST_AUDIO_STREAM_H
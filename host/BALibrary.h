@@ -0,0 +1,191 @@
+#ifndef HOST_BALIBRARY_H
+#define HOST_BALIBRARY_H
+
+// -------------------------------------------------------------------------
+// Host stand-in for the BALibrary pieces the core uses: the two SPI RAM
+// chips, ExtMemSlot and ExternalSramManager.
+// Each chip is a MAP_SHARED mapping of <data dir>/mem0.bin and mem1.bin, so
+// BASpiMemory and the ExternalSramManager slots see the same bytes, just
+// like on the board, and the contents can be inspected after a run.
+// -------------------------------------------------------------------------
+
+#include <Arduino.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <functional>
+
+namespace HostStorage {
+  // Root for everything the host build writes. Override with LOOPER_HOST_DIR.
+  inline std::string dataDir() {
+    const char* dir = getenv("LOOPER_HOST_DIR");
+    std::string path = dir ? dir : "host_data";
+    mkdir(path.c_str(), 0755);
+    return path;
+  }
+
+  // Benches that keep their own clock take the modelled SD time here
+  // instead of sleeping it
+  inline std::function<void(double us)> sdClock;
+
+  // Emulated SD card speed: LOOPER_HOST_SD_MBPS (MB/s) paces reads and
+  // writes, LOOPER_HOST_SD_LATENCY_US is added to every read and write and
+  // LOOPER_HOST_SD_SYNC_US to every sync. Unset, SD runs at host speed.
+  inline void sdDelay(size_t bytes, bool sync = false) {
+    static const char* mbps = getenv("LOOPER_HOST_SD_MBPS");
+    static const char* latencyUs = getenv("LOOPER_HOST_SD_LATENCY_US");
+    static const char* syncUs = getenv("LOOPER_HOST_SD_SYNC_US");
+    double us = mbps ? bytes / atof(mbps) : 0.0;
+    if (!sync && latencyUs) us += atof(latencyUs);
+    if (sync && syncUs) us += atof(syncUs);
+    if (us <= 0) return;
+    if (sdClock) sdClock(us);
+    else std::this_thread::sleep_for(std::chrono::nanoseconds((int64_t)(us * 1000.0)));
+  }
+}
+
+namespace BALibrary {
+
+enum class SpiDeviceId { SPI_DEVICE0, SPI_DEVICE1 };
+enum class MemSelect { MEM0, MEM1 };
+
+class BAHardware {
+public:
+  static const size_t SPI_MEM_SIZE_BYTES = 8 * 1024 * 1024; // 64 Mbit
+
+  size_t getSpiMemSizeBytes(MemSelect) const { return SPI_MEM_SIZE_BYTES; }
+
+  // Mapping for one chip, created zero-filled on first use
+  static uint8_t* chip(int index) {
+    static uint8_t* maps[2] = { nullptr, nullptr };
+    if (!maps[index]) {
+      std::string path = HostStorage::dataDir() + "/mem" + std::to_string(index) + ".bin";
+      int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0 || ftruncate(fd, SPI_MEM_SIZE_BYTES) != 0) {
+        perror(path.c_str());
+        abort();
+      }
+      void* map = mmap(nullptr, SPI_MEM_SIZE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if (map == MAP_FAILED) {
+        perror("mmap");
+        abort();
+      }
+      maps[index] = (uint8_t*)map;
+    }
+    return maps[index];
+  }
+};
+
+inline BAHardware BAHardwareConfig;
+
+class BASpiMemory {
+public:
+  BASpiMemory(SpiDeviceId id) : chipIndex(id == SpiDeviceId::SPI_DEVICE0 ? 0 : 1) {}
+
+  void begin() { mem = BAHardware::chip(chipIndex); }
+
+  void write(size_t address, uint8_t data) { mem[address] = data; }
+  uint8_t read(size_t address) { return mem[address]; }
+  void write(size_t address, uint8_t* data, size_t numBytes) {
+    memcpy(&mem[address], data, numBytes);
+    traffic += numBytes;
+  }
+  void read(size_t address, uint8_t* dest, size_t numBytes) {
+    memcpy(dest, &mem[address], numBytes);
+    traffic += numBytes;
+  }
+
+  void write16(size_t address, uint16_t data) { memcpy(&mem[address], &data, sizeof(data)); }
+  uint16_t read16(size_t address) {
+    uint16_t data;
+    memcpy(&data, &mem[address], sizeof(data));
+    return data;
+  }
+  void write16(size_t address, uint16_t* data, size_t numWords) {
+    memcpy(&mem[address], data, numWords * 2);
+    traffic += numWords * 2;
+  }
+  void read16(size_t address, uint16_t* dest, size_t numWords) {
+    memcpy(dest, &mem[address], numWords * 2);
+    traffic += numWords * 2;
+  }
+
+  // Bytes moved by the bulk calls on either chip, for the benches
+  static inline uint64_t traffic = 0;
+
+private:
+  int chipIndex;
+  uint8_t* mem = nullptr;
+};
+
+// A region of one chip with its own read/write positions. Positions are in
+// bytes, relative to the slot, and the *Advance16 calls wrap at the slot end.
+class ExtMemSlot {
+public:
+  bool setWritePosition(size_t offsetBytes) { writePosition = offsetBytes; return true; }
+  bool setReadPosition(size_t offsetBytes) { readPosition = offsetBytes; return true; }
+  size_t getWritePosition() const { return writePosition; }
+  size_t getReadPosition() const { return readPosition; }
+  size_t size() const { return sizeBytes; }
+
+  bool writeAdvance16(int16_t* src, size_t numWords) {
+    if (!mem) return false;
+    copyWrapped(writePosition, (uint8_t*)src, numWords * 2, true);
+    return true;
+  }
+
+  bool readAdvance16(int16_t* dest, size_t numWords) {
+    if (!mem) return false;
+    copyWrapped(readPosition, (uint8_t*)dest, numWords * 2, false);
+    return true;
+  }
+
+private:
+  friend class ExternalSramManager;
+  uint8_t* mem = nullptr;
+  size_t sizeBytes = 0;
+  size_t writePosition = 0;
+  size_t readPosition = 0;
+
+  void copyWrapped(size_t& position, uint8_t* buffer, size_t numBytes, bool toMemory) {
+    while (numBytes > 0) {
+      size_t run = sizeBytes - position;
+      if (run > numBytes) run = numBytes;
+      if (toMemory) memcpy(&mem[position], buffer, run);
+      else memcpy(buffer, &mem[position], run);
+      buffer += run;
+      numBytes -= run;
+      position += run;
+      if (position >= sizeBytes) position = 0;
+    }
+  }
+};
+
+// Hands out slots from the bottom of each chip upward, never frees
+class ExternalSramManager {
+public:
+  bool requestMemory(ExtMemSlot* slot, size_t sizeBytes, MemSelect mem, bool useDma = false) {
+    (void)useDma;
+    int index = mem == MemSelect::MEM0 ? 0 : 1;
+    if (next[index] + sizeBytes > BAHardware::SPI_MEM_SIZE_BYTES) return false;
+    slot->mem = BAHardware::chip(index) + next[index];
+    slot->sizeBytes = sizeBytes;
+    slot->writePosition = 0;
+    slot->readPosition = 0;
+    next[index] += sizeBytes;
+    return true;
+  }
+
+private:
+  size_t next[2] = { 0, 0 };
+};
+
+} // namespace BALibrary
+
+#define SPI_MEM0_64M() do {} while (0)
+#define SPI_MEM1_64M() do {} while (0)
+
+#endif // HOST_BALIBRARY_H
@@ -0,0 +1,124 @@
+#ifndef HOST_BENCH_HARNESS_H
+#define HOST_BENCH_HARNESS_H
+
+// -------------------------------------------------------------------------
+// Offline render harness shared by the host benches. Each bench is a single
+// translation unit, so the looper and the render state are globals here:
+// the input is a tone per layer, `output` holds the last block the looper
+// sent, and step() runs one audio block and one loop() pass. The loop may
+// be off the block grid, so a loop start is the block it falls inside.
+// -------------------------------------------------------------------------
+
+#include "../AudioLooper.h"
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+inline AudioLooper* looper;             // created by the bench, after beginBench()
+inline long blockNo = 0;
+inline int layer = 0;                   // tone of the input while recording, -1 for silence
+inline std::vector<int16_t> output;     // last block the looper sent
+inline bool loopStarted = false;        // a block held the loop start, cleared by the bench
+inline uint64_t updateNanos = 0;        // the last AudioLooper::update()
+inline std::function<void()> loopWork;  // more of loop(), after the looper's storage work
+
+// One "--name value" option on the command line
+struct BenchOption {
+  enum Kind { INT, LONG, SIZE, DOUBLE };
+  const char* name;
+  Kind kind;
+  void* value;
+
+  BenchOption(const char* name, int& value) : name(name), kind(INT), value(&value) {}
+  BenchOption(const char* name, long& value) : name(name), kind(LONG), value(&value) {}
+  BenchOption(const char* name, size_t& value) : name(name), kind(SIZE), value(&value) {}
+  BenchOption(const char* name, double& value) : name(name), kind(DOUBLE), value(&value) {}
+};
+
+// Reads the options; anything else prints the usage and returns false
+inline bool parseOptions(int argc, char** argv, std::initializer_list<BenchOption> options) {
+  for (int i = 1; i < argc; i++) {
+    const BenchOption* match = nullptr;
+    for (const BenchOption& option : options) {
+      if (argv[i] == std::string(option.name)) match = &option;
+    }
+    if (!match || i + 1 >= argc) {
+      std::string usage;
+      for (const BenchOption& option : options) {
+        usage += std::string(" [") + option.name + (option.kind == BenchOption::DOUBLE ? " X]" : " N]");
+      }
+      fprintf(stderr, "usage: %s%s\n", argv[0], usage.c_str());
+      return false;
+    }
+    const char* text = argv[++i];
+    switch (match->kind) {
+      case BenchOption::INT: *(int*)match->value = atoi(text); break;
+      case BenchOption::LONG: *(long*)match->value = atol(text); break;
+      case BenchOption::SIZE: *(size_t*)match->value = (size_t)atol(text); break;
+      case BenchOption::DOUBLE: *(double*)match->value = atof(text); break;
+    }
+  }
+  return true;
+}
+
+// Its own data directory, the looper's LOG() chatter out of the report, and
+// the audio in and out. Layer n plays a tone of its own at `amplitude`,
+// quiet enough that the benches' full mixes never clip.
+inline bool beginBench(const char* dataDir, float amplitude) {
+  setenv("LOOPER_HOST_DIR", dataDir, 0);
+  if (!freopen("/dev/null", "w", stderr)) return false;
+
+  HostAudio::source = [amplitude](int, int16_t* data) {
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      long n = blockNo * AUDIO_BLOCK_SAMPLES + i;
+      data[i] = layer < 0 ? 0 : (int16_t)(amplitude * sinf(n * (0.011f + 0.007f * layer)));
+    }
+    return true;
+  };
+  HostAudio::sink = [](int channel, const int16_t* data) {
+    if (channel == 0) output.assign(data, data + AUDIO_BLOCK_SAMPLES);
+  };
+  return true;
+}
+
+// One audio block, as the ISR runs it. Returns whether the loop start fell inside it.
+inline bool audioBlock() {
+  size_t playhead = looper->getPlayhead();
+  uint64_t start = HostClock::nanos();
+  looper->update();
+  updateNanos = HostClock::nanos() - start;
+  blockNo++;
+  bool started = looper->getTimeline() > 0 && playhead + AUDIO_BLOCK_SAMPLES >= looper->getTimeline();
+  if (started) loopStarted = true;
+  return started;
+}
+
+// One audio block, then one loop() pass. Returns whether the loop start fell inside the block.
+inline bool step() {
+  bool started = audioBlock();
+  looper->prefetch();
+  looper->updateStorage();
+  if (loopWork) loopWork();
+  DeferredLog::drain();
+  return started;
+}
+
+inline void runToLoopStart() {
+  while (!step()) {
+  }
+}
+
+// One lap of output, from the loop start
+inline std::vector<int16_t> renderLap() {
+  runToLoopStart();
+  std::vector<int16_t> lap;
+  bool end;
+  do {
+    end = step();
+    lap.insert(lap.end(), output.begin(), output.end());
+  } while (!end);
+  return lap;
+}
+
+#endif // HOST_BENCH_HARNESS_H
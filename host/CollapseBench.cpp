@@ -0,0 +1,140 @@
+// -------------------------------------------------------------------------
+// Collapse benchmark on the host build (see README).
+// Records a base loop and a layer on every other track at assorted volumes,
+// one of them muted, then collapses them all into track 0 while playing.
+// Reports:
+//   output : every sample played from before the collapse to a lap after it,
+//            against the lap rendered before it; they must be identical
+//   blocks : ns per AudioLooper::update() and SPI traffic per block, before,
+//            during and after the collapse; the ISR's own transfers, and all
+//            of them with the read-ahead and overdub folding of loop()
+//   memory : free SPI RAM pages before and after, and a new layer recorded
+//            on one of the freed tracks
+//
+//   collapse_bench [--loop-blocks N] [--tracks N]
+// -------------------------------------------------------------------------
+
+#include "BenchHarness.h"
+#include <algorithm>
+
+// Per-block figures over a stretch of blocks
+struct Stats {
+  long blocks = 0;
+  uint64_t nanos = 0, bytes = 0, transactions = 0, traffic = 0;
+
+  void print(const char* name) const {
+    printf("  %-6s: %4ld blocks, %5.0f ns per update(); SPI per block %5.0f B in %3.1f transactions from the ISR, "
+           "%5.0f B with the read-ahead\n",
+           name, blocks, (double)nanos / blocks, (double)bytes / blocks, (double)transactions / blocks,
+           (double)traffic / blocks);
+  }
+};
+
+// step(), filed under `stats`
+static void measuredStep(Stats* stats) {
+  uint64_t traffic = BALibrary::BASpiMemory::traffic;
+  step();
+  if (!stats) return;
+  stats->nanos += updateNanos;
+  stats->bytes += looper->getSpiBytes();
+  stats->transactions += looper->getSpiTransactions();
+  stats->traffic += BALibrary::BASpiMemory::traffic - traffic;
+  stats->blocks++;
+}
+
+// One lap of output from wherever the playhead is, indexed by loop position
+static std::vector<int16_t> lapByPosition(Stats* stats) {
+  size_t timeline = looper->getTimeline();
+  std::vector<int16_t> lap(timeline);
+  for (size_t n = 0; n < timeline / AUDIO_BLOCK_SAMPLES + 1; n++) {
+    size_t pos = looper->getPlayhead();
+    measuredStep(stats);
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) lap[(pos + i) % timeline] = output[i];
+  }
+  return lap;
+}
+
+// Plays one block and compares it with the reference lap
+static void playChecked(const std::vector<int16_t>& lap, size_t& differ, int& worst, Stats* stats) {
+  size_t pos = looper->getPlayhead();
+  measuredStep(stats);
+  for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+    int diff = abs(output[i] - lap[(pos + i) % lap.size()]);
+    if (diff) differ++;
+    worst = std::max(worst, diff);
+  }
+}
+
+static void recordLayer(int tone) {
+  layer = tone;
+  looper->trigger(SampleClock::now());
+  step();
+  runToLoopStart();
+  looper->trigger(SampleClock::now());
+  step();
+  layer = -1;
+  runToLoopStart();
+  runToLoopStart(); // crossfade tail recorded
+}
+
+int main(int argc, char** argv) {
+  size_t loopBlocks = 345 * 2;
+  int tracks = NUM_LOOPS;
+  if (!parseOptions(argc, argv, { { "--loop-blocks", loopBlocks }, { "--tracks", tracks } })) return 1;
+  if (tracks < 2 || tracks > NUM_LOOPS) tracks = NUM_LOOPS;
+  if (loopBlocks < 16) loopBlocks = 16;
+  if (!beginBench("collapse_bench_data", 3000.0f)) return 1;
+
+  looper = new AudioLooper();
+  looper->begin();
+
+  // Base loop off the block grid, so the collapse starts and ends mid-block
+  layer = 0;
+  looper->trigger(SampleClock::now());
+  for (size_t i = 0; i < loopBlocks; i++) step();
+  looper->trigger(SampleClock::now() + 37);
+  step();
+  layer = -1;
+  runToLoopStart();
+  runToLoopStart();
+  for (int n = 1; n < tracks; n++) recordLayer(n);
+  for (int n = 0; n < tracks; n++) looper->setTrackVolume(n, 1.0f - 0.08f * n);
+  looper->muteTrack(tracks / 2, true);
+  for (int i = 0; i < FADE_DURATION_BLOCKS + 2; i++) step();
+
+  Stats before, during, after;
+  std::vector<int16_t> lap = lapByPosition(&before);
+  int freeBefore = looper->getFreePages();
+  int countBefore = looper->getTrackCount();
+
+  // Request the collapse mid-lap, it starts on the next loop start
+  for (size_t i = 0; i < loopBlocks / 3; i++) step();
+  looper->collapse(NUM_LOOPS - 1);
+  size_t differ = 0;
+  int worst = 0;
+  do {
+    playChecked(lap, differ, worst, nullptr);
+  } while (looper->isCollapsing() && !looper->getTrack(0)->isBouncing());
+  long collapseBlocks = 0;
+  while (looper->isCollapsing()) {
+    playChecked(lap, differ, worst, &during);
+    collapseBlocks++;
+  }
+  for (size_t n = 0; n < lap.size() / AUDIO_BLOCK_SAMPLES + 1; n++) playChecked(lap, differ, worst, &after);
+
+  printf("output : %d tracks (one muted) into 1 over %ld blocks; %zu samples differ from the lap before, worst by %d\n",
+         countBefore, collapseBlocks, differ, worst);
+  printf("blocks :\n");
+  before.print("before");
+  during.print("during");
+  after.print("after");
+
+  // Tracks cleared: their pages come back, and a new layer can be recorded
+  for (int i = 0; i < 4; i++) runToLoopStart();
+  int freeAfter = looper->getFreePages();
+  int countAfter = looper->getTrackCount();
+  recordLayer(tracks);
+  printf("memory : %d of %d pages free before, %d after; tracks in use %d -> %d, %d after recording a new layer\n",
+         freeBefore, looper->getTotalPages(), freeAfter, countBefore, countAfter, looper->getTrackCount());
+  return differ == 0 && countAfter == 1 && looper->getTrackCount() == 2 ? 0 : 1;
+}
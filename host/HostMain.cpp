@@ -0,0 +1,238 @@
+// -------------------------------------------------------------------------
+// Offline renderer for the looper core (host build, see README).
+// Runs AudioLooper block by block over a mono 16-bit raw PCM file as fast as
+// the host allows and writes the output the same way. Between blocks it does
+// the work loop() does between audio interrupts on the pedal.
+//
+//   looper_host <in.raw|-> <out.raw> [events] [blocks]
+//   looper_host --bench
+//
+//   in "-"  : generate a test tone instead of reading a file
+//   events  : comma separated <block>[+<sample>]:<action>, action is trigger,
+//             reset, pot=<0..1>, tempo=<on|off>, clock=<bpm>[/<jitter ms>],
+//             overdub=<on|off>, undo or redo (the last three on the newest
+//             layer), collapse[=<last track>] (every layer by default),
+//             e.g. "10:trigger,400+37:trigger,900:trigger".
+//             A trigger lands on sample <sample> of its block. clock starts
+//             (or retunes) a synthetic MIDI clock with uniform timing jitter,
+//             clock=0 stops it.
+//   blocks  : render at least this many blocks (input is padded with silence)
+// -------------------------------------------------------------------------
+
+#include "../AudioLooper.h"
+#include "../TempoSync.h"
+#include "../Benchmark.h"
+#include <vector>
+
+struct Event {
+  long block;
+  int offset; // sample inside the block
+  std::string action;
+};
+
+static std::vector<Event> parseEvents(const char* text) {
+  std::vector<Event> events;
+  std::string list = text ? text : "";
+  size_t start = 0;
+  while (start < list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) end = list.size();
+    std::string item = list.substr(start, end - start);
+    size_t colon = item.find(':');
+    if (colon != std::string::npos) {
+      std::string when = item.substr(0, colon);
+      size_t plus = when.find('+');
+      int offset = plus != std::string::npos ? atoi(when.c_str() + plus + 1) : 0;
+      events.push_back({ atol(when.c_str()), offset, item.substr(colon + 1) });
+    }
+    start = end + 1;
+  }
+  return events;
+}
+
+// MIDI clock source with its ticks stamped in samples, as MidiHandler does
+struct SyntheticClock {
+  double period = 0.0; // samples per tick, 0 when stopped
+  double jitter = 0.0; // +/- samples
+  double next = 0.0;   // ideal time of the next tick
+  uint32_t seed = 1;
+
+  void set(double bpm, double jitterMs) {
+    if (period == 0.0) next = SampleClock::now() + jitterMs * SAMPLE_RATE / 1000.0;
+    period = bpm > 0.0 ? 60.0 * SAMPLE_RATE / (bpm * MidiClock::TICKS_PER_BEAT) : 0.0;
+    jitter = jitterMs * SAMPLE_RATE / 1000.0;
+  }
+
+  // Delivers the ticks due before sample `until`
+  void run(uint32_t until, MidiClock& clock, TempoSync& tempoSync) {
+    while (period > 0.0 && next < until) {
+      seed = seed * 1664525u + 1013904223u;
+      double offset = ((seed >> 8) / 16777216.0 * 2.0 - 1.0) * jitter;
+      clock.handleClock((uint32_t)(next + offset + 0.5));
+      tempoSync.update();
+      next += period;
+    }
+  }
+};
+
+// What MidiClockOut sent, stamped with the sample the timer ran at
+struct ClockOutLog {
+  static inline uint32_t now = 0;
+  static inline uint32_t ticks = 0, starts = 0, stops = 0;
+  static inline uint32_t lastTick = 0; // 0 after a stop
+  static inline double intervalSum = 0.0, intervalWorst = 0.0;
+  static inline uint32_t intervals = 0;
+
+  static void send(uint8_t status) {
+    if (status == MIDI_STATUS_START) {
+      starts++;
+    } else if (status == MIDI_STATUS_STOP) {
+      stops++;
+      lastTick = 0;
+    } else if (status == MIDI_STATUS_CLOCK) {
+      if (lastTick != 0) {
+        double interval = now - lastTick;
+        intervalSum += interval;
+        intervals++;
+        double ideal = intervalSum / intervals;
+        if (fabs(interval - ideal) > intervalWorst) intervalWorst = fabs(interval - ideal);
+      }
+      ticks++;
+      lastTick = now;
+    }
+  }
+
+  // Runs the send timer over the block that just started playing
+  static void run(uint32_t blockStart) {
+    static double us = 0.0;
+    double blockEndUs = (blockStart + AUDIO_BLOCK_SAMPLES) * 1e6 / SAMPLE_RATE;
+    for (; us < blockEndUs; us += MIDI_CLOCK_OUT_US) {
+      now = (uint32_t)(us * SAMPLE_RATE / 1e6);
+      MidiClockOut::emit(now, (uint32_t)(us * (Hal::cyclesPerSecond() / 1e6)));
+    }
+  }
+};
+
+static void runEvent(AudioLooper& looper, TempoSync& tempoSync, SyntheticClock& midi, const Event& event) {
+  if (event.action == "trigger") tempoSync.trigger(SampleClock::now() + event.offset);
+  else if (event.action == "reset") looper.reset();
+  else if (event.action == "tempo=on" || event.action == "tempo=off") tempoSync.setEnabled(event.action == "tempo=on");
+  else if (event.action.rfind("clock=", 0) == 0) {
+    const char* jitter = strchr(event.action.c_str(), '/');
+    midi.set(atof(event.action.c_str() + 6), jitter ? atof(jitter + 1) : 0.0);
+  }
+  else if (event.action.rfind("pot=", 0) == 0) looper.updateSmartMute((float)atof(event.action.c_str() + 4));
+  else if (event.action == "overdub=on" || event.action == "overdub=off") {
+    looper.overdubTrack(looper.getTrackCount() - 1, event.action == "overdub=on", SampleClock::now() + event.offset);
+  }
+  else if (event.action == "undo") looper.undoOverdub(looper.getTrackCount() - 1);
+  else if (event.action == "redo") looper.redoOverdub(looper.getTrackCount() - 1);
+  else if (event.action == "collapse") looper.collapse(NUM_LOOPS - 1);
+  else if (event.action.rfind("collapse=", 0) == 0) looper.collapse(atoi(event.action.c_str() + 9));
+  else fprintf(stderr, "unknown action '%s'\n", event.action.c_str());
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 2 && std::string(argv[1]) == "--bench") {
+    Benchmark::runAll();
+    return 0;
+  }
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <in.raw|-> <out.raw> [events] [blocks]\n", argv[0]);
+    return 1;
+  }
+
+  bool tone = std::string(argv[1]) == "-";
+  FILE* in = tone ? nullptr : fopen(argv[1], "rb");
+  FILE* out = fopen(argv[2], "wb");
+  if ((!tone && !in) || !out) {
+    perror("open");
+    return 1;
+  }
+  std::vector<Event> events = parseEvents(argc > 3 ? argv[3] : nullptr);
+  long minBlocks = argc > 4 ? atol(argv[4]) : 0;
+  for (const Event& event : events) {
+    if (event.block + 1 > minBlocks) minBlocks = event.block + 1;
+  }
+
+  static AudioLooper looper;
+  static MidiClock clock;
+  static TempoSync tempoSync(looper, clock);
+  SyntheticClock midi;
+  looper.begin();
+  MidiClockOut::setOutput(ClockOutLog::send);
+
+  long block = 0;
+  bool inputDone = false;
+  HostAudio::source = [&](int, int16_t* data) {
+    size_t got = 0;
+    if (tone) {
+      for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        long n = block * AUDIO_BLOCK_SAMPLES + i;
+        data[i] = (int16_t)(8000.0f * sinf(n * 0.0313f));
+      }
+      got = AUDIO_BLOCK_SAMPLES;
+    } else if (in) {
+      got = fread(data, sizeof(int16_t), AUDIO_BLOCK_SAMPLES, in);
+    }
+    if (got < AUDIO_BLOCK_SAMPLES) {
+      memset(&data[got], 0, (AUDIO_BLOCK_SAMPLES - got) * sizeof(int16_t));
+      if (!tone) inputDone = true;
+    }
+    return true;
+  };
+  HostAudio::sink = [&](int, const int16_t* data) {
+    fwrite(data, sizeof(int16_t), AUDIO_BLOCK_SAMPLES, out);
+  };
+
+  uint64_t spiTransactions = 0;
+  size_t nextEvent = 0;
+  uint64_t start = HostClock::nanos();
+  while (block < minBlocks || (!tone && !inputDone)) {
+    while (nextEvent < events.size() && events[nextEvent].block <= block) {
+      runEvent(looper, tempoSync, midi, events[nextEvent++]);
+    }
+    midi.run(SampleClock::now() + AUDIO_BLOCK_SAMPLES, clock, tempoSync);
+
+    uint32_t blockStart = SampleClock::now();
+    looper.update();
+    spiTransactions += looper.getSpiTransactions();
+    ClockOutLog::run(blockStart);
+
+    // loop() side
+    looper.prefetch();
+    looper.updateStorage();
+    tempoSync.update();
+    MidiClockOut::setFollowing(clock.hasTempo());
+    DeferredLog::drain();
+    block++;
+  }
+  double seconds = (HostClock::nanos() - start) / 1e9;
+  double audioSeconds = block * AUDIO_BLOCK_SAMPLES / (double)AUDIO_SAMPLE_RATE_EXACT;
+
+  printf("blocks %ld (%.1f s of audio) in %.3f s, %.0fx real time\n",
+         block, audioSeconds, seconds, seconds > 0 ? audioSeconds / seconds : 0.0);
+  printf("spi transactions %llu, prefetch misses %u, spill underruns %u, free pages %d/%d\n",
+         (unsigned long long)spiTransactions, looper.getPrefetchMisses(), looper.getSpillUnderruns(),
+         looper.getFreePages(), looper.getTotalPages());
+  if (midi.period > 0.0) {
+    printf("midi clock drift %d samples, max %d\n", tempoSync.getDrift(), tempoSync.getMaxDrift());
+  }
+
+  if (ClockOutLog::ticks > 0) {
+    MidiClockOut::Stats stats = MidiClockOut::takeStats();
+    printf("midi clock out %u ticks, %u start, %u stop, interval %.2f samples, worst %.2f off; "
+           "late max %u samples, interval error max %.1f us\n",
+           ClockOutLog::ticks, ClockOutLog::starts, ClockOutLog::stops,
+           ClockOutLog::intervals ? ClockOutLog::intervalSum / ClockOutLog::intervals : 0.0,
+           ClockOutLog::intervalWorst, stats.lateMax, stats.intervalMaxMicros());
+  }
+
+#if PROFILER_ENABLED
+  Profiler::dump();
+#endif
+
+  if (in) fclose(in);
+  fclose(out);
+  return 0;
+}
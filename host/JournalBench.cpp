@@ -0,0 +1,248 @@
+// -------------------------------------------------------------------------
+// Autosave journal benchmark on the host build (see README).
+// Records a base loop and layers, then changes a volume and a mute, with
+// SessionJournal::update() running once per audio block as loop() would.
+// The SD card is paced by the host SD stand-in (--sd-mbps, --sync-us).
+// Reports:
+//   written : journal bytes against a full snapshot at every commit
+//   stall   : time per update() call that did work, mean, p99 and worst
+//   crash   : the journal cut at many points, with and without garbage
+//             after the cut, each restored into wiped SPI RAM; the lap must
+//             match the one rendered when the last surviving commit was made;
+//             the restore runs a record per audio block, as from loop(), and
+//             its longest pass is reported
+//
+//   journal_bench [--loop-blocks N] [--tracks N] [--sd-mbps X] [--sync-us N]
+// -------------------------------------------------------------------------
+
+#include "BenchHarness.h"
+#include "../SessionJournal.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+
+static SessionJournal* journal;
+static std::vector<double> updateMicros; // update() calls that found work
+
+// The journal's part of a loop() pass, timed
+static void journalPass() {
+  if (!journal) return;
+  SessionJournal::Stats before = journal->getStats();
+  uint64_t start = HostClock::nanos();
+  journal->update();
+  double us = (HostClock::nanos() - start) / 1e3;
+  if (journal->getStats().passes != before.passes) updateMicros.push_back(us);
+}
+
+// What a commit holds, as far as the audio goes
+static std::string keyOf(int count, const bool* muted, const float* volume) {
+  std::string key = std::to_string(count);
+  for (int i = 0; i < count; i++) {
+    char part[32];
+    snprintf(part, sizeof(part), "/%d:%.3f", muted[i] ? 1 : 0, volume[i]);
+    key += part;
+  }
+  return key;
+}
+
+static std::string looperKey() {
+  bool muted[NUM_LOOPS];
+  float volume[NUM_LOOPS];
+  int count = looper->getTrackCount();
+  for (int i = 0; i < count; i++) {
+    muted[i] = looper->getTrack(i)->getMuteState();
+    volume[i] = looper->getTrack(i)->getVolume();
+  }
+  return keyOf(count, muted, volume);
+}
+
+// Key of the last commit in `bytes`, "" for none
+static std::string lastCommitKey(const std::vector<uint8_t>& bytes) {
+  std::string key;
+  size_t at = SD_SECTOR_BYTES;
+  SessionJournal::Record record;
+  while (at + SD_SECTOR_BYTES <= bytes.size()) {
+    memcpy(&record, &bytes[at], sizeof(record));
+    if (record.magic != SessionJournal::MAGIC) break;
+    uint32_t sum = 2166136261u;
+    for (size_t i = 0; i < offsetof(SessionJournal::Record, checksum); i++) sum = (sum ^ bytes[at + i]) * 16777619u;
+    if (sum != record.checksum) break;
+    at += SD_SECTOR_BYTES + record.dataBytes;
+    if (at > bytes.size()) break;
+    if (record.type != SessionJournal::COMMIT) continue;
+    bool muted[NUM_LOOPS];
+    float volume[NUM_LOOPS];
+    for (uint32_t i = 0; i < record.count; i++) {
+      muted[i] = record.tracks[i].muted;
+      volume[i] = record.tracks[i].volume;
+    }
+    key = keyOf(record.count, muted, volume);
+  }
+  return key;
+}
+
+static std::vector<uint8_t> readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const uint8_t* bytes, size_t count) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write((const char*)bytes, count);
+}
+
+static void clearLooper() {
+  looper->reset();
+  do {
+    step();
+  } while (!looper->isIdle() || looper->isWaiting());
+  step();
+}
+
+int main(int argc, char** argv) {
+  size_t loopBlocks = 345 * 4;
+  int tracks = 4;
+  double mbps = 20;
+  long syncUs = 2000;
+  if (!parseOptions(argc, argv,
+                    { { "--loop-blocks", loopBlocks }, { "--tracks", tracks }, { "--sd-mbps", mbps }, { "--sync-us", syncUs } })) {
+    return 1;
+  }
+  if (tracks < 2 || tracks > NUM_LOOPS) tracks = NUM_LOOPS;
+
+  setenv("LOOPER_HOST_SD_MBPS", std::to_string(mbps).c_str(), 1);
+  setenv("LOOPER_HOST_SD_SYNC_US", std::to_string(syncUs).c_str(), 1);
+  if (!beginBench("journal_bench_data", 4000.0f)) return 1;
+  SD.remove("journal_0.bin");
+  SD.remove("journal_1.bin");
+
+  looper = new AudioLooper();
+  looper->begin();
+  journal = new SessionJournal(*looper);
+  journal->begin();
+  loopWork = journalPass;
+
+  // Every state the journal commits gets a reference lap, rendered once the
+  // journal has caught up with it
+  std::map<std::string, std::vector<int16_t>> references;
+  auto settle = [&]() {
+    while (!journal->isIdle()) step();
+    layer = -1;
+    references[looperKey()] = renderLap();
+  };
+
+  layer = 0;
+  looper->trigger(SampleClock::now());
+  for (size_t i = 0; i < loopBlocks; i++) step();
+  looper->trigger(SampleClock::now());
+  step();
+  runToLoopStart();
+  runToLoopStart(); // crossfade tail recorded
+  settle();
+  for (int n = 1; n < tracks; n++) {
+    layer = n;
+    looper->trigger(SampleClock::now());
+    step();
+    runToLoopStart();
+    looper->trigger(SampleClock::now());
+    step();
+    runToLoopStart();
+    runToLoopStart();
+    settle();
+  }
+  looper->setTrackVolume(1, 0.5f);
+  for (int i = 0; i < FADE_DURATION_BLOCKS + 2; i++) step();
+  settle();
+  looper->muteTrack(tracks - 1, true);
+  for (int i = 0; i < FADE_DURATION_BLOCKS + 2; i++) step();
+  settle();
+
+  SessionJournal::Stats stats = journal->getStats();
+  uint64_t finalSnapshot = 0;
+  for (int i = 0; i < looper->getTrackCount(); i++) {
+    finalSnapshot += looper->getTrack(i)->getStoredBlocks() * STORAGE_BLOCK_WORDS * 2;
+  }
+  printf("written : %lu commits, %lu blocks, %.1f KB journaled; full snapshot per commit %.1f KB (%.1fx), "
+         "final snapshot alone %.1f KB\n",
+         (unsigned long)stats.commits, (unsigned long)stats.blocks, stats.bytes / 1024.0,
+         stats.snapshotBytes / 1024.0, stats.bytes ? (double)stats.snapshotBytes / stats.bytes : 0.0,
+         finalSnapshot / 1024.0);
+
+  std::sort(updateMicros.begin(), updateMicros.end());
+  double sum = 0;
+  for (double us : updateMicros) sum += us;
+  printf("stall   : %zu update() calls with work at %g MB/s, sync %ld us: mean %.0f us, p99 %.0f us, worst %.0f us "
+         "(budget %d us, block %.0f us)\n",
+         updateMicros.size(), mbps, syncUs, updateMicros.empty() ? 0.0 : sum / updateMicros.size(),
+         updateMicros.empty() ? 0.0 : updateMicros[(size_t)(0.99 * (updateMicros.size() - 1))],
+         updateMicros.empty() ? 0.0 : updateMicros.back(), AUTOSAVE_BUDGET_US,
+         AUDIO_BLOCK_SAMPLES * 1e6 / AUDIO_SAMPLE_RATE_EXACT);
+
+  // Crash test: the journal as a power cut could leave it
+  delete journal;
+  journal = nullptr;
+  std::string path0 = SdFs::path("journal_0.bin"), path1 = SdFs::path("journal_1.bin");
+  std::vector<uint8_t> full = readFile(path1);
+  std::string written = path1;
+  if (full.empty()) {
+    full = readFile(path0);
+    written = path0;
+  }
+
+  std::vector<size_t> cuts;
+  for (int i = 0; i <= 40; i++) cuts.push_back(full.size() * i / 40);
+  for (size_t at = 1000; at < full.size(); at += full.size() / 7) cuts.push_back(at); // mid sector
+
+  int passed = 0, failed = 0;
+  double worstReplayUs = 0;
+  uint32_t noise = 12345;
+  for (size_t cut : cuts) {
+    for (int garbage = 0; garbage < 2; garbage++) {
+      std::vector<uint8_t> torn(full.begin(), full.begin() + cut);
+      // Garbage: a torn sector of stale data after the cut
+      for (int i = 0; garbage && i < 4096; i++) {
+        noise = noise * 1664525u + 1013904223u;
+        torn.push_back((uint8_t)(noise >> 24));
+      }
+      std::string expected = lastCommitKey(torn);
+
+      clearLooper();
+      for (int chip = 0; chip < 2; chip++) {
+        memset(BALibrary::BAHardware::chip(chip), 0x5A, BALibrary::BAHardware::SPI_MEM_SIZE_BYTES);
+      }
+      unlink(path0.c_str());
+      unlink(path1.c_str());
+      writeFile(written, torn.data(), torn.size());
+
+      SessionJournal reader(*looper);
+      bool restored = reader.beginRestore();
+      while (reader.isRestoring()) {
+        uint64_t start = HostClock::nanos();
+        reader.update();
+        worstReplayUs = std::max(worstReplayUs, (HostClock::nanos() - start) / 1e3);
+        step();
+      }
+      bool ok;
+      std::string got = "";
+      if (!restored) {
+        ok = expected.empty() || expected == "0";
+      } else {
+        runToLoopStart();
+        got = looperKey();
+        std::vector<int16_t> lap = renderLap();
+        ok = got == expected && references.count(got) && references[got] == lap;
+      }
+      if (ok) {
+        passed++;
+      } else {
+        failed++;
+        printf("  cut at %zu%s: expected [%s], restored [%s]\n", cut, garbage ? " + garbage" : "", expected.c_str(),
+               got.c_str());
+      }
+    }
+  }
+  printf("crash   : %d of %d cuts restored the last commit exactly; longest restore pass %.0f us\n", passed,
+         passed + failed, worstReplayUs);
+  return failed == 0 ? 0 : 1;
+}
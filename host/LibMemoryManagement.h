@@ -0,0 +1,6 @@
+#ifndef HOST_LIB_MEMORY_MANAGEMENT_H
+#define HOST_LIB_MEMORY_MANAGEMENT_H
+
+#include "BALibrary.h"
+
+#endif // HOST_LIB_MEMORY_MANAGEMENT_H
@@ -0,0 +1,195 @@
+// -------------------------------------------------------------------------
+// Benchmark for AudioLooper::update() on the host build (see README).
+// For every track count 1..NUM_LOOPS it scripts a session: record the base
+// loop, stack layers up to that count, play, overdub the top track for a
+// lap and undo/redo that pass, mute and unmute the layers through
+// updateSmartMute(), then reset. Every update() is timed and filed
+// under the phase it ran in.
+//
+//   looper_bench [--json] [--loop-blocks N] [--label text]
+//
+// Phases: record (new layer over the playing ones), play, xfade (the
+// crossfade blocks at the loop start), overdub (a lap overdubbing the top
+// track), undo (the blocks after an undo or redo of that pass, which drop
+// the read-ahead), fade (mute/unmute ramps), muted (a lap with every layer
+// muted, only the base loop audible), reset.
+// -------------------------------------------------------------------------
+
+#include "../AudioLooper.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// One audio block at the Teensy's sample rate, the ISR's hard deadline
+static const double BLOCK_DEADLINE_NS = AUDIO_BLOCK_SAMPLES * 1e9 / AUDIO_SAMPLE_RATE_EXACT;
+
+struct PhaseStats {
+  std::vector<double> ns;
+  uint64_t spiBytes = 0;
+  uint64_t allBytes = 0; // the read-ahead and storage work of loop() included
+};
+
+static AudioLooper* looper; // created after stderr is silenced
+static long blockNo = 0;
+static std::map<std::pair<int, std::string>, PhaseStats> results;
+
+// Runs one block and files its timing under `phase` (nullptr: not recorded)
+static void step(int tracks, const char* phase) {
+  uint64_t traffic = BALibrary::BASpiMemory::traffic;
+  uint64_t start = HostClock::nanos();
+  looper->update();
+  uint64_t elapsed = HostClock::nanos() - start;
+
+  // loop() side, not timed
+  looper->prefetch();
+  looper->updateStorage();
+  DeferredLog::drain();
+  blockNo++;
+
+  if (phase) {
+    std::string name = phase;
+    // The first blocks of every lap run the loop-boundary crossfade
+    // (the playhead has already moved on to the next block)
+    size_t timeline = looper->getTimeline();
+    if (name == "play" && timeline > 0 &&
+        (looper->getPlayhead() + timeline - AUDIO_BLOCK_SAMPLES) % timeline < FADE_DURATION_BLOCKS * AUDIO_BLOCK_SAMPLES) name = "xfade";
+    PhaseStats& stats = results[{ tracks, name }];
+    stats.ns.push_back((double)elapsed);
+    stats.spiBytes += looper->getSpiBytes();
+    stats.allBytes += BALibrary::BASpiMemory::traffic - traffic;
+  }
+}
+
+// Runs blocks until the looper reaches the next loop start
+static void runToLoopStart(int tracks, const char* phase) {
+  do {
+    step(tracks, phase);
+  } while (looper->getPlayhead() != 0);
+}
+
+static void session(int tracks, size_t loopBlocks) {
+  // Base loop
+  looper->trigger(SampleClock::now());
+  for (size_t i = 0; i < loopBlocks; i++) step(tracks, tracks == 1 ? "record" : nullptr);
+  looper->trigger(SampleClock::now());
+  step(tracks, nullptr);
+  runToLoopStart(tracks, nullptr);
+
+  // Layers: the last one is the measured "record" pass
+  for (int layer = 1; layer < tracks; layer++) {
+    looper->trigger(SampleClock::now());
+    step(tracks, nullptr);
+    const char* phase = layer == tracks - 1 ? "record" : nullptr;
+    runToLoopStart(tracks, phase);
+    looper->trigger(SampleClock::now());
+    step(tracks, phase);
+    runToLoopStart(tracks, phase);
+  }
+
+  // Everything playing, two laps
+  looper->updateSmartMute(1.0f);
+  runToLoopStart(tracks, "play");
+  runToLoopStart(tracks, "play");
+
+  // Overdub the top track for a lap, then undo and redo the pass
+  looper->overdubTrack(tracks - 1, true, SampleClock::now());
+  runToLoopStart(tracks, "overdub");
+  looper->overdubTrack(tracks - 1, false, SampleClock::now());
+  step(tracks, "overdub");
+  looper->undoOverdub(tracks - 1);
+  for (int i = 0; i < FADE_DURATION_BLOCKS + 1; i++) step(tracks, "undo");
+  looper->redoOverdub(tracks - 1);
+  for (int i = 0; i < FADE_DURATION_BLOCKS + 1; i++) step(tracks, "undo");
+  runToLoopStart(tracks, "play");
+
+  // Mute and unmute the layers
+  if (tracks > 1) {
+    looper->updateSmartMute(0.0f);
+    for (int i = 0; i < FADE_DURATION_BLOCKS + 1; i++) step(tracks, "fade");
+    runToLoopStart(tracks, "muted");
+    looper->updateSmartMute(1.0f);
+    for (int i = 0; i < FADE_DURATION_BLOCKS + 1; i++) step(tracks, "fade");
+  }
+  runToLoopStart(tracks, nullptr);
+
+  // Reset fade and clear
+  looper->reset();
+  do {
+    step(tracks, "reset");
+  } while (!looper->isIdle() || looper->isWaiting());
+  for (int i = 0; i < 4; i++) step(tracks, nullptr);
+}
+
+static double percentile(std::vector<double>& sorted, double p) {
+  size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+int main(int argc, char** argv) {
+  bool json = false;
+  size_t loopBlocks = 345; // about one second
+  std::string label = "";
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--json") json = true;
+    else if (arg == "--loop-blocks" && i + 1 < argc) loopBlocks = (size_t)atol(argv[++i]);
+    else if (arg == "--label" && i + 1 < argc) label = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--json] [--loop-blocks N] [--label text]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // Keep the looper's own LOG() chatter out of the report
+  if (!freopen("/dev/null", "w", stderr)) return 1;
+
+  HostAudio::source = [](int, int16_t* data) {
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      long n = blockNo * AUDIO_BLOCK_SAMPLES + i;
+      data[i] = (int16_t)(6000.0f * sinf(n * 0.0271f) + 2000.0f * sinf(n * 0.1937f));
+    }
+    return true;
+  };
+  HostAudio::sink = [](int, const int16_t*) {};
+
+  looper = new AudioLooper();
+  looper->begin();
+  for (int tracks = 1; tracks <= NUM_LOOPS; tracks++) {
+    session(tracks, loopBlocks);
+  }
+
+  if (json) {
+    printf("{\n  \"label\": \"%s\",\n  \"block_deadline_ns\": %.0f,\n  \"loop_blocks\": %zu,\n  \"results\": [",
+           label.c_str(), BLOCK_DEADLINE_NS, loopBlocks);
+  } else {
+    printf("%-6s %-7s %7s %10s %10s %10s %10s %10s %10s %9s\n",
+           "tracks", "phase", "blocks", "mean ns", "p50 ns", "p99 ns", "max ns", "spi B/blk", "all B/blk", "max/ddl");
+  }
+
+  bool first = true;
+  for (auto& entry : results) {
+    PhaseStats& stats = entry.second;
+    std::sort(stats.ns.begin(), stats.ns.end());
+    double sum = 0;
+    for (double ns : stats.ns) sum += ns;
+    double mean = sum / stats.ns.size();
+    double worst = stats.ns.back();
+    double spiPerBlock = (double)stats.spiBytes / stats.ns.size();
+    double allPerBlock = (double)stats.allBytes / stats.ns.size();
+
+    if (json) {
+      printf("%s\n    {\"tracks\": %d, \"phase\": \"%s\", \"blocks\": %zu, \"mean_ns\": %.0f, \"p50_ns\": %.0f, "
+             "\"p99_ns\": %.0f, \"max_ns\": %.0f, \"spi_bytes_per_block\": %.1f, \"all_spi_bytes_per_block\": %.1f}",
+             first ? "" : ",", entry.first.first, entry.first.second.c_str(), stats.ns.size(), mean,
+             percentile(stats.ns, 0.50), percentile(stats.ns, 0.99), worst, spiPerBlock, allPerBlock);
+    } else {
+      printf("%-6d %-7s %7zu %10.0f %10.0f %10.0f %10.0f %10.1f %10.1f %8.2f%%\n",
+             entry.first.first, entry.first.second.c_str(), stats.ns.size(), mean,
+             percentile(stats.ns, 0.50), percentile(stats.ns, 0.99), worst, spiPerBlock, allPerBlock,
+             100.0 * worst / BLOCK_DEADLINE_NS);
+    }
+    first = false;
+  }
+  if (json) printf("\n  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,265 @@
+// -------------------------------------------------------------------------
+// MIDI ingestion benchmark on the host build (see README).
+// Replays a MIDI byte stream through MidiParser and MidiClock twice:
+//   polled   : the old path, loop() reads at most one message per pass and
+//              stamps it when it gets to it
+//   captured : the MidiInput path, a timer interrupt stamps every byte on
+//              arrival; loop() takes in what came since the last tick and
+//              drains everything each pass
+// loop() is modelled with passes of a few tens of microseconds and an SD
+// flush sized stall every so often. Reports clock tick timestamp error and
+// interval jitter, the BPM MidiClock ends up with, CC handling latency and
+// parser throughput.
+//
+//   midi_bench [trace.txt] [--bpm N] [--seconds N] [--stall-ms N]
+//
+// A trace is one byte burst per line, "<arrival microseconds> <hex bytes...>",
+// '#' starts a comment. Without one a 31250 baud stream is synthesized:
+// clock at --bpm, a note pattern using running status, CC 10 every 4 s and
+// clock bytes landing inside other messages.
+// -------------------------------------------------------------------------
+
+#include "../MidiParser.h"
+#include "../MidiClock.h"
+#include <algorithm>
+#include <vector>
+
+struct Arrival {
+  double us;
+  uint8_t data;
+};
+
+struct Stats {
+  std::vector<double> values;
+
+  void add(double value) { values.push_back(value); }
+  double mean() const {
+    double sum = 0;
+    for (double v : values) sum += v;
+    return values.empty() ? 0 : sum / values.size();
+  }
+  double stddev() const {
+    double m = mean(), sum = 0;
+    for (double v : values) sum += (v - m) * (v - m);
+    return values.empty() ? 0 : sqrt(sum / values.size());
+  }
+  double worst() const {
+    double w = 0;
+    for (double v : values) w = std::max(w, fabs(v));
+    return w;
+  }
+};
+
+struct Result {
+  Stats tickError;    // stamp - arrival of every clock byte, us
+  Stats tickInterval; // stamped interval - true interval, us
+  Stats ccLatency;    // handled - arrival of every CC, us
+  float bpm = 0;
+};
+
+static uint32_t seed = 12345;
+static double randomUnit() {
+  seed = seed * 1664525u + 1013904223u;
+  return (seed >> 8) / 16777216.0;
+}
+
+static uint32_t toSamples(double us) { return (uint32_t)(us * SAMPLE_RATE / 1e6 + 0.5); }
+
+static std::vector<Arrival> loadTrace(const char* path) {
+  std::vector<Arrival> stream;
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    exit(1);
+  }
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    char* hash = strchr(line, '#');
+    if (hash) *hash = 0;
+    char* cursor = line;
+    char* end;
+    double us = strtod(cursor, &end);
+    if (end == cursor) continue;
+    cursor = end;
+    while (true) {
+      long value = strtol(cursor, &end, 16);
+      if (end == cursor) break;
+      stream.push_back({ us, (uint8_t)value });
+      cursor = end;
+    }
+  }
+  fclose(file);
+  return stream;
+}
+
+// Bytes as they come off a 31250 baud wire, 320 us each
+static std::vector<Arrival> synthesize(double bpm, double seconds) {
+  const double byteUs = 320.0;
+  std::vector<std::pair<double, std::vector<uint8_t>>> sends;
+
+  double tickUs = 60e6 / (bpm * MidiClock::TICKS_PER_BEAT);
+  for (double t = 0; t < seconds * 1e6; t += tickUs) sends.push_back({ t, { MIDI_STATUS_CLOCK } });
+  for (double t = 1000; t < seconds * 1e6; t += tickUs * 6) {
+    // Running status: only the first note of a pair sends the status byte
+    uint8_t note = 48 + (uint8_t)(randomUnit() * 24);
+    sends.push_back({ t + tickUs * 0.5, { MIDI_STATUS_NOTE_ON, note, 100, (uint8_t)(note + 7), 90 } });
+  }
+  for (double t = 2e6; t < seconds * 1e6; t += 4e6) {
+    sends.push_back({ t - 200, { MIDI_STATUS_CONTROL_CHANGE, 10, 127 } });
+  }
+  std::stable_sort(sends.begin(), sends.end(),
+                   [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  // Serialize; a clock byte that comes due mid-message goes out between its bytes
+  std::vector<Arrival> stream;
+  double wire = 0;
+  for (auto& send : sends) {
+    if (send.second[0] == MIDI_STATUS_CLOCK && !stream.empty() && send.first < wire) {
+      size_t last = stream.size() - 1;
+      stream.insert(stream.begin() + last, { stream[last].us, MIDI_STATUS_CLOCK });
+      for (size_t i = last + 1; i < stream.size(); i++) stream[i].us += byteUs;
+      wire += byteUs;
+      continue;
+    }
+    wire = std::max(wire, send.first);
+    for (uint8_t data : send.second) {
+      wire += byteUs;
+      stream.push_back({ wire, data });
+    }
+  }
+  return stream;
+}
+
+static double nextStall;
+
+// Time of the next loop() pass after `us`
+static double nextPass(double us, double stallMs) {
+  double pass = 20.0 + randomUnit() * 80.0;
+  if (us >= nextStall) {
+    pass += stallMs * 1000.0 * (0.2 + 0.8 * randomUnit()); // SD flush
+    nextStall = us + 50000.0 + randomUnit() * 100000.0;
+  }
+  return us + pass;
+}
+
+static void handle(const MidiParser::Message& message, double arrivalUs, double handledUs, double stampUs,
+                   MidiClock& clock, Result& result, double& lastStamp, double& lastArrival) {
+  if (message.status == MIDI_STATUS_CLOCK) {
+    clock.handleClock(toSamples(stampUs));
+    result.tickError.add(stampUs - arrivalUs);
+    if (lastStamp >= 0) result.tickInterval.add((stampUs - lastStamp) - (arrivalUs - lastArrival));
+    lastStamp = stampUs;
+    lastArrival = arrivalUs;
+  } else if (message.type() == MIDI_STATUS_CONTROL_CHANGE) {
+    result.ccLatency.add(handledUs - arrivalUs);
+  }
+}
+
+static Result runPolled(const std::vector<Arrival>& stream, double stallMs) {
+  Result result;
+  MidiClock clock;
+  MidiParser parser;
+  MidiParser::Message message;
+  double lastStamp = -1, lastArrival = 0;
+  double now = 0;
+  size_t next = 0;
+  seed = 777;
+  nextStall = 0;
+  while (next < stream.size()) {
+    now = nextPass(now, stallMs);
+    // One message per pass, stamped now
+    while (next < stream.size() && stream[next].us <= now) {
+      const Arrival& byte = stream[next++];
+      if (parser.parse(byte.data, 0, message)) {
+        handle(message, byte.us, now, now, clock, result, lastStamp, lastArrival);
+        break;
+      }
+    }
+  }
+  result.bpm = clock.getBpm();
+  return result;
+}
+
+static Result runCaptured(const std::vector<Arrival>& stream, double stallMs) {
+  Result result;
+  MidiClock clock;
+  MidiParser parser;
+  MidiParser::Message message;
+  double lastStamp = -1, lastArrival = 0;
+  double now = 0;
+  size_t next = 0;
+  seed = 777;
+  nextStall = 0;
+  while (next < stream.size()) {
+    now = nextPass(now, stallMs);
+    // Everything arrived so far, stamped at the timer tick that caught it,
+    // or now if loop() got to it before the next tick
+    while (next < stream.size() && stream[next].us <= now) {
+      const Arrival& byte = stream[next++];
+      double captured = std::min(ceil(byte.us / MIDI_POLL_US) * MIDI_POLL_US, now);
+      if (parser.parse(byte.data, toSamples(captured), message)) {
+        double stampUs = message.sample * 1e6 / SAMPLE_RATE;
+        handle(message, byte.us, now, stampUs, clock, result, lastStamp, lastArrival);
+      }
+    }
+  }
+  result.bpm = clock.getBpm();
+  return result;
+}
+
+static double parserNsPerByte(const std::vector<Arrival>& stream) {
+  MidiParser parser;
+  MidiParser::Message message;
+  uint32_t messages = 0;
+  const int rounds = 50;
+  uint64_t start = HostClock::nanos();
+  for (int r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < stream.size(); i++) {
+      if (parser.parse(stream[i].data, (uint32_t)i, message)) messages++;
+    }
+  }
+  uint64_t elapsed = HostClock::nanos() - start;
+  if (messages == 0) printf("(no messages parsed)\n");
+  return (double)elapsed / (rounds * stream.size());
+}
+
+static void report(const char* name, const Result& result, double bpm) {
+  printf("%-9s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.3f\n", name,
+         result.tickError.mean(), result.tickError.worst(),
+         result.tickInterval.stddev(), result.tickInterval.worst(),
+         result.ccLatency.mean(), result.ccLatency.worst(),
+         bpm > 0 ? result.bpm - bpm : result.bpm);
+}
+
+int main(int argc, char** argv) {
+  const char* trace = nullptr;
+  double bpm = 120.0, seconds = 60.0, stallMs = 8.0;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--bpm" && i + 1 < argc) bpm = atof(argv[++i]);
+    else if (arg == "--seconds" && i + 1 < argc) seconds = atof(argv[++i]);
+    else if (arg == "--stall-ms" && i + 1 < argc) stallMs = atof(argv[++i]);
+    else if (arg[0] != '-' && !trace) trace = argv[i];
+    else {
+      fprintf(stderr, "usage: %s [trace.txt] [--bpm N] [--seconds N] [--stall-ms N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<Arrival> stream = trace ? loadTrace(trace) : synthesize(bpm, seconds);
+  if (stream.empty()) {
+    fprintf(stderr, "empty stream\n");
+    return 1;
+  }
+  if (trace) bpm = 0; // unknown, the BPM column shows the estimate itself
+
+  printf("%zu bytes over %.1f s, loop() stalls up to %.1f ms, capture every %d us\n",
+         stream.size(), stream.back().us / 1e6, stallMs, MIDI_POLL_US);
+  printf("%-9s %9s %9s %9s %9s %9s %9s %9s\n", "", "tick err", "tick max", "ivl sd", "ivl max",
+         "cc lat", "cc max", trace ? "bpm" : "bpm err");
+  printf("%-9s %9s %9s %9s %9s %9s %9s %9s\n", "", "us", "us", "us", "us", "us", "us", "");
+  report("polled", runPolled(stream, stallMs), bpm);
+  report("captured", runCaptured(stream, stallMs), bpm);
+  printf("parser %.1f ns/byte\n", parserNsPerByte(stream));
+  return 0;
+}
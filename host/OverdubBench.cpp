@@ -0,0 +1,176 @@
+// -------------------------------------------------------------------------
+// Overdub undo/redo benchmark on the host build (see README).
+// Records a base loop, then overdubs it pass after pass, each over a
+// different half of the loop, rendering one reference lap after every pass.
+// Reports:
+//   undo   : every undo and redo against the reference lap it must bring
+//            back, sample by sample, down to the oldest pass still undoable
+//   fold   : passes past OVERDUB_UNDO_LEVELS folded into the loop by
+//            updateStorage(), and the lap unchanged by it
+//   memory : SPI RAM pages holding copies against the blocks overdubbed
+//   lookup : ns per OverdubMap::find() with 0..N passes on a page, and
+//            AudioLooper::update() per block with and without passes
+//
+//   overdub_bench [--loop-blocks N] [--passes N]
+// -------------------------------------------------------------------------
+
+#include "BenchHarness.h"
+#include <algorithm>
+
+// Runs until the block holding loop sample `sample` is next
+static void runToPlayhead(size_t sample) {
+  while (sample < looper->getPlayhead() || sample >= looper->getPlayhead() + AUDIO_BLOCK_SAMPLES) step();
+}
+
+static size_t differ(const std::vector<int16_t>& a, const std::vector<int16_t>& b) {
+  if (a.size() != b.size()) return std::max(a.size(), b.size());
+  size_t count = 0;
+  for (size_t i = 0; i < a.size(); i++) count += a[i] != b[i];
+  return count;
+}
+
+// Mean ns per AudioLooper::update() over one lap
+static double lapNanos() {
+  runToLoopStart();
+  uint64_t total = 0;
+  long blocks = 0;
+  bool end;
+  do {
+    end = step();
+    total += updateNanos;
+    blocks++;
+  } while (!end);
+  return (double)total / blocks;
+}
+
+// ns per find() over every block of a map with `passes` passes on each page
+static double findNanos(int passes) {
+  static OverdubMap map; // large, keep it off the stack
+  static PageAllocator pager;
+  map.clear(&pager);
+  pager.reset();
+  const size_t blocks = 16 * PAGE_BLOCKS;
+  for (int p = 0; p < passes; p++) {
+    map.beginPass(&pager);
+    for (size_t block = 0; block < blocks; block++) {
+      if ((block + p) % (p + 2) == 0) map.writePage(block, &pager);
+    }
+  }
+  uint64_t sum = 0;
+  const int rounds = 2000;
+  uint64_t start = HostClock::nanos();
+  for (int r = 0; r < rounds; r++) {
+    for (size_t block = 0; block < blocks; block++) sum += map.find(block);
+  }
+  uint64_t took = HostClock::nanos() - start;
+  if (sum == 1) printf(" "); // keep the lookups
+  return (double)took / (rounds * blocks);
+}
+
+int main(int argc, char** argv) {
+  size_t loopBlocks = 345 * 2;
+  int passes = OVERDUB_UNDO_LEVELS + 2;
+  if (!parseOptions(argc, argv, { { "--loop-blocks", loopBlocks }, { "--passes", passes } })) return 1;
+  if (passes < 1) passes = 1;
+  if (loopBlocks < 16) loopBlocks = 16;
+  if (!beginBench("overdub_bench_data", 3000.0f)) return 1;
+
+  looper = new AudioLooper();
+  looper->begin();
+
+  looper->trigger(SampleClock::now());
+  for (size_t i = 0; i < loopBlocks; i++) step();
+  looper->trigger(SampleClock::now());
+  step();
+  runToLoopStart();
+  runToLoopStart(); // crossfade tail recorded
+  layer = -1;
+  double plainNanos = lapNanos();
+
+  // Pass k overdubs half the loop, starting k/8 of the way in, 37 samples off the block grid
+  std::vector<std::vector<int16_t>> laps;
+  laps.push_back(renderLap());
+  size_t loop = looper->getTimeline();
+  int peakPages = 0;
+  for (int k = 1; k <= passes; k++) {
+    size_t from = (loop * (k % 8) / 8) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+    size_t to = (from + loop / 2) % loop / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+    runToLoopStart();
+    runToPlayhead(from);
+    layer = k;
+    looper->overdubTrack(0, true, SampleClock::now() + 37);
+    step();
+    runToPlayhead(to);
+    looper->overdubTrack(0, false, SampleClock::now() + 37);
+    layer = -1;
+    for (int i = 0; i < FADE_DURATION_BLOCKS + 2; i++) step();
+    laps.push_back(renderLap());
+    peakPages = std::max(peakPages, looper->getOverdubPages());
+  }
+
+  // Undo down to the oldest undoable pass, then redo back up
+  int undoable = std::min(passes, OVERDUB_UNDO_LEVELS);
+  int checks = 0, failures = 0;
+  for (int n = 1; n <= undoable + 1; n++) {
+    looper->undoOverdub(0);
+    step();
+    int expect = std::max(passes - n, passes - undoable);
+    size_t bad = differ(renderLap(), laps[expect]);
+    checks++;
+    if (bad) {
+      failures++;
+      printf("  undo %d: lap differs from pass %d in %zu samples\n", n, expect, bad);
+    }
+  }
+  for (int n = 1; n <= undoable + 1; n++) {
+    looper->redoOverdub(0);
+    step();
+    int expect = std::min(passes - undoable + n, passes);
+    size_t bad = differ(renderLap(), laps[expect]);
+    checks++;
+    if (bad) {
+      failures++;
+      printf("  redo %d: lap differs from pass %d in %zu samples\n", n, expect, bad);
+    }
+  }
+  printf("undo   : %d passes, %d undoable, %d of %d undo/redo laps match their reference exactly\n", passes, undoable,
+         checks - failures, checks);
+
+  // Folding: by now updateStorage() has had whole laps to fold the old passes in
+  double historyNanos = lapNanos();
+  size_t bad = differ(renderLap(), laps[passes]);
+  if (bad) failures++;
+  int kept = looper->getOverdubPages();
+  printf("fold   : %d passes folded into the loop, lap %s; copies peaked at %d pages, %d kept\n",
+         std::max(0, passes - OVERDUB_UNDO_LEVELS), bad ? "CHANGED" : "unchanged", peakPages, kept);
+  size_t keptBlocks = (size_t)undoable * (loop / 2 / AUDIO_BLOCK_SAMPLES + 1);
+
+  // A new pass after an undo drops the undone one
+  looper->undoOverdub(0);
+  step();
+  runToLoopStart();
+  layer = passes + 1;
+  looper->overdubTrack(0, true, SampleClock::now());
+  step();
+  runToPlayhead(loop / 4 / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES);
+  looper->overdubTrack(0, false, SampleClock::now());
+  layer = -1;
+  for (int i = 0; i < FADE_DURATION_BLOCKS + 2; i++) step();
+  std::vector<int16_t> branch = renderLap();
+  looper->redoOverdub(0);
+  step();
+  bad = differ(renderLap(), branch);
+  if (bad) failures++;
+  printf("branch : redo after a new pass %s\n", bad ? "CHANGED the lap" : "does nothing, as it should");
+
+  printf("memory : %d pages (%d KB) of copies for the %d undoable passes, %zu blocks (%zu KB) overdubbed; "
+         "a copy of the loop per pass would take %zu KB\n",
+         kept, kept * PAGE_WORDS * 2 / 1024, undoable, keptBlocks, keptBlocks * STORAGE_BLOCK_WORDS * 2 / 1024,
+         undoable * (loop / AUDIO_BLOCK_SAMPLES + 1) * STORAGE_BLOCK_WORDS * 2 / 1024);
+
+  printf("lookup : find() per block:");
+  for (int p = 0; p <= OVERDUB_UNDO_LEVELS + 1; p++) printf(" %d passes %.1f ns%s", p, findNanos(p), p <= OVERDUB_UNDO_LEVELS ? "," : "");
+  printf("\n         update() per block: %.0f ns without passes, %.0f ns with %d kept\n", plainNanos, historyNanos,
+         std::min(passes, OVERDUB_UNDO_LEVELS));
+  return failures == 0 ? 0 : 1;
+}
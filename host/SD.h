@@ -0,0 +1,163 @@
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+// -------------------------------------------------------------------------
+// Host stand-in for the Teensy SD library, backed by <data dir>/sd/.
+// FsFile mirrors the SdFat calls MemorySd streams through. File and
+// SD.open() only cover directory listing.
+// -------------------------------------------------------------------------
+
+#include <Arduino.h>
+#include <BALibrary.h>
+#include <dirent.h>
+#include <vector>
+
+#define FILE_READ 0
+#define FILE_WRITE 1
+
+class FsFile {
+public:
+  FsFile() {}
+  FsFile(const FsFile&) = delete;
+  FsFile& operator=(const FsFile&) = delete;
+  FsFile(FsFile&& other) : fd(other.fd) { other.fd = -1; }
+  FsFile& operator=(FsFile&& other) {
+    if (this != &other) {
+      close();
+      fd = other.fd;
+      other.fd = -1;
+    }
+    return *this;
+  }
+  ~FsFile() { close(); }
+
+  bool open(const char* path, int oflag) {
+    close();
+    fd = ::open(path, oflag, 0644);
+    return fd >= 0;
+  }
+
+  explicit operator bool() const { return fd >= 0; }
+  bool isOpen() const { return fd >= 0; }
+
+  int read(void* buffer, size_t count) {
+    HostStorage::sdDelay(count);
+    return (int)::read(fd, buffer, count);
+  }
+  size_t write(const void* buffer, size_t count) {
+    HostStorage::sdDelay(count);
+    ssize_t written = ::write(fd, buffer, count);
+    return written < 0 ? 0 : (size_t)written;
+  }
+
+  bool seekSet(uint64_t position) { return lseek(fd, (off_t)position, SEEK_SET) == (off_t)position; }
+  uint64_t curPosition() const { return (uint64_t)lseek(fd, 0, SEEK_CUR); }
+  uint64_t fileSize() const {
+    struct stat info;
+    return fstat(fd, &info) == 0 ? (uint64_t)info.st_size : 0;
+  }
+
+  // Reserves blocks without changing the logical size, like SdFat
+  bool preAllocate(uint64_t length) { return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)length) == 0; }
+  bool truncate(uint64_t length) { return ftruncate(fd, (off_t)length) == 0; }
+  bool flush() {
+    HostStorage::sdDelay(0, true);
+    return fsync(fd) == 0;
+  }
+  bool sync() { return flush(); }
+
+  bool close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    return true;
+  }
+
+private:
+  int fd = -1;
+};
+
+// Directory iteration only (SD.open("/") then openNextFile())
+class File {
+public:
+  explicit operator bool() const { return valid; }
+  const char* name() const { return fileName.c_str(); }
+  bool isDirectory() const { return directory; }
+  void close() {}
+
+  File openNextFile() {
+    File next;
+    if (nextEntry < entries.size()) {
+      next = entries[nextEntry++];
+    }
+    return next;
+  }
+
+private:
+  friend class SDClass;
+  bool valid = false;
+  bool directory = false;
+  std::string fileName;
+  std::vector<File> entries;
+  size_t nextEntry = 0;
+};
+
+class SdFs {
+public:
+  FsFile open(const char* name, int oflag) {
+    FsFile file;
+    file.open(path(name).c_str(), oflag);
+    return file;
+  }
+
+  static std::string path(const char* name) {
+    std::string root = HostStorage::dataDir() + "/sd";
+    mkdir(root.c_str(), 0755);
+    while (*name == '/') name++;
+    return *name ? root + "/" + name : root;
+  }
+};
+
+class SDClass {
+public:
+  SdFs sdfs;
+
+  bool begin(uint8_t) { return SdFs::path("").size() > 0; }
+
+  bool exists(const char* name) {
+    struct stat info;
+    return stat(SdFs::path(name).c_str(), &info) == 0;
+  }
+
+  bool remove(const char* name) { return unlink(SdFs::path(name).c_str()) == 0; }
+
+  File open(const char* name, int mode = FILE_READ) {
+    (void)mode;
+    File file;
+    std::string fullPath = SdFs::path(name);
+    struct stat info;
+    if (stat(fullPath.c_str(), &info) != 0) return file;
+
+    file.valid = true;
+    file.fileName = name;
+    file.directory = S_ISDIR(info.st_mode);
+    if (file.directory) {
+      DIR* dir = opendir(fullPath.c_str());
+      while (dir) {
+        struct dirent* entry = readdir(dir);
+        if (!entry) break;
+        if (entry->d_name[0] == '.') continue;
+        File child;
+        child.valid = true;
+        child.fileName = entry->d_name;
+        child.directory = entry->d_type == DT_DIR;
+        file.entries.push_back(child);
+      }
+      if (dir) closedir(dir);
+    }
+    return file;
+  }
+};
+
+inline SDClass SD;
+
+#endif // HOST_SD_H
@@ -0,0 +1,143 @@
+// -------------------------------------------------------------------------
+// Session save/restore benchmark on the host build (see README).
+// Records a base loop and layers, renders one reference lap, saves the
+// session with SessionStore, then wipes SPI RAM as a power cycle would and
+// restores it. SD speed is modelled: each audio block, SessionStore::update()
+// runs as many bursts as the modelled card moves in one block period.
+// Reports, against loading every block before playing:
+//   first audio : SD time and bytes read until the base loop is queued, and
+//                 the block it is first heard in
+//   full restore: audio time until every layer is in, throughput, and
+//                 blocks played before their data arrived (underruns)
+//   match       : the restored lap against the reference, sample by sample
+// Host wall time spent in SessionStore is printed too, though with the page
+// cache behind it this says little about a card.
+//
+//   session_bench [--loop-blocks N] [--tracks N] [--sd-mbps X]
+// -------------------------------------------------------------------------
+
+#include "BenchHarness.h"
+#include "../SessionStore.h"
+
+static const double BLOCK_SECONDS = AUDIO_BLOCK_SAMPLES / AUDIO_SAMPLE_RATE_EXACT;
+
+static SessionStore* session;
+static uint64_t sdBytes = 0;        // moved by SessionStore::update() so far
+static uint64_t firstAudioBytes = 0; // read when the base loop was queued
+
+// Runs SessionStore::update() for one block period of modelled SD time
+static void sdPasses(double mbps, double& hostSeconds, double& credit) {
+  credit += BLOCK_SECONDS;
+  while (session->isBusy() && credit > 0) {
+    uint32_t before = session->getBytes();
+    uint64_t start = HostClock::nanos();
+    session->update();
+    hostSeconds += (HostClock::nanos() - start) / 1e9;
+    uint32_t bytes = session->getBytes() - before;
+    sdBytes += bytes;
+    credit -= bytes / (mbps * 1e6);
+    if (session->isRestoring() && firstAudioBytes == 0 && session->getFirstAudioMicros() > 0) firstAudioBytes = sdBytes;
+    if (bytes == 0) break;
+  }
+  if (credit > 0) credit = 0; // idle time does not bank
+}
+
+int main(int argc, char** argv) {
+  size_t loopBlocks = 345 * 4; // about four seconds
+  int tracks = 4;
+  double mbps = 20.0; // sequential read/write of a decent card through SDIO
+  if (!parseOptions(argc, argv, { { "--loop-blocks", loopBlocks }, { "--tracks", tracks }, { "--sd-mbps", mbps } })) {
+    return 1;
+  }
+  if (tracks < 1 || tracks > NUM_LOOPS) tracks = NUM_LOOPS;
+  if (!beginBench("session_bench_data", 4000.0f)) return 1;
+
+  looper = new AudioLooper();
+  session = new SessionStore(*looper);
+  looper->begin();
+
+  // Base loop and layers
+  looper->trigger(SampleClock::now());
+  for (size_t i = 0; i < loopBlocks; i++) step();
+  looper->trigger(SampleClock::now());
+  step();
+  runToLoopStart();
+  for (layer = 1; layer < tracks; layer++) {
+    looper->trigger(SampleClock::now());
+    step();
+    runToLoopStart();
+    looper->trigger(SampleClock::now());
+    step();
+    runToLoopStart();
+  }
+  layer = -1;
+  std::vector<int16_t> reference = renderLap();
+
+  // Save while playing
+  double hostSeconds = 0, credit = 0;
+  long saveBlocks = 0;
+  session->save();
+  while (session->isBusy()) {
+    step();
+    sdPasses(mbps, hostSeconds, credit);
+    saveBlocks++;
+  }
+  uint32_t savedBytes = session->getBytes();
+  printf("save     : %d tracks, %.1f KB in %ld blocks (%.0f ms audio time at %.2f MB/s), host %.2f ms\n", tracks,
+         savedBytes / 1024.0, saveBlocks, saveBlocks * BLOCK_SECONDS * 1e3, mbps, hostSeconds * 1e3);
+
+  // Power cycle: clear the looper and scribble over SPI RAM
+  looper->reset();
+  do {
+    step();
+  } while (!looper->isIdle() || looper->isWaiting());
+  for (int chip = 0; chip < 2; chip++) {
+    memset(BALibrary::BAHardware::chip(chip), 0x5A, BALibrary::BAHardware::SPI_MEM_SIZE_BYTES);
+  }
+  step();
+
+  // Restore, one block per iteration
+  hostSeconds = 0;
+  credit = 0;
+  uint64_t start = HostClock::nanos();
+  if (!session->beginRestore()) {
+    printf("restore failed to start\n");
+    return 1;
+  }
+  hostSeconds += (HostClock::nanos() - start) / 1e9;
+  sdBytes = 0;
+  long blocks = 0, firstAudioBlock = -1;
+  while (session->isBusy()) {
+    sdPasses(mbps, hostSeconds, credit);
+    step();
+    blocks++;
+    if (firstAudioBlock < 0 && looper->isPlaying()) firstAudioBlock = blocks;
+  }
+  // The header sector is read before the first burst
+  uint32_t totalBytes = session->getBytes() + SD_SECTOR_BYTES;
+  firstAudioBytes += SD_SECTOR_BYTES;
+
+  printf("restore  : first audio after %.2f ms of SD (%.1f KB), audible in block %ld; loading everything first: %.0f ms\n",
+         firstAudioBytes / (mbps * 1e6) * 1e3, firstAudioBytes / 1024.0, firstAudioBlock,
+         totalBytes / (mbps * 1e6) * 1e3);
+  printf("           full restore after %ld blocks (%.0f ms), %.1f KB, %.2f MB/s over audio time, %lu underruns\n",
+         blocks, blocks * BLOCK_SECONDS * 1e3, totalBytes / 1024.0, totalBytes / (blocks * BLOCK_SECONDS) / 1e6,
+         (unsigned long)looper->getRestoreUnderruns());
+  printf("           host %.2f ms in SessionStore (%.0f MB/s), %.3f ms to first audio\n", hostSeconds * 1e3,
+         hostSeconds > 0 ? totalBytes / hostSeconds / 1e6 : 0.0, session->getFirstAudioMicros() / 1e3);
+
+  // Layers join at a loop start; the lap after that has everything
+  runToLoopStart();
+  std::vector<int16_t> restored = renderLap();
+  size_t differ = 0;
+  int worst = 0;
+  size_t count = std::min(reference.size(), restored.size());
+  for (size_t i = 0; i < count; i++) {
+    int diff = abs(reference[i] - restored[i]);
+    if (diff > 0) differ++;
+    if (diff > worst) worst = diff;
+  }
+  printf("match    : lap of %zu samples (reference %zu), %zu differ, worst %d\n", restored.size(), reference.size(),
+         differ, worst);
+  return differ == 0 && restored.size() == reference.size() ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+// -------------------------------------------------------------------------
+// SD spill benchmark on the host build (see README).
+// Two sessions, each played for two laps with the autosave journal running:
+//   a base loop longer than SPI RAM, its end spilled to SD
+//   a base loop and a layer on every other track, sized so that SPI RAM
+//   runs out halfway through the last layer, which spills
+// A recording needs a free page to start, so once a spill has taken the
+// last of SPI RAM no other track can record: one track spills at a time.
+// Audio runs on a simulated clock: a block falls due every 2.9 ms and runs
+// as soon as the clock passes it, in the middle of a loop() pass if that is
+// where it lands. The clock moves on by the modelled SD time of every read,
+// write and sync (--sd-mbps, --latency-us, --sync-us), plus --pass-us for
+// the rest of each loop() pass; an idle loop() waits for the next block.
+// Reports:
+//   sd      : simulated time, how much of it the card was busy, and the
+//             longest loop() pass against the time the spill rings cover
+//   spill   : blocks that missed the SD stream, per phase; must be 0
+//             (--spill-blocks sets how far the first base loop spills)
+//
+//   spill_bench [--spill-blocks N] [--tracks N] [--sd-mbps X] [--latency-us N]
+//               [--sync-us N] [--pass-us X]
+// -------------------------------------------------------------------------
+
+#include "BenchHarness.h"
+#include "../SessionJournal.h"
+#include <algorithm>
+
+static const double BLOCK_US = AUDIO_BLOCK_SAMPLES * 1e6 / AUDIO_SAMPLE_RATE_EXACT;
+
+static SessionJournal* journal;
+
+// Simulated time, in us
+static double nowUs = 0, nextBlockUs = 0;
+static double sdBusyUs = 0, worstPassUs = 0;
+static double passUs = 100;
+static double passStartUs = 0;
+
+// Moves the clock on, running the blocks that fall due as the audio ISR would
+static void advance(double us) {
+  nowUs += us;
+  while (nextBlockUs <= nowUs) {
+    audioBlock();
+    nextBlockUs += BLOCK_US;
+  }
+}
+
+// One loop() pass
+static void pass() {
+  passStartUs = nowUs;
+  double busy = sdBusyUs;
+  looper->prefetch();
+  looper->updateStorage();
+  journal->update();
+  DeferredLog::drain();
+  advance(passUs);
+  worstPassUs = std::max(worstPassUs, nowUs - passStartUs);
+  // Nothing went to the card: no new work until the next block
+  if (sdBusyUs == busy && nowUs < nextBlockUs) advance(nextBlockUs - nowUs);
+}
+
+static void passBlocks(long blocks) {
+  long until = blockNo + blocks;
+  while (blockNo < until) pass();
+}
+
+static void passToLoopStart() {
+  loopStarted = false;
+  while (!loopStarted) pass();
+}
+
+static void recordBase(long blocks) {
+  layer = 0;
+  looper->trigger(SampleClock::now());
+  passBlocks(blocks);
+  looper->trigger(SampleClock::now());
+  passBlocks(1);
+  layer = -1;
+  passToLoopStart();
+  passToLoopStart(); // crossfade tail recorded
+}
+
+static void recordLayer(int tone) {
+  layer = tone;
+  looper->trigger(SampleClock::now());
+  passBlocks(1);
+  passToLoopStart();
+  looper->trigger(SampleClock::now());
+  passBlocks(1);
+  layer = -1;
+  passToLoopStart();
+  passToLoopStart();
+}
+
+// Underruns over one phase of the session
+static uint32_t report(const char* name, uint32_t& last) {
+  uint32_t total = looper->getSpillUnderruns();
+  printf("  %-22s: %u blocks missed\n", name, total - last);
+  uint32_t missed = total - last;
+  last = total;
+  return missed;
+}
+
+int main(int argc, char** argv) {
+  long spillBlocks = 345 * 30;
+  int tracks = NUM_LOOPS;
+  double mbps = 20;
+  long latencyUs = 250;
+  long syncUs = 2000;
+  if (!parseOptions(argc, argv,
+                    { { "--spill-blocks", spillBlocks }, { "--tracks", tracks }, { "--sd-mbps", mbps },
+                      { "--latency-us", latencyUs }, { "--sync-us", syncUs }, { "--pass-us", passUs } })) {
+    return 1;
+  }
+  if (tracks < 2 || tracks > NUM_LOOPS) tracks = NUM_LOOPS;
+  if (spillBlocks < 16) spillBlocks = 16;
+
+  setenv("LOOPER_HOST_SD_MBPS", std::to_string(mbps).c_str(), 1);
+  setenv("LOOPER_HOST_SD_LATENCY_US", std::to_string(latencyUs).c_str(), 1);
+  setenv("LOOPER_HOST_SD_SYNC_US", std::to_string(syncUs).c_str(), 1);
+  if (!beginBench("spill_bench_data", 3000.0f)) return 1;
+  SD.remove("journal_0.bin");
+  SD.remove("journal_1.bin");
+
+  HostStorage::sdClock = [](double us) {
+    sdBusyUs += us;
+    advance(us);
+    // A card slower than the streams keeps one flush going for ever
+    if (nowUs - passStartUs > 10e6) {
+      printf("sd     : one loop() pass has run for 10 s, the card cannot keep up (%u blocks missed)\n",
+             looper->getSpillUnderruns());
+      exit(1);
+    }
+  };
+
+  looper = new AudioLooper();
+  looper->begin();
+  journal = new SessionJournal(*looper);
+  journal->begin();
+
+  uint32_t last = 0, missed = 0;
+  long ramBlocks = (long)looper->getFreePages() * PAGE_BLOCKS;
+  printf("spill  :\n");
+
+  // Base loop: SPI RAM fills up and the rest of it goes to SD
+  recordBase(ramBlocks + spillBlocks);
+  missed += report("spilled base, recorded", last);
+  passToLoopStart();
+  passToLoopStart();
+  missed += report("spilled base, 2 laps", last);
+
+  // Layers: SPI RAM runs out in the last one
+  looper->reset();
+  passBlocks(FADE_DURATION_BLOCKS + 2);
+  recordBase(ramBlocks * 2 / (2 * tracks - 1));
+  for (int n = 1; n < tracks; n++) recordLayer(n);
+  int spilled = -1;
+  for (int n = 0; n < tracks; n++) {
+    if (looper->getTrack(n)->isSpilled()) spilled = n;
+  }
+  char name[40];
+  snprintf(name, sizeof(name), "%d tracks, recorded", looper->getTrackCount());
+  missed += report(name, last);
+  passToLoopStart();
+  passToLoopStart();
+  snprintf(name, sizeof(name), "%d tracks, 2 laps", looper->getTrackCount());
+  missed += report(name, last);
+  printf("  track %d spilled\n", spilled);
+
+  printf("sd     : %.1f s simulated, card busy %.1f%% of it; longest loop() pass %.1f ms, "
+         "the spill rings cover %.0f ms\n",
+         nowUs / 1e6, 100.0 * sdBusyUs / nowUs, worstPassUs / 1e3, SPILL_RING_BLOCKS * BLOCK_US / 1e3);
+  return missed == 0 ? 0 : 1;
+}
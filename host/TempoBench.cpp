@@ -0,0 +1,189 @@
+// -------------------------------------------------------------------------
+// Tempo estimator benchmark on the host build (see README).
+// Feeds MIDI clock tick times to TempoEstimator and to the previous
+// estimator (one-beat window smoothed 0.9/0.1) and reports, per trace:
+//   converge : ticks until the BPM stays within 0.5% for a whole beat,
+//              counted from the start or from the tempo change
+//   err      : mean and worst |BPM error| from the second beat on
+//   pred     : RMS error of the predicted next tick, in samples
+// Synthetic traces cover steady tempo with poll-sized and USB-sized jitter,
+// a ramp, a jump and stray late ticks. A recorded trace (same format as
+// midi_bench, only 0xF8 bytes are used) has no known tempo, so it only
+// reports prediction error and the estimator's own statistics.
+//
+//   tempo_bench [trace.txt]
+// -------------------------------------------------------------------------
+
+#include "../TempoEstimator.h"
+#include "../MidiClock.h"
+#include "../MidiDefs.h"
+#include <vector>
+
+struct Trace {
+  const char* name;
+  std::vector<double> ticks; // arrival, samples
+  std::vector<double> bpm;   // true tempo at each tick, empty when unknown
+  size_t changeAt = 0;       // tick the tempo jumps or settles at, 0 for none
+};
+
+struct Score {
+  long converge = -1;
+  double errSum = 0, errMax = 0;
+  long errCount = 0;
+  double predSq = 0;
+  long predCount = 0;
+};
+
+static uint32_t seed = 4242;
+static double jitter(double amount) {
+  seed = seed * 1664525u + 1013904223u;
+  return ((seed >> 8) / 16777216.0 * 2.0 - 1.0) * amount;
+}
+
+static double msToSamples(double ms) { return ms * SAMPLE_RATE / 1000.0; }
+
+// Ticks for a tempo curve bpm(beat), with uniform jitter
+template <typename Curve>
+static Trace synthesize(const char* name, double beats, double jitterMs, Curve curve, size_t changeAt = 0) {
+  Trace trace;
+  trace.name = name;
+  trace.changeAt = changeAt;
+  double t = SAMPLE_RATE; // start a second in
+  for (long k = 0; k < beats * MidiClock::TICKS_PER_BEAT; k++) {
+    double bpm = curve(k / (double)MidiClock::TICKS_PER_BEAT);
+    trace.ticks.push_back(t + jitter(msToSamples(jitterMs)));
+    trace.bpm.push_back(bpm);
+    t += 60.0 * SAMPLE_RATE / (bpm * MidiClock::TICKS_PER_BEAT);
+  }
+  return trace;
+}
+
+static Trace loadTrace(const char* path) {
+  Trace trace;
+  trace.name = path;
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    exit(1);
+  }
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    char* hash = strchr(line, '#');
+    if (hash) *hash = 0;
+    char* end;
+    double us = strtod(line, &end);
+    if (end == line) continue;
+    char* cursor = end;
+    while (true) {
+      long value = strtol(cursor, &end, 16);
+      if (end == cursor) break;
+      if (value == MIDI_STATUS_CLOCK) trace.ticks.push_back(us * SAMPLE_RATE / 1e6);
+      cursor = end;
+    }
+  }
+  fclose(file);
+  return trace;
+}
+
+// Scores one estimate against the trace at tick k (the estimate includes tick k)
+static void score(Score& s, const Trace& trace, size_t k, double bpm, double predicted, long& inBand) {
+  if (k + 1 < trace.ticks.size() && predicted > 0) {
+    double e = predicted - trace.ticks[k + 1];
+    s.predSq += e * e;
+    s.predCount++;
+  }
+  if (trace.bpm.empty()) return;
+
+  double err = fabs(bpm - trace.bpm[k]);
+  bool tracking = bpm > 0 && err < 0.005 * trace.bpm[k];
+  size_t from = k >= trace.changeAt ? trace.changeAt : 0;
+
+  inBand = tracking ? inBand + 1 : 0;
+  if (s.converge < 0 && inBand >= MidiClock::TICKS_PER_BEAT) {
+    s.converge = (long)(k - from) - MidiClock::TICKS_PER_BEAT + 1;
+  }
+  if (k >= (size_t)MidiClock::TICKS_PER_BEAT) {
+    s.errSum += err;
+    s.errCount++;
+    if (err > s.errMax) s.errMax = err;
+  }
+  // Converging again after the change is what counts
+  if (trace.changeAt > 0 && k + 1 == trace.changeAt) {
+    s.converge = -1;
+    inBand = 0;
+  }
+}
+
+static Score runPrevious(const Trace& trace) {
+  const int window = MidiClock::TICKS_PER_BEAT + 1;
+  std::vector<double> stamps;
+  double bpm = 0;
+  long inBand = 0;
+  Score s;
+  for (size_t k = 0; k < trace.ticks.size(); k++) {
+    stamps.push_back(trace.ticks[k]);
+    if ((int)stamps.size() >= window) {
+      double duration = stamps.back() - stamps[stamps.size() - window];
+      double instant = 60.0 * SAMPLE_RATE / duration;
+      bpm = bpm == 0 ? instant : bpm * 0.9 + instant * 0.1;
+    }
+    double predicted = bpm > 0 ? trace.ticks[k] + 60.0 * SAMPLE_RATE / (bpm * MidiClock::TICKS_PER_BEAT) : 0;
+    score(s, trace, k, bpm, predicted, inBand);
+  }
+  return s;
+}
+
+static Score runEstimator(const Trace& trace, TempoEstimator& tempo) {
+  tempo.reset();
+  long inBand = 0;
+  Score s;
+  for (size_t k = 0; k < trace.ticks.size(); k++) {
+    tempo.addTick((uint32_t)lround(trace.ticks[k]));
+    double spt = tempo.getSamplesPerTick();
+    double bpm = spt > 0 ? 60.0 * SAMPLE_RATE / (spt * MidiClock::TICKS_PER_BEAT) : 0;
+    double predicted = spt > 0 ? (double)tempo.predictNext(1) : 0;
+    score(s, trace, k, bpm, predicted, inBand);
+  }
+  return s;
+}
+
+static void report(const char* estimator, const Score& s, bool known) {
+  char converge[24] = "-";
+  if (known && s.converge >= 0) snprintf(converge, sizeof(converge), "%ld", s.converge);
+  else if (known) snprintf(converge, sizeof(converge), "never");
+  printf("  %-9s %9s %9.3f %9.3f %9.1f\n", estimator, converge,
+         s.errCount ? s.errSum / s.errCount : 0.0, s.errMax,
+         s.predCount ? sqrt(s.predSq / s.predCount) : 0.0);
+}
+
+int main(int argc, char** argv) {
+  std::vector<Trace> traces;
+  if (argc > 1) {
+    traces.push_back(loadTrace(argv[1]));
+  } else {
+    traces.push_back(synthesize("steady 120, 0.25 ms", 64, 0.25, [](double) { return 120.0; }));
+    traces.push_back(synthesize("steady 120, 2 ms", 64, 2.0, [](double) { return 120.0; }));
+    traces.push_back(synthesize("ramp 100-140, 0.5 ms", 64, 0.5,
+                                [](double beat) { return beat < 32 ? 100.0 + 40.0 * beat / 32 : 140.0; },
+                                32 * MidiClock::TICKS_PER_BEAT));
+    traces.push_back(synthesize("jump 120-90, 0.5 ms", 64, 0.5,
+                                [](double beat) { return beat < 32 ? 120.0 : 90.0; }, 32 * MidiClock::TICKS_PER_BEAT));
+    Trace stray = synthesize("stray ticks 128, 0.5 ms", 64, 0.5, [](double) { return 128.0; });
+    for (size_t k = 37; k < stray.ticks.size(); k += 37) stray.ticks[k] += msToSamples(6.0);
+    traces.push_back(stray);
+  }
+
+  TempoEstimator tempo;
+  printf("  %-9s %9s %9s %9s %9s\n", "", "converge", "err mean", "err max", "pred rms");
+  printf("  %-9s %9s %9s %9s %9s\n", "", "ticks", "bpm", "bpm", "samples");
+  for (const Trace& trace : traces) {
+    bool known = !trace.bpm.empty();
+    printf("%s (%zu ticks)\n", trace.name, trace.ticks.size());
+    report("previous", runPrevious(trace), known);
+    report("fit", runEstimator(trace, tempo), known);
+    printf("  fit stats: jitter %.1f, error sd %.1f max %.0f samples, %u outliers, %u tempo changes\n",
+           tempo.getJitter(), tempo.getErrorStdDev(), tempo.getErrorMax(), tempo.getOutliers(),
+           tempo.getTempoChanges());
+  }
+  return 0;
+}
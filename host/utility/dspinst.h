@@ -0,0 +1,46 @@
+#ifndef HOST_DSPINST_H
+#define HOST_DSPINST_H
+
+// -------------------------------------------------------------------------
+// Portable versions of the Audio library's Cortex-M DSP intrinsics.
+// Same results as the SSAT/SMULWB/PKHBT instructions they replace.
+// -------------------------------------------------------------------------
+
+#include <stdint.h>
+
+static inline int32_t signed_saturate_rshift(int32_t val, int bits, int rshift) {
+  int32_t out = val >> rshift;
+  int32_t max = 1 << (bits - 1);
+  if (out >= max) return max - 1;
+  if (out < -max) return -max;
+  return out;
+}
+
+static inline int16_t saturate16(int32_t val) {
+  return (int16_t)signed_saturate_rshift(val, 16, 0);
+}
+
+// (a * bottom 16 bits of b) >> 16
+static inline int32_t signed_multiply_32x16b(int32_t a, uint32_t b) {
+  return (int32_t)(((int64_t)a * (int16_t)(b & 0xFFFF)) >> 16);
+}
+
+// (a * top 16 bits of b) >> 16
+static inline int32_t signed_multiply_32x16t(int32_t a, uint32_t b) {
+  return (int32_t)(((int64_t)a * (int16_t)(b >> 16)) >> 16);
+}
+
+static inline int32_t multiply_32x32_rshift32(int32_t a, int32_t b) {
+  return (int32_t)(((int64_t)a * (int64_t)b) >> 32);
+}
+
+// a in the top half, b in the bottom half
+static inline uint32_t pack_16b_16b(int32_t a, int32_t b) {
+  return ((uint32_t)a << 16) | ((uint32_t)b & 0x0000FFFF);
+}
+
+static inline uint32_t pack_16t_16b(int32_t a, int32_t b) {
+  return ((uint32_t)a & 0xFFFF0000) | ((uint32_t)b & 0x0000FFFF);
+}
+
+#endif // HOST_DSPINST_H